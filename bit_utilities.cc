@@ -2,9 +2,24 @@
 
 #include <cstdint>
 #include <algorithm>  // (for std::min)
+#include <vector>
+#include <atomic>
+#include <thread>
 
 #include "bit_utilities.h"
 
+// hardware popcount support is only compiled for x86-64 with gcc-compatible
+// compilers; the avx-512 kernel also requires a compiler that knows about the
+// vpopcntdq extension; other platforms just use the lookup table
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define bitwise_hardwarePopcount
+#include <immintrin.h>
+#if (!defined(__clang__)) && (__GNUC__ >= 8)
+#define bitwise_avx512Popcount
+#endif
+#endif
+
 #define u8  std::uint8_t
 #define u64 std::uint64_t
 
@@ -1151,6 +1166,392 @@ overrun:
 	return bitsInDst + bitsInDstChunk;
 	}
 
+//----------
+//
+// popcount kernels--
+//	Count the 1s in the result of a bitwise operation between two arrays of
+//	64-bit words, using the fastest method the CPU supports.
+//
+//----------
+//
+// Notes:
+//	(1)	The kernel is chosen once, at the first call, by querying the CPU. In
+//		order of preference we use avx-512 vpopcntdq, avx2 (with the Harley-
+//		Seal carry-save adder method, see [1]), the popcnt instruction, and
+//		finally the popCount8 lookup table. The lookup table kernel gives the
+//		same results as the earlier byte-at-a-time code, and is what every
+//		kernel is expected to match, bit for bit.
+//	(2)	The bitwise operation is supplied as a template argument, a struct
+//		with a word() function for 64-bit words, and vec256() and vec512()
+//		functions for avx2 and avx-512 registers.
+//	(3)	Callers are responsible for any partial word at the end of a bit
+//		array.
+//	(4)	bitwise_set_popcount_kernel() overrides the choice, so that each
+//		supported kernel can be checked against the lookup table (see the
+//		validatepopcount command). It isn't meant to be used while other
+//		threads are counting.
+//
+// References:
+//	[1]	Muła, Wojciech, Nathan Kurz, and Daniel Lemire. "Faster population
+//		counts using AVX2 instructions." The Computer Journal 61.1 (2018):
+//		111-120.
+//
+//----------
+
+#ifdef bitwise_hardwarePopcount
+#define bitwise_target(features) __attribute__((target(features)))
+#else
+#define bitwise_target(features)
+#endif
+
+struct popOpFirst
+	{
+	static inline u64 word (u64 a, u64 b) { return a; }
+#ifdef bitwise_hardwarePopcount
+	bitwise_target("avx2")
+	static inline __m256i vec256 (__m256i a, __m256i b) { return a; }
+#ifdef bitwise_avx512Popcount
+	bitwise_target("avx512f")
+	static inline __m512i vec512 (__m512i a, __m512i b) { return a; }
+#endif
+#endif
+	};
+
+struct popOpAnd
+	{
+	static inline u64 word (u64 a, u64 b) { return a & b; }
+#ifdef bitwise_hardwarePopcount
+	bitwise_target("avx2")
+	static inline __m256i vec256 (__m256i a, __m256i b) { return _mm256_and_si256(a,b); }
+#ifdef bitwise_avx512Popcount
+	bitwise_target("avx512f")
+	static inline __m512i vec512 (__m512i a, __m512i b) { return _mm512_and_si512(a,b); }
+#endif
+#endif
+	};
+
+struct popOpMask
+	{
+	static inline u64 word (u64 a, u64 b) { return a & ~b; }
+#ifdef bitwise_hardwarePopcount
+	bitwise_target("avx2")
+	static inline __m256i vec256 (__m256i a, __m256i b) { return _mm256_andnot_si256(b,a); }
+#ifdef bitwise_avx512Popcount
+	bitwise_target("avx512f")
+	static inline __m512i vec512 (__m512i a, __m512i b)
+		{ return _mm512_and_si512(a,_mm512_xor_si512(b,_mm512_set1_epi64(-1))); }
+#endif
+#endif
+	};
+
+struct popOpOr
+	{
+	static inline u64 word (u64 a, u64 b) { return a | b; }
+#ifdef bitwise_hardwarePopcount
+	bitwise_target("avx2")
+	static inline __m256i vec256 (__m256i a, __m256i b) { return _mm256_or_si256(a,b); }
+#ifdef bitwise_avx512Popcount
+	bitwise_target("avx512f")
+	static inline __m512i vec512 (__m512i a, __m512i b) { return _mm512_or_si512(a,b); }
+#endif
+#endif
+	};
+
+struct popOpOrNot
+	{
+	static inline u64 word (u64 a, u64 b) { return a | ~b; }
+#ifdef bitwise_hardwarePopcount
+	bitwise_target("avx2")
+	static inline __m256i vec256 (__m256i a, __m256i b)
+		{ return _mm256_or_si256(a,_mm256_xor_si256(b,_mm256_set1_epi64x(-1))); }
+#ifdef bitwise_avx512Popcount
+	bitwise_target("avx512f")
+	static inline __m512i vec512 (__m512i a, __m512i b)
+		{ return _mm512_or_si512(a,_mm512_xor_si512(b,_mm512_set1_epi64(-1))); }
+#endif
+#endif
+	};
+
+struct popOpXor
+	{
+	static inline u64 word (u64 a, u64 b) { return a ^ b; }
+#ifdef bitwise_hardwarePopcount
+	bitwise_target("avx2")
+	static inline __m256i vec256 (__m256i a, __m256i b) { return _mm256_xor_si256(a,b); }
+#ifdef bitwise_avx512Popcount
+	bitwise_target("avx512f")
+	static inline __m512i vec512 (__m512i a, __m512i b) { return _mm512_xor_si512(a,b); }
+#endif
+#endif
+	};
+
+
+bool bitwise_popcount_kernel_supported
+   (const int kernel)
+	{
+	switch (kernel)
+		{
+		case popcntkernel_table:
+			return true;
+#ifdef bitwise_hardwarePopcount
+#ifdef bitwise_avx512Popcount
+		case popcntkernel_avx512:
+			__builtin_cpu_init();
+			return (__builtin_cpu_supports("avx512f"))
+			    && (__builtin_cpu_supports("avx512vpopcntdq"));
+#endif
+		case popcntkernel_avx2:
+			__builtin_cpu_init();
+			return (__builtin_cpu_supports("avx2"))
+			    && (__builtin_cpu_supports("popcnt"));
+		case popcntkernel_popcnt:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("popcnt");
+#endif
+		default:
+			return false;
+		}
+	}
+
+const char* bitwise_popcount_kernel_name
+   (const int kernel)
+	{
+	switch (kernel)
+		{
+		case popcntkernel_table:  return "table";
+		case popcntkernel_popcnt: return "popcnt";
+		case popcntkernel_avx2:   return "avx2";
+		case popcntkernel_avx512: return "avx512";
+		default:                  return "(unknown)";
+		}
+	}
+
+static int choose_popcount_kernel ()
+	{
+	for (int kernel=popcntkernel_avx512 ; kernel>popcntkernel_table ; kernel--)
+		{
+		if (bitwise_popcount_kernel_supported(kernel)) return kernel;
+		}
+	return popcntkernel_table;
+	}
+
+static int forcedPopcountKernel = -1;  // (see note 4)
+
+int bitwise_popcount_kernel ()
+	{
+	static const int kernel = choose_popcount_kernel();
+	return (forcedPopcountKernel >= 0)? forcedPopcountKernel : kernel;
+	}
+
+bool bitwise_set_popcount_kernel
+   (const int kernel)
+	{
+	if (kernel < 0)
+		{ forcedPopcountKernel = -1;  return true; }
+	if (!bitwise_popcount_kernel_supported(kernel)) return false;
+	forcedPopcountKernel = kernel;
+	return true;
+	}
+
+
+template <class Op>
+static u64 count_words_table
+   (const u64*	scan1,
+	const u64*	scan2,
+	const u64	numWords)
+	{
+	u64			numOnes = 0;
+
+	for (u64 wIx=0 ; wIx<numWords ; wIx++)
+		{
+		u64 w = Op::word(scan1[wIx],scan2[wIx]);
+		for (int byteIx=0 ; byteIx<8 ; byteIx++,w>>=8)
+			numOnes += popCount8[w & 0xFF];
+		}
+
+	return numOnes;
+	}
+
+#ifdef bitwise_hardwarePopcount
+
+template <class Op>
+bitwise_target("popcnt")
+static u64 count_words_popcnt
+   (const u64*	scan1,
+	const u64*	scan2,
+	const u64	numWords)
+	{
+	u64			numOnes = 0;
+
+	for (u64 wIx=0 ; wIx<numWords ; wIx++)
+		numOnes += __builtin_popcountll(Op::word(scan1[wIx],scan2[wIx]));
+
+	return numOnes;
+	}
+
+
+bitwise_target("avx2")
+static inline __m256i popcount256
+   (__m256i	v)
+	{
+	// count 1s in each nibble by table lookup, then sum the bytes in each
+	// 64-bit lane
+
+	const __m256i nibbleCount = _mm256_setr_epi8
+	                             (0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+	                              0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+	const __m256i lowNibble   = _mm256_set1_epi8(0x0F);
+
+	__m256i lo = _mm256_and_si256(v,lowNibble);
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v,4),lowNibble);
+	__m256i byteCounts = _mm256_add_epi8(_mm256_shuffle_epi8(nibbleCount,lo),
+	                                     _mm256_shuffle_epi8(nibbleCount,hi));
+	return _mm256_sad_epu8(byteCounts,_mm256_setzero_si256());
+	}
+
+bitwise_target("avx2")
+static inline void carry_save_add
+   (__m256i&	h,
+	__m256i&	l,
+	__m256i		a,
+	__m256i		b,
+	__m256i		c)
+	{
+	__m256i u = _mm256_xor_si256(a,b);
+	h = _mm256_or_si256(_mm256_and_si256(a,b),_mm256_and_si256(u,c));
+	l = _mm256_xor_si256(u,c);
+	}
+
+template <class Op>
+bitwise_target("avx2,popcnt")
+static u64 count_words_avx2
+   (const u64*	scan1,
+	const u64*	scan2,
+	const u64	numWords)
+	{
+	const __m256i* v1 = (const __m256i*) scan1;
+	const __m256i* v2 = (const __m256i*) scan2;
+	u64 numBlocks = numWords / 4;   // (256-bit blocks)
+	u64 blockIx   = 0;
+
+	#define block(ix) Op::vec256(_mm256_loadu_si256(v1+(ix)),_mm256_loadu_si256(v2+(ix)))
+
+	__m256i total    = _mm256_setzero_si256();
+	__m256i ones     = _mm256_setzero_si256();
+	__m256i twos     = _mm256_setzero_si256();
+	__m256i fours    = _mm256_setzero_si256();
+	__m256i eights   = _mm256_setzero_si256();
+	__m256i sixteens, twosA, twosB, foursA, foursB, eightsA, eightsB;
+
+	// Harley-Seal, 16 blocks at a time
+
+	for ( ; blockIx+16<=numBlocks ; blockIx+=16)
+		{
+		carry_save_add (twosA,   ones,   ones,   block(blockIx+0),  block(blockIx+1));
+		carry_save_add (twosB,   ones,   ones,   block(blockIx+2),  block(blockIx+3));
+		carry_save_add (foursA,  twos,   twos,   twosA,             twosB);
+		carry_save_add (twosA,   ones,   ones,   block(blockIx+4),  block(blockIx+5));
+		carry_save_add (twosB,   ones,   ones,   block(blockIx+6),  block(blockIx+7));
+		carry_save_add (foursB,  twos,   twos,   twosA,             twosB);
+		carry_save_add (eightsA, fours,  fours,  foursA,            foursB);
+		carry_save_add (twosA,   ones,   ones,   block(blockIx+8),  block(blockIx+9));
+		carry_save_add (twosB,   ones,   ones,   block(blockIx+10), block(blockIx+11));
+		carry_save_add (foursA,  twos,   twos,   twosA,             twosB);
+		carry_save_add (twosA,   ones,   ones,   block(blockIx+12), block(blockIx+13));
+		carry_save_add (twosB,   ones,   ones,   block(blockIx+14), block(blockIx+15));
+		carry_save_add (foursB,  twos,   twos,   twosA,             twosB);
+		carry_save_add (eightsB, fours,  fours,  foursA,            foursB);
+		carry_save_add (sixteens,eights, eights, eightsA,           eightsB);
+		total = _mm256_add_epi64(total,popcount256(sixteens));
+		}
+
+	total = _mm256_slli_epi64(total,4);
+	total = _mm256_add_epi64(total,_mm256_slli_epi64(popcount256(eights),3));
+	total = _mm256_add_epi64(total,_mm256_slli_epi64(popcount256(fours), 2));
+	total = _mm256_add_epi64(total,_mm256_slli_epi64(popcount256(twos),  1));
+	total = _mm256_add_epi64(total,popcount256(ones));
+
+	// leftover blocks, one at a time
+
+	for ( ; blockIx<numBlocks ; blockIx++)
+		total = _mm256_add_epi64(total,popcount256(block(blockIx)));
+
+	#undef block
+
+	u64 lanes[4];
+	_mm256_storeu_si256((__m256i*) lanes,total);
+	u64 numOnes = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+	// leftover words
+
+	for (u64 wIx=4*numBlocks ; wIx<numWords ; wIx++)
+		numOnes += __builtin_popcountll(Op::word(scan1[wIx],scan2[wIx]));
+
+	return numOnes;
+	}
+
+#ifdef bitwise_avx512Popcount
+
+template <class Op>
+bitwise_target("avx512f,avx512vpopcntdq,popcnt")
+static u64 count_words_avx512
+   (const u64*	scan1,
+	const u64*	scan2,
+	const u64	numWords)
+	{
+	const __m512i* v1 = (const __m512i*) scan1;
+	const __m512i* v2 = (const __m512i*) scan2;
+	u64 numBlocks = numWords / 8;   // (512-bit blocks)
+
+	__m512i total = _mm512_setzero_si512();
+	for (u64 blockIx=0 ; blockIx<numBlocks ; blockIx++)
+		{
+		__m512i v = Op::vec512(_mm512_loadu_si512(v1+blockIx),_mm512_loadu_si512(v2+blockIx));
+		total = _mm512_add_epi64(total,_mm512_popcnt_epi64(v));
+		}
+
+	u64 lanes[8];
+	_mm512_storeu_si512((__m512i*) lanes,total);
+	u64 numOnes = 0;
+	for (int laneIx=0 ; laneIx<8 ; laneIx++)
+		numOnes += lanes[laneIx];
+
+	for (u64 wIx=8*numBlocks ; wIx<numWords ; wIx++)
+		numOnes += __builtin_popcountll(Op::word(scan1[wIx],scan2[wIx]));
+
+	return numOnes;
+	}
+
+#endif // bitwise_avx512Popcount
+#endif // bitwise_hardwarePopcount
+
+
+template <class Op>
+static u64 count_words
+   (const void*	bits1,
+	const void*	bits2,
+	const u64	numWords)
+	{
+	const u64* scan1 = (const u64*) bits1;
+	const u64* scan2 = (const u64*) bits2;
+
+	switch (bitwise_popcount_kernel())
+		{
+#ifdef bitwise_hardwarePopcount
+#ifdef bitwise_avx512Popcount
+		case popcntkernel_avx512:
+			return count_words_avx512<Op> (scan1, scan2, numWords);
+#endif
+		case popcntkernel_avx2:
+			return count_words_avx2<Op>   (scan1, scan2, numWords);
+		case popcntkernel_popcnt:
+			return count_words_popcnt<Op> (scan1, scan2, numWords);
+#endif
+		default:
+			return count_words_table<Op>  (scan1, scan2, numWords);
+		}
+	}
+
 //----------
 //
 // bitwise_count --
@@ -1172,6 +1573,9 @@ overrun:
 //	(1)	The number of bytes in the bit arrays is ceil(numBits/8). When numBits
 //		is not a multiple of 8, the remaining bits are read from the least
 //		significant bits of the final byte.
+//	(2)	We process the bytes in 64-bit chunks (using one of the popcount
+//		kernels) until we get to the final chunk. The final chunk is processed
+//		byte-by-byte, so that we do not access any bytes beyond the bit array.
 //
 //----------
 
@@ -1179,11 +1583,12 @@ u64 bitwise_count
    (const void*	bits,
 	const u64	numBits)
 	{
-	u8*			scan = (u8*) bits;
+	u64			numWords = numBits / 64;
+	u64			numOnes  = count_words<popOpFirst> (bits, bits, numWords);
+	u8*			scan = (u8*) (((u64*) bits) + numWords);
 	u64			n;
-	u64			numOnes = 0;
 
-	for (n=numBits ; n>=8 ; n-=8)
+	for (n=numBits-64*numWords ; n>=8 ; n-=8)
 		numOnes += popCount8[*(scan++)];
 
 	if (n == 0) return numOnes;
@@ -1218,6 +1623,8 @@ u64 bitwise_count
 //		is not a multiple of 8, the remaining bits are read from the least
 //		significant bits of the final byte.
 //	(2)	bitwise_xor_count() is equivalent to hamming distance.
+//	(3)	As with bitwise_count(), all but the final partial 64-bit chunk are
+//		counted by one of the popcount kernels.
 //
 //----------
 
@@ -1226,12 +1633,13 @@ u64 bitwise_and_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
+	u64			numWords = numBits / 64;
+	u64			numOnes  = count_words<popOpAnd> (bits1, bits2, numWords);
+	u8*			scan1 = (u8*) (((u64*) bits1) + numWords);
+	u8*			scan2 = (u8*) (((u64*) bits2) + numWords);
 	u64			n;
-	u64			numOnes = 0;
 
-	for (n=numBits ; n>=8 ; n-=8)
+	for (n=numBits-64*numWords ; n>=8 ; n-=8)
 		numOnes += popCount8[*(scan1++) & *(scan2++)];
 
 	if (n == 0) return numOnes;
@@ -1247,12 +1655,13 @@ u64 bitwise_mask_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
+	u64			numWords = numBits / 64;
+	u64			numOnes  = count_words<popOpMask> (bits1, bits2, numWords);
+	u8*			scan1 = (u8*) (((u64*) bits1) + numWords);
+	u8*			scan2 = (u8*) (((u64*) bits2) + numWords);
 	u64			n;
-	u64			numOnes = 0;
 
-	for (n=numBits ; n>=8 ; n-=8)
+	for (n=numBits-64*numWords ; n>=8 ; n-=8)
 		numOnes += popCount8[*(scan1++) & ~*(scan2++)];
 
 	if (n == 0) return numOnes;
@@ -1268,12 +1677,13 @@ u64 bitwise_or_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
+	u64			numWords = numBits / 64;
+	u64			numOnes  = count_words<popOpOr> (bits1, bits2, numWords);
+	u8*			scan1 = (u8*) (((u64*) bits1) + numWords);
+	u8*			scan2 = (u8*) (((u64*) bits2) + numWords);
 	u64			n;
-	u64			numOnes = 0;
 
-	for (n=numBits ; n>=8 ; n-=8)
+	for (n=numBits-64*numWords ; n>=8 ; n-=8)
 		numOnes += popCount8[*(scan1++) | *(scan2++)];
 
 	if (n == 0) return numOnes;
@@ -1289,12 +1699,13 @@ u64 bitwise_or_not_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
+	u64			numWords = numBits / 64;
+	u64			numOnes  = count_words<popOpOrNot> (bits1, bits2, numWords);
+	u8*			scan1 = (u8*) (((u64*) bits1) + numWords);
+	u8*			scan2 = (u8*) (((u64*) bits2) + numWords);
 	u64			n;
-	u64			numOnes = 0;
 
-	for (n=numBits ; n>=8 ; n-=8)
+	for (n=numBits-64*numWords ; n>=8 ; n-=8)
 		numOnes += popCount8[*(scan1++) | ((u8)~*(scan2++))];
 
 	if (n == 0) return numOnes;
@@ -1310,12 +1721,13 @@ u64 bitwise_xor_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
+	u64			numWords = numBits / 64;
+	u64			numOnes  = count_words<popOpXor> (bits1, bits2, numWords);
+	u8*			scan1 = (u8*) (((u64*) bits1) + numWords);
+	u8*			scan2 = (u8*) (((u64*) bits2) + numWords);
 	u64			n;
-	u64			numOnes = 0;
 
-	for (n=numBits ; n>=8 ; n-=8)
+	for (n=numBits-64*numWords ; n>=8 ; n-=8)
 		numOnes += popCount8[*(scan1++) ^ *(scan2++)];
 
 	if (n == 0) return numOnes;
@@ -1325,3 +1737,121 @@ u64 bitwise_xor_count
 
 	return numOnes;
 	}
+
+//----------
+//
+// bitwise_tile_size--
+//	Determine how many bit arrays should be in a tile, for all-vs-all
+//	comparisons of bit arrays.
+//
+//----------
+//
+// Arguments:
+//	const u64	numBits:	The number of bits in each bit array.
+//
+// Returns:
+//	The number of bit arrays per tile (at least 1).
+//
+//----------
+//
+// Notes:
+//	(1)	The goal is that two tiles' worth of bit arrays (one for rows and one
+//		for columns) fit in a typical L2 cache, so that as a tile of rows is
+//		compared against a tile of columns each array is read from memory
+//		only once.
+//
+//----------
+
+#define tileCacheBytes (256*1024)
+
+std::uint32_t bitwise_tile_size
+   (const u64	numBits)
+	{
+	u64 bytesPerArray = (numBits+7) / 8;
+	if (bytesPerArray == 0) bytesPerArray = 1;
+	u64 tileSize = tileCacheBytes / (2*bytesPerArray);
+	if (tileSize < 1)    tileSize = 1;
+	if (tileSize > 1024) tileSize = 1024;
+	return (std::uint32_t) tileSize;
+	}
+
+//----------
+//
+// for_each_tile_pair--
+//	Partition a grid of (row,col) pairs into square tiles, and process the
+//	tiles, possibly with several threads.
+//
+//----------
+//
+// Arguments:
+//	const u32		numRows:		The number of rows in the grid.
+//	const u32		numCols:		The number of columns in the grid.
+//	const u32		tileSize:		The number of rows (and columns) per tile.
+//	const u32		numThreads:		The number of threads to use. If this is
+//									.. 1, the tiles are processed in this
+//									.. thread, in row-major order.
+//	const bool		upperTriangle:	true => skip tiles that contain only pairs
+//									.. with col <= row; note that processTile
+//									.. must still skip such pairs in tiles
+//									.. that straddle the diagonal.
+//	const tilefunc&	processTile:	The function to call for each tile; it is
+//									.. called as
+//									..   processTile(threadNum,
+//									..               rowStart,rowEnd,
+//									..               colStart,colEnd)
+//									.. with threadNum in 0..numThreads-1.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	Threads take tiles from a shared counter, so a thread that finishes
+//		its tiles early takes on more. processTile must not write to anything
+//		shared with other tiles, except through its own threadNum.
+//
+//----------
+
+void for_each_tile_pair
+   (const std::uint32_t	numRows,
+	const std::uint32_t	numCols,
+	const std::uint32_t	tileSize,
+	const std::uint32_t	numThreads,
+	const bool			upperTriangle,
+	const tilefunc&		processTile)
+	{
+	std::uint32_t tileRows = (numRows + tileSize-1) / tileSize;
+	std::uint32_t tileCols = (numCols + tileSize-1) / tileSize;
+	u64           numTiles = ((u64) tileRows) * tileCols;
+
+	std::atomic<u64> nextTile(0);
+
+	auto worker = [&](std::uint32_t threadNum)
+		{
+		while (true)
+			{
+			u64 tileIx = nextTile++;
+			if (tileIx >= numTiles) break;
+
+			std::uint32_t rowStart = (std::uint32_t) (tileIx / tileCols) * tileSize;
+			std::uint32_t colStart = (std::uint32_t) (tileIx % tileCols) * tileSize;
+			std::uint32_t rowEnd   = std::min (rowStart+tileSize, numRows);
+			std::uint32_t colEnd   = std::min (colStart+tileSize, numCols);
+			if ((upperTriangle) && (colEnd <= rowStart+1)) continue;
+
+			processTile (threadNum, rowStart, rowEnd, colStart, colEnd);
+			}
+		};
+
+	if (numThreads <= 1)
+		{ worker(0);  return; }
+
+	std::vector<std::thread> workers;
+	for (std::uint32_t threadNum=1 ; threadNum<numThreads ; threadNum++)
+		workers.emplace_back(worker,threadNum);
+	worker(0);
+
+	for (auto& w : workers)
+		w.join();
+	}
@@ -1,6 +1,8 @@
 #ifndef bit_utilities_H
 #define bit_utilities_H
 
+#include <functional>
+
 //----------
 //
 // prototypes for functions in this module--
@@ -39,4 +41,31 @@ std::uint64_t bitwise_xor_count    (const void* bits1, const void* bits2, const
 
 #define hamming_distance(bits1,bits2,numBits) (bitwise_xor_count((bits1),(bits2),(numBits)))
 
+// the counting functions use one of these popcount kernels, chosen to suit
+// the cpu; the choice can be overridden, for validation
+
+enum
+	{
+	popcntkernel_table   = 0,
+	popcntkernel_popcnt  = 1,
+	popcntkernel_avx2    = 2,
+	popcntkernel_avx512  = 3
+	};
+
+bool          bitwise_popcount_kernel_supported (const int kernel);
+const char*   bitwise_popcount_kernel_name      (const int kernel);
+int           bitwise_popcount_kernel           (void);
+bool          bitwise_set_popcount_kernel       (const int kernel);
+
+// for_each_tile_pair() calls a function for each tile of a grid of (row,col)
+// pairs; the arguments are the thread number, then the tile's row and column
+// ranges (start inclusive, end exclusive)
+
+typedef std::function<void(std::uint32_t,std::uint32_t,std::uint32_t,std::uint32_t,std::uint32_t)> tilefunc;
+
+std::uint32_t bitwise_tile_size    (const std::uint64_t numBits);
+void          for_each_tile_pair   (const std::uint32_t numRows, const std::uint32_t numCols,
+                                    const std::uint32_t tileSize, const std::uint32_t numThreads,
+                                    const bool upperTriangle, const tilefunc& processTile);
+
 #endif // bit_utilities_H
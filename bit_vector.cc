@@ -3,10 +3,15 @@
 #include <string>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <chrono>
 #include <sdsl/bit_vectors.hpp>
 #include <sdsl/sfstream.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "utilities.h"
 #include "bit_utilities.h"
@@ -83,6 +88,12 @@ u64    BitVector::totalSelectNews     = 0;
 u64    BitVector::totalRankCalls      = 0;
 u64    BitVector::totalSelectCalls    = 0;
 
+bool   BitVector::useMemoryMap        = false;
+bool   BitVector::verifyChecksums     = false;
+
+u32    RrrBitVector::defaultBlockSize  = RRR_BLOCK_SIZE;
+u32    RrrBitVector::defaultRankPeriod = RRR_RANK_PERIOD;
+
 //----------
 //
 // BitVector--
@@ -181,6 +192,8 @@ void BitVector::load()
 
 	if (isResident) return;
 
+	if ((verifyChecksums) && (hasChecksum)) verify_checksum();
+
 	if (reportLoad)
 		cerr << "loading " << identity() << endl;
 
@@ -294,6 +307,140 @@ size_t BitVector::serialized_out
 	return (size_t) bits->serialize (out, nullptr, "");
 	}
 
+//----------
+//
+// checksummed_out--
+//	Serialize the bit vector to a stream, computing a checksum of the bytes
+//	written.
+//
+//----------
+//
+// Arguments:
+//	std::ofstream&	out:	The stream to write to.
+//	u32&			crc:	Place to return the checksum (CRC32C).
+//
+// Returns:
+//	The number of bytes written.
+//
+//----------
+//
+// Notes:
+//	(1)	We compute the checksum as the bytes pass through, by temporarily
+//		interposing a stream buffer, so no re-reading is required and the
+//		serialization routines needn't know about it.
+//
+//----------
+
+class ChecksumStreamBuf: public std::streambuf
+	{
+public:
+	ChecksumStreamBuf(std::streambuf* _dest): dest(_dest), crc(0) {}
+
+protected:
+	virtual int overflow (int ch)
+		{
+		if (ch == traits_type::eof()) return traits_type::not_eof(ch);
+		char c = (char) ch;
+		crc = crc32c (crc, &c, 1);
+		return dest->sputc(c);
+		}
+
+	virtual std::streamsize xsputn (const char* s, std::streamsize n)
+		{
+		std::streamsize written = dest->sputn(s,n);
+		if (written > 0) crc = crc32c (crc, s, (size_t) written);
+		return written;
+		}
+
+	virtual std::streampos seekoff (std::streamoff off, std::ios_base::seekdir dir,
+	                                std::ios_base::openmode which)
+		{
+		// only position queries (e.g. tellp) are supported
+		if ((off != 0) || (dir != std::ios_base::cur)) return std::streampos(-1);
+		return dest->pubseekoff(off,dir,which);
+		}
+
+	virtual int sync () { return dest->pubsync(); }
+
+public:
+	std::streambuf* dest;
+	u32 crc;
+	};
+
+
+size_t BitVector::checksummed_out
+   (std::ofstream&	out,
+	u32&			crc)
+	{
+	ChecksumStreamBuf checksummer(out.rdbuf());
+	std::streambuf* fileBuf = out.std::ios::rdbuf(&checksummer);
+	size_t bytesWritten = serialized_out (out);
+	out.std::ios::rdbuf(fileBuf);
+	crc = checksummer.crc;
+	return bytesWritten;
+	}
+
+//----------
+//
+// verify_checksum--
+//	Read the vector's data from its file, and make sure it matches the
+//	checksum we were given for it.
+//
+//----------
+//
+// Arguments:
+//	(none)
+//
+// Returns:
+//	(nothing); a mismatch is fatal
+//
+//----------
+//
+// Notes:
+//	(1)	This is an extra read of the data, so it is only done if
+//		verifyChecksums is set; the query path doesn't pay for it by default.
+//
+//----------
+
+#define checksumBufferBytes (64*1024)
+
+void BitVector::verify_checksum()
+	{
+	if (numBytes == 0)
+		fatal ("internal error for " + identity()
+		     + "; can't verify checksum when the data size is unknown");
+
+	std::ifstream* in = FileManager::open_file(filename,std::ios::binary|std::ios::in);
+	if (not *in)
+		fatal ("error: BitVector::verify_checksum(" + identity() + ")"
+		     + " failed to open \"" + filename + "\"");
+	in->seekg(offset, in->beg);
+
+	char* buffer = new char[checksumBufferBytes];
+	u32 crc = 0;
+	size_t bytesRemaining = numBytes;
+	while (bytesRemaining > 0)
+		{
+		size_t bytesToRead = std::min (bytesRemaining, (size_t) checksumBufferBytes);
+		in->read (buffer, bytesToRead);
+		if ((size_t) in->gcount() != bytesToRead)
+			fatal ("error: BitVector::verify_checksum(" + identity() + ")"
+			     + " \"" + filename + "\" is too short to contain the bit vector");
+		crc = crc32c (crc, buffer, bytesToRead);
+		bytesRemaining -= bytesToRead;
+		}
+	delete[] buffer;
+
+	FileManager::close_file(in,/*really*/true);
+
+	if (crc != checksum)
+		fatal ("error: BitVector::verify_checksum(" + identity() + ")"
+		     + " checksum mismatch in \"" + filename + "\""
+		     + " (data has " + std::to_string(crc)
+		     + ", header says " + std::to_string(checksum) + ")"
+		     + "\n(the file appears to be corrupted)");
+	}
+
 void BitVector::discard_bits()
 	{
 	if ((trackMemory) && (bits != nullptr))
@@ -532,12 +679,207 @@ void BitVector::squeeze_by
 	replace_bits(resultBits);
 	}
 
+//----------
+//
+// combine_with--
+//	Combine another bit vector into this one, reading the other vector a chunk
+//	at a time.
+//
+//----------
+//
+// Arguments:
+//	const BitVector*	srcBv:		The vector to combine into this one. This
+//									.. can be compressed (e.g. RrrBitVector or
+//									.. RoarBitVector in the compressed state).
+//	int					operation:	One of bvop_union, bvop_union_complement,
+//									.. bvop_intersect, bvop_mask or bvop_xor.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	The source is decoded into a small buffer with extract_words(), one
+//		chunk at a time, and each chunk is combined into the corresponding
+//		part of this vector. So we never need an uncompressed copy of the
+//		whole source, which matters when building trees with large filters.
+//	(2)	This vector must be in the uncompressed state. The results are the
+//		same as for the sdslbitvector variants of union_with() etc., including
+//		which combinations of unequal lengths are supported.
+//
+//----------
+
+static const u64 combineChunkWords = 128*1024;  // (1M bytes)
+
+void BitVector::combine_with
+   (const BitVector*	srcBv,
+	int					operation)
+	{
+	if (bits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; attempt to combine into null bit vector");
+	if (srcBv == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; attempt to combine from null bit vector");
+
+	u64 commonNumBits = std::min(numBits,srcBv->num_bits());
+	if ((numBits > commonNumBits)
+	 && ((operation == bvop_union_complement) || (operation == bvop_intersect)))
+		fatal ("internal error for " + identity()
+		     + "; combining unequal-length bit vectors"
+		     + " (operation " + std::to_string(operation) + ") is not implemented");
+
+	u64* chunk = new u64[combineChunkWords];
+	if (chunk == nullptr)
+		fatal ("error: failed to allocate " + std::to_string(combineChunkWords) + "-word"
+		     + " buffer for BitVector(" + identity() + ")");
+
+	u64* dstWords = (u64*) bits->data();
+	for (u64 startBit=0 ; startBit<commonNumBits ; startBit+=64*combineChunkWords)
+		{
+		u64 chunkBits  = std::min(64*combineChunkWords,commonNumBits-startBit);
+		u64 chunkWords = (chunkBits+63) / 64;
+		srcBv->extract_words(startBit/64,chunkWords,chunk);
+
+		void* dst = (void*) &dstWords[startBit/64];
+		switch (operation)
+			{
+			case bvop_union:            bitwise_or     (dst,chunk,chunkBits);  break;
+			case bvop_union_complement: bitwise_or_not (dst,chunk,chunkBits);  break;
+			case bvop_intersect:        bitwise_and    (dst,chunk,chunkBits);  break;
+			case bvop_mask:             bitwise_mask   (dst,chunk,chunkBits);  break;
+			case bvop_xor:              bitwise_xor    (dst,chunk,chunkBits);  break;
+			default:
+				fatal ("internal error for " + identity()
+				     + "; bad combine operation " + std::to_string(operation));
+			}
+		}
+
+	delete[] chunk;
+	}
+
+//----------
+//
+// extract_words--
+//	Copy a range of the bit vector, in uncompressed form, into an array of
+//	64-bit words.
+//
+//----------
+//
+// Arguments:
+//	u64		startWord:	Index of the first word to copy; bit i of the vector
+//						.. is bit (i%64) of word i/64.
+//	u64		numWords:	Number of words to copy.
+//	u64*	dstWords:	Array to copy the words to.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	Any bits beyond the end of the vector are copied as zeros.
+//
+//----------
+
+void BitVector::extract_words
+   (u64		startWord,
+	u64		numWords,
+	u64*	dstWords) const
+	{
+	if (bits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; attempt to extract words from null bit vector");
+
+	const u64* srcWords = (const u64*) bits->data();
+	u64 srcNumWords = (numBits+63) / 64;
+
+	for (u64 ix=0 ; ix<numWords ; ix++)
+		{
+		u64 wordIx = startWord + ix;
+		if (wordIx >= srcNumWords) { dstWords[ix] = 0;  continue; }
+		u64 word = srcWords[wordIx];
+		if ((wordIx+1 == srcNumWords) && (numBits % 64 != 0))
+			word &= (((u64) 1) << (numBits % 64)) - 1;
+		dstWords[ix] = word;
+		}
+	}
+
 int BitVector::operator[]
    (u64 pos) const
 	{
 	return (*bits)[pos];
 	}
 
+//----------
+//
+// read_bits--
+//	Read the bit at each of a list of positions, as per operator[].
+//
+//----------
+//
+// Arguments:
+//	u64			numPositions:	The number of entries in positions[].
+//	const u64*	positions:		The positions to read. These needn't be in any
+//								.. particular order.
+//	u8*			bitVals:		Place to return the bits; bitVals[i] is 0 or 1,
+//								.. the bit at positions[i].
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	This exists so that a caller with many positions to look up makes one
+//		virtual call per vector, rather than one per position; each subclass
+//		implements it as a loop over its concrete representation.
+//	(2)	For the uncompressed representations, positions are typically
+//		scattered across the vector (they come from hashing), so we prefetch
+//		the word for a position a little ahead of when we need it.
+//
+//----------
+
+#define readBitsPrefetchDistance 16
+
+static inline void read_bits_from_words
+   (const u64*	words,
+	u64			numPositions,
+	const u64*	positions,
+	u8*			bitVals)
+	{
+	u64 ix = 0;
+	if (numPositions > readBitsPrefetchDistance)
+		{
+		for ( ; ix<numPositions-readBitsPrefetchDistance ; ix++)
+			{
+			__builtin_prefetch (&words[positions[ix+readBitsPrefetchDistance]/64]);
+			u64 pos = positions[ix];
+			bitVals[ix] = (u8) ((words[pos/64] >> (pos%64)) & 1);
+			}
+		}
+
+	for ( ; ix<numPositions ; ix++)
+		{
+		u64 pos = positions[ix];
+		bitVals[ix] = (u8) ((words[pos/64] >> (pos%64)) & 1);
+		}
+	}
+
+void BitVector::read_bits
+   (u64			numPositions,
+	const u64*	positions,
+	u8*			bitVals) const
+	{
+	if (bits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for read_bits(" + std::to_string(numPositions) + " positions)"
+		     + " in null bit vector");
+
+	read_bits_from_words (bits->data(), numPositions, positions, bitVals);
+	}
+
 void BitVector::write_bit
    (u64	pos,
 	int	val)
@@ -574,6 +916,78 @@ u64 BitVector::rank1
 	return ranker1->rank(pos);
 	}
 
+//----------
+//
+// rank1_many--
+//	Compute rank1 for each of a list of positions.
+//
+//----------
+//
+// Arguments:
+//	u64			numPositions:	The number of entries in positions[].
+//	const u64*	positions:		The positions to compute rank1 for. These must
+//								.. be in non-decreasing order.
+//	u64*		ranks:			Place to return the ranks; ranks[i] is rank1 of
+//								.. positions[i].
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	Because the positions are sorted, each rank can usually be derived from
+//		the previous one by counting the 1s between the two positions, rather
+//		than by a separate lookup in the rank support. We only use a full rank
+//		lookup when the gap is large; rankManyMaxGap sets that threshold.
+//	(2)	The subclasses implement this in whatever way is cheapest for their
+//		representation, but give the same results as calling rank1() for each
+//		position.
+//
+//----------
+
+static const u64 rankManyMaxGap = 8*64;  // (bits)
+
+void BitVector::rank1_many
+   (u64			numPositions,
+	const u64*	positions,
+	u64*		ranks)
+	{
+	if (bits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for rank1_many(" + std::to_string(numPositions) + " positions)"
+		     + " in null bit vector");
+
+	// we track the rank at the start of the word containing the previous
+	// position, and count forward from there with popcounts
+
+	const u64* words = bits->data();
+	u64 basePos  = 0;
+	u64 baseRank = 0;
+	bool haveBase = false;
+
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		{
+		u64 pos       = positions[ix];
+		u64 wordStart = pos & ~((u64) 63);
+
+		if ((haveBase) && (wordStart - basePos <= rankManyMaxGap))
+			{
+			if (wordStart > basePos)
+				baseRank += bitwise_count (words+basePos/64, wordStart-basePos);
+			}
+		else
+			{
+			baseRank = rank1(wordStart);
+			haveBase = true;
+			}
+		basePos = wordStart;
+
+		if (pos == wordStart) ranks[ix] = baseRank;
+		                 else ranks[ix] = baseRank + bitwise_count (words+wordStart/64, pos-wordStart);
+		}
+	}
+
 u64 BitVector::select0
    (u64 rank)
 	{
@@ -601,6 +1015,31 @@ u64 BitVector::select0
 	return selector0->select(rank+1);  // (rank+1 compensates for SDSL API)
 	}
 
+void BitVector::prepare_rank_select ()
+	{
+	// create the rank/select support now, rather than on the first call to
+	// rank1() or select0(); this is needed before several threads share the
+	// bit vector, since that lazy creation isn't thread-safe
+
+	if (bits == nullptr) return;
+
+	if (ranker1 == nullptr)
+		{
+		dbgRankSelect_CountRankNew;
+		ranker1 = new sdslrank1(bits);
+		if (trackMemory)
+			cerr << "@+" << ranker1 << " creating ranker1 for BitVector(" << identity() << " " << this << ")" << endl;
+		}
+
+	if (selector0 == nullptr)
+		{
+		dbgRankSelect_CountSelectNew;
+		selector0 = new sdslselect0(bits);
+		if (trackMemory)
+			cerr << "@+" << selector0 << " creating selector0 for BitVector(" << identity() << " " << this << ")" << endl;
+		}
+	}
+
 void BitVector::discard_rank_select ()
 	{
 	if ((trackMemory) && (ranker1 != nullptr))
@@ -637,6 +1076,145 @@ string BitVector::to_complement_string () const
 	return s;
 	}
 
+//----------
+//
+// RrrBits--
+//	Run-time selection of sdsl's rrr_vector template arguments.
+//
+//----------
+//
+// Implementation notes:
+//	(1)	sdsl's rrr_vector, and its rank/select supports, are templates over
+//		block size and rank period, so each (block size, rank period) pair is a
+//		distinct type. RrrBitsT is instantiated for every pair we support, and
+//		rrr_bits() chooses between them.
+//	(2)	The supported pairs are the block sizes 63, 127 and 255 crossed with
+//		the rank periods 8, 16, 32 and 64, plus the pair given by RRR_BLOCK_SIZE
+//		and RRR_RANK_PERIOD at build time. Adding more pairs costs compile time
+//		and code size, but nothing at run time.
+//
+//----------
+
+template<class t_support, class t_vector>
+class RrrRankSupportT: public RrrRankSupport
+	{
+public:
+	RrrRankSupportT(const t_vector* v): support(v) {}
+	virtual ~RrrRankSupportT() {}
+	virtual u64 rank(u64 pos) const { return support.rank(pos); }
+
+	t_support support;
+	};
+
+template<class t_support, class t_vector>
+class RrrSelectSupportT: public RrrSelectSupport
+	{
+public:
+	RrrSelectSupportT(const t_vector* v): support(v) {}
+	virtual ~RrrSelectSupportT() {}
+	virtual u64 select(u64 rank) const { return support.select(rank); }
+
+	t_support support;
+	};
+
+template<std::uint16_t t_bs, std::uint16_t t_k>
+class RrrBitsT: public RrrBits
+	{
+public:
+	typedef sdsl::rrr_vector<t_bs,sdsl::int_vector<>,t_k>           rrrvector;
+	typedef sdsl::rank_support_rrr<0,t_bs,sdsl::int_vector<>,t_k>   rrrrank0T;
+	typedef sdsl::rank_support_rrr<1,t_bs,sdsl::int_vector<>,t_k>   rrrrank1T;
+	typedef sdsl::select_support_rrr<0,t_bs,sdsl::int_vector<>,t_k> rrrselect0T;
+	typedef sdsl::select_support_rrr<1,t_bs,sdsl::int_vector<>,t_k> rrrselect1T;
+
+public:
+	RrrBitsT() {}
+	RrrBitsT(const sdslbitvector& srcBits): v(srcBits) {}
+	RrrBitsT(const rrrvector& srcV): v(srcV) {}
+	virtual ~RrrBitsT() {}
+
+	virtual u32 block_size() const  { return t_bs; }
+	virtual u32 rank_period() const { return t_k; }
+	virtual u64 size() const { return v.size(); }
+	virtual int operator[](u64 pos) const { return v[pos]; }
+	virtual void read_bits(u64 numPositions, const u64* positions, u8* bitVals) const
+		{
+		// (a tight loop over the concrete rrr type, so that the compiler can
+		// inline sdsl's access, rather than a virtual call per position)
+		for (u64 ix=0 ; ix<numPositions ; ix++)
+			bitVals[ix] = (u8) v[positions[ix]];
+		}
+	virtual u64 get_int(u64 pos, std::uint8_t len=64) const { return v.get_int(pos,len); }
+	virtual void load(std::istream& in) { sdsl::load (v, in); }  // $$$ ERROR_CHECK we need to check for errors inside sdsl
+	virtual size_t serialize(std::ostream& out) const { return (size_t) v.serialize (out, nullptr, ""); }
+	virtual RrrBits* clone() const { return new RrrBitsT<t_bs,t_k>(v); }
+	virtual RrrRankSupport*   new_rank0() const   { return new RrrRankSupportT<rrrrank0T,rrrvector>(&v); }
+	virtual RrrRankSupport*   new_rank1() const   { return new RrrRankSupportT<rrrrank1T,rrrvector>(&v); }
+	virtual RrrSelectSupport* new_select0() const { return new RrrSelectSupportT<rrrselect0T,rrrvector>(&v); }
+	virtual RrrSelectSupport* new_select1() const { return new RrrSelectSupportT<rrrselect1T,rrrvector>(&v); }
+
+	rrrvector v;
+	};
+
+#define rrr_dispatch(bs,k,args)                                              \
+	if ((blockSize == bs) && (rankPeriod == k))                              \
+		return new RrrBitsT<bs,k> args;
+
+#define rrr_dispatch_periods(bs,args)                                        \
+	rrr_dispatch(bs, 8,args)                                                 \
+	rrr_dispatch(bs,16,args)                                                 \
+	rrr_dispatch(bs,32,args)                                                 \
+	rrr_dispatch(bs,64,args)
+
+bool RrrBits::valid_parameters
+   (u32	blockSize,
+	u32	rankPeriod)
+	{
+	if ((blockSize == RRR_BLOCK_SIZE) && (rankPeriod == RRR_RANK_PERIOD))
+		return true;
+	if ((blockSize != 63) && (blockSize != 127) && (blockSize != 255))
+		return false;
+	if ((rankPeriod != 8) && (rankPeriod != 16) && (rankPeriod != 32) && (rankPeriod != 64))
+		return false;
+	return true;
+	}
+
+RrrBits* RrrBits::rrr_bits
+   (u32	blockSize,
+	u32	rankPeriod)
+	{
+	rrr_dispatch(RRR_BLOCK_SIZE,RRR_RANK_PERIOD,())
+	rrr_dispatch_periods( 63,())
+	rrr_dispatch_periods(127,())
+	rrr_dispatch_periods(255,())
+
+	fatal ("error: rrr block size " + std::to_string(blockSize)
+	     + " with rank period " + std::to_string(rankPeriod)
+	     + " is not supported"
+	     + "\n(see notes regarding RRR_BLOCK_SIZE in bit_vector.h)");
+	return nullptr;  // execution never reaches here
+	}
+
+RrrBits* RrrBits::rrr_bits
+   (u32					blockSize,
+	u32					rankPeriod,
+	const sdslbitvector& srcBits)
+	{
+	rrr_dispatch(RRR_BLOCK_SIZE,RRR_RANK_PERIOD,(srcBits))
+	rrr_dispatch_periods( 63,(srcBits))
+	rrr_dispatch_periods(127,(srcBits))
+	rrr_dispatch_periods(255,(srcBits))
+
+	fatal ("error: rrr block size " + std::to_string(blockSize)
+	     + " with rank period " + std::to_string(rankPeriod)
+	     + " is not supported"
+	     + "\n(see notes regarding RRR_BLOCK_SIZE in bit_vector.h)");
+	return nullptr;  // execution never reaches here
+	}
+
+#undef rrr_dispatch_periods
+#undef rrr_dispatch
+
 //----------
 //
 // RrrBitVector--
@@ -651,6 +1229,9 @@ string BitVector::to_complement_string () const
 //		bits in the vector can be modified.
 //	(2)	We'll never have both compressed or uncompressed forms at the same time.
 //	(3)	copy_from() automatically compresses.
+//	(4)	The block size and rank period are normally the defaults, but a vector
+//		read from a file uses whatever the file's header says (the caller
+//		passes those to the constructor). A zero for either means the default.
 //
 //----------
 
@@ -658,10 +1239,14 @@ RrrBitVector::RrrBitVector
    (const string& _filename,
 	const size_t _offset,
 	const size_t _numBytes,
-	bool _readAsUncompressed)
+	bool _readAsUncompressed,
+	u32 _blockSize,
+	u32 _rankPeriod)
 	  :	BitVector(_filename, _offset, _numBytes),
 		readAsUncompressed(_readAsUncompressed),
 		writeAsUncompressed(false),
+		rrrBlockSize((_blockSize == 0)? defaultBlockSize : _blockSize),
+		rrrRankPeriod((_rankPeriod == 0)? defaultRankPeriod : _rankPeriod),
 		rrrBits(nullptr),
 		rrrRanker1(nullptr),
 		rrrSelector0(nullptr)
@@ -675,6 +1260,8 @@ RrrBitVector::RrrBitVector
 	  :	BitVector(nullptr),
 		readAsUncompressed(false),
 		writeAsUncompressed(false),
+		rrrBlockSize(defaultBlockSize),
+		rrrRankPeriod(defaultRankPeriod),
 		rrrBits(nullptr),
 		rrrRanker1(nullptr),
 		rrrSelector0(nullptr)
@@ -684,7 +1271,8 @@ RrrBitVector::RrrBitVector
 
 	// we copy from any subclass that is in the uncompressed state, or from an
 	// RrrBitVector in the compressed state, or from an all-ones or all-zeros
-	// class
+	// class; an RrrBitVector compressed with a different block size or rank
+	// period is decompressed, so that it will be recompressed with ours
 
 	if (srcBv->bits != nullptr)
 		copy_from (srcBv->bits);
@@ -692,7 +1280,16 @@ RrrBitVector::RrrBitVector
 		{
 		RrrBitVector* srcRrrBv = (RrrBitVector*) srcBv;
 		if (srcRrrBv->rrrBits != nullptr)
-			copy_from (srcRrrBv->rrrBits);
+			{
+			if ((srcRrrBv->rrrBits->block_size()  == rrrBlockSize)
+			 && (srcRrrBv->rrrBits->rank_period() == rrrRankPeriod))
+				copy_from (srcRrrBv->rrrBits);
+			else
+				{
+				new_bits (srcRrrBv->numBits);
+				decompress_rrr (srcRrrBv->rrrBits, bits->data(), numBits);
+				}
+			}
 		}
 	else if ((srcBv->numBits != 0)
 	      && ((srcBv->compressor() == bvcomp_zeros)
@@ -712,6 +1309,8 @@ RrrBitVector::RrrBitVector
 	  :	BitVector(_numBits),
 		readAsUncompressed(false),
 		writeAsUncompressed(false),
+		rrrBlockSize(defaultBlockSize),
+		rrrRankPeriod(defaultRankPeriod),
 		rrrBits(nullptr),
 		rrrRanker1(nullptr),
 		rrrSelector0(nullptr)
@@ -744,9 +1343,9 @@ void RrrBitVector::serialized_in
 	if (readAsUncompressed)
 		{ BitVector::serialized_in(in); return; }
 
-	rrrBits = new rrrbitvector();
+	rrrBits = RrrBits::rrr_bits (rrrBlockSize, rrrRankPeriod);
 	if (reportLoadTime || reportTotalLoadTime) startTime = get_wall_time();
-	sdsl::load (*rrrBits, in);  // $$$ ERROR_CHECK we need to check for errors inside sdsl
+	rrrBits->load (in);
 	if (reportLoadTime || reportTotalLoadTime) elapsedTime = elapsed_wall_time(startTime);
 	if (reportFileBytes)
 		cerr << "[" << class_identity() << " serialized_in] read " << numBytes << " bytes " << filename << "@" << offset << endl;
@@ -824,7 +1423,7 @@ size_t RrrBitVector::serialized_out
 	if ((rrrBits == nullptr) and (bits != nullptr))
 		compress();
 
-	return (size_t) rrrBits->serialize (out, nullptr, "");
+	return rrrBits->serialize (out);
 	}
 
 void RrrBitVector::discard_bits()
@@ -876,7 +1475,7 @@ void RrrBitVector::copy_from
 	// $$$ used to be implemented like this, essentially compressing as it
 	//     copies; but we really want to keep it uncompressed until something
 	//     needs it to be compressed
-	//rrrBits = new rrrbitvector (*srcBits);
+	//rrrBits = RrrBits::rrr_bits (rrrBlockSize, rrrRankPeriod, *srcBits);
 	//numBits = rrrBits->size();
 	//isResident = true;
 	//
@@ -891,7 +1490,7 @@ void RrrBitVector::copy_from
 	}
 
 void RrrBitVector::copy_from
-   (const rrrbitvector* srcRrrBits)
+   (const RrrBits* srcRrrBits)
 	{
 	if ((trackMemory) && (bits != nullptr))
 		cerr << "@-" << bits << " discarding bits for RrrBitVector(" << identity() << " " << this << ")" << endl;
@@ -909,7 +1508,9 @@ void RrrBitVector::copy_from
 		discard_rank_select();
 		}
 
-	rrrBits = new rrrbitvector (*srcRrrBits);
+	rrrBits       = srcRrrBits->clone();
+	rrrBlockSize  = rrrBits->block_size();
+	rrrRankPeriod = rrrBits->rank_period();
 	numBits = rrrBits->size();
 	isResident = true;
 
@@ -927,7 +1528,7 @@ void RrrBitVector::compress
 		fatal ("internal error for " + identity()
 		     + "; attempt to compress null bit vector");
 
-	rrrBits = new rrrbitvector (*bits);
+	rrrBits = RrrBits::rrr_bits (rrrBlockSize, rrrRankPeriod, *bits);
 	numBits = rrrBits->size();
 
 	if (trackMemory)
@@ -961,12 +1562,41 @@ bool RrrBitVector::is_all_ones ()
 	return (rank1(numBits) == numBits);
 	}
 
-int RrrBitVector::operator[]
-   (u64 pos) const
+void RrrBitVector::extract_words
+   (u64		startWord,
+	u64		numWords,
+	u64*	dstWords) const
 	{
-	if (rrrBits != nullptr) return (*rrrBits)[pos];
-	                   else return BitVector::operator[](pos);
-	}
+	if (rrrBits == nullptr)
+		{ BitVector::extract_words(startWord,numWords,dstWords);  return; }
+
+	// nota bene: get_int() decodes only the rrr block(s) covering each word
+
+	u64 srcNumBits = rrrBits->size();
+	for (u64 ix=0 ; ix<numWords ; ix++)
+		{
+		u64 pos = 64 * (startWord + ix);
+		if (pos >= srcNumBits) { dstWords[ix] = 0;  continue; }
+		u64 len = std::min((u64) 64,srcNumBits-pos);
+		dstWords[ix] = rrrBits->get_int(pos,len);
+		}
+	}
+
+int RrrBitVector::operator[]
+   (u64 pos) const
+	{
+	if (rrrBits != nullptr) return (*rrrBits)[pos];
+	                   else return BitVector::operator[](pos);
+	}
+
+void RrrBitVector::read_bits
+   (u64			numPositions,
+	const u64*	positions,
+	u8*			bitVals) const
+	{
+	if (rrrBits != nullptr) rrrBits->read_bits(numPositions,positions,bitVals);
+	                   else BitVector::read_bits(numPositions,positions,bitVals);
+	}
 
 void RrrBitVector::write_bit
    (u64	pos,
@@ -992,7 +1622,7 @@ u64 RrrBitVector::rank1
 	if (rrrRanker1 == nullptr)
 		{
 		dbgRankSelect_CountRankNew;
-		rrrRanker1 = new rrrrank1(rrrBits);
+		rrrRanker1 = rrrBits->new_rank1();
 		if (trackMemory)
 			cerr << "@+" << rrrRanker1 << " creating ranker1 for RrrBitVector(" << identity() << " " << this << ")" << endl;
 		}
@@ -1000,6 +1630,48 @@ u64 RrrBitVector::rank1
 	return rrrRanker1->rank(pos);
 	}
 
+void RrrBitVector::rank1_many
+   (u64			numPositions,
+	const u64*	positions,
+	u64*		ranks)
+	{
+	// see BitVector::rank1_many(); sdsl doesn't give us access to the rrr
+	// block structure, so the best we can do is decode the bits between
+	// nearby positions (which touches at most two rrr blocks), instead of
+	// walking the rank samples again
+
+	if (rrrBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for rank1_many(" + std::to_string(numPositions) + " positions)"
+		     + " in null bit vector");
+
+	u64 prevPos  = 0;
+	u64 prevRank = 0;
+	bool havePrev = false;
+
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		{
+		u64 pos = positions[ix];
+
+		if ((havePrev) && (pos - prevPos <= 64))
+			{
+			if (pos > prevPos)
+				{
+				u64 word = rrrBits->get_int(prevPos,pos-prevPos);
+				prevRank += bitwise_count (&word, pos-prevPos);
+				}
+			}
+		else
+			{
+			prevRank = rank1(pos);
+			havePrev = true;
+			}
+		prevPos = pos;
+
+		ranks[ix] = prevRank;
+		}
+	}
+
 u64 RrrBitVector::select0
    (u64 rank)
 	{
@@ -1013,7 +1685,7 @@ u64 RrrBitVector::select0
 	if (rrrSelector0 == nullptr)
 		{
 		dbgRankSelect_CountSelectNew;
-		rrrSelector0 = new rrrselect0(rrrBits);
+		rrrSelector0 = rrrBits->new_select0();
 		if (trackMemory)
 			cerr << "@+" << rrrSelector0 << " creating selector0 for RrrBitVector(" << identity() << " " << this << ")" << endl;
 		}
@@ -1021,6 +1693,29 @@ u64 RrrBitVector::select0
 	return rrrSelector0->select(rank+1);  // (rank+1 compensates for SDSL API)
 	}
 
+void RrrBitVector::prepare_rank_select ()
+	{
+	// see BitVector::prepare_rank_select()
+
+	if (rrrBits == nullptr) return;
+
+	if (rrrRanker1 == nullptr)
+		{
+		dbgRankSelect_CountRankNew;
+		rrrRanker1 = rrrBits->new_rank1();
+		if (trackMemory)
+			cerr << "@+" << rrrRanker1 << " creating ranker1 for RrrBitVector(" << identity() << " " << this << ")" << endl;
+		}
+
+	if (rrrSelector0 == nullptr)
+		{
+		dbgRankSelect_CountSelectNew;
+		rrrSelector0 = rrrBits->new_select0();
+		if (trackMemory)
+			cerr << "@+" << rrrSelector0 << " creating selector0 for RrrBitVector(" << identity() << " " << this << ")" << endl;
+		}
+	}
+
 void RrrBitVector::discard_rank_select ()
 	{
 	if ((trackMemory) && (rrrRanker1 != nullptr))
@@ -1082,7 +1777,8 @@ RoarBitVector::RoarBitVector
 	  :	BitVector(_filename, _offset, _numBytes),
 		readAsUncompressed(_readAsUncompressed),
 		writeAsUncompressed(false),
-		roarBits(nullptr)
+		roarBits(nullptr),
+		roarRankSamples(nullptr)
 	{
 	if (trackMemory)
 		cerr << "@+" << this << " constructor RoarBitVector(" << identity() << "), variant 1" << endl;
@@ -1093,7 +1789,8 @@ RoarBitVector::RoarBitVector
 	  :	BitVector(nullptr),
 		readAsUncompressed(false),
 		writeAsUncompressed(false),
-		roarBits(nullptr)
+		roarBits(nullptr),
+		roarRankSamples(nullptr)
 	{
 	bits = nullptr;
 	if (srcBv == nullptr) return;
@@ -1128,7 +1825,8 @@ RoarBitVector::RoarBitVector
 	  :	BitVector(_numBits),
 		readAsUncompressed(false),
 		writeAsUncompressed(false),
-		roarBits(nullptr)
+		roarBits(nullptr),
+		roarRankSamples(nullptr)
 	{
 	if (trackMemory)
 		cerr << "@+" << this << " constructor RoarBitVector(" << identity() << "), variant 3" << endl;
@@ -1142,6 +1840,7 @@ RoarBitVector::~RoarBitVector()
 		cerr << "@-" << roarBits << " discarding roarBits for RoarBitVector(" << identity() << " " << this << ")" << endl;
 
 	if (roarBits != nullptr) roaring_bitmap_free(roarBits);
+	if (roarRankSamples != nullptr) delete[] roarRankSamples;
 	// bits will get deleted in BitVector's destructor
 	}
 
@@ -1302,6 +2001,7 @@ void RoarBitVector::discard_bits()
 
 	if      (bits     != nullptr) { delete bits;                    bits     = nullptr; }
 	else if (roarBits != nullptr) { roaring_bitmap_free(roarBits);  roarBits = nullptr; }
+	discard_rank_select();
 	isResident = false;
 	}
 
@@ -1404,6 +2104,56 @@ bool RoarBitVector::is_all_ones ()
 	return false; // never gets here
 	}
 
+void RoarBitVector::extract_words
+   (u64		startWord,
+	u64		numWords,
+	u64*	dstWords) const
+	{
+	if (roarBits == nullptr)
+		{ BitVector::extract_words(startWord,numWords,dstWords);  return; }
+
+	for (u64 ix=0 ; ix<numWords ; ix++)
+		dstWords[ix] = 0;
+
+	u64 startPos = 64 * startWord;
+	u64 endPos   = std::min(64*(startWord+numWords),numBits);
+	if (startPos >= endPos) return;
+
+	// position an iterator at the first member in the range, then read
+	// members a batch at a time and set the corresponding bits, until we
+	// reach the end of the range
+	// nota bene: positioning the iterator is a binary search over the
+	//            containers; reading from it then walks forward, so the cost
+	//            of a call is proportional to the size of the range rather
+	//            than to its distance from the start of the bitmap
+
+	roaring_uint32_iterator_t* iter = roaring_create_iterator (roarBits);
+	if (iter == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; failed to create roaring iterator");
+
+	if (roaring_move_uint32_iterator_equalorlarger (iter, (std::uint32_t) startPos))
+		{
+		const std::uint32_t batchSize = 1024;
+		std::uint32_t members[batchSize];
+		bool reachedEnd = false;
+		while (not reachedEnd)
+			{
+			std::uint32_t numMembers = roaring_read_uint32_iterator (iter, members, batchSize);
+			if (numMembers < batchSize) reachedEnd = true;
+
+			for (std::uint32_t mIx=0 ; mIx<numMembers ; mIx++)
+				{
+				if (members[mIx] >= endPos) { reachedEnd = true;  break; }
+				u64 offset = members[mIx] - startPos;
+				dstWords[offset/64] |= ((u64) 1) << (offset%64);
+				}
+			}
+		}
+
+	roaring_free_uint32_iterator (iter);
+	}
+
 int RoarBitVector::operator[]
    (u64 pos) const
 	{
@@ -1411,37 +2161,203 @@ int RoarBitVector::operator[]
 	                    else return BitVector::operator[](pos);
 	}
 
+void RoarBitVector::read_bits
+   (u64			numPositions,
+	const u64*	positions,
+	u8*			bitVals) const
+	{
+	if (roarBits == nullptr)
+		{ BitVector::read_bits(numPositions,positions,bitVals);  return; }
+
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		bitVals[ix] = (u8) roaring_bitmap_contains (roarBits, positions[ix]);
+	}
+
 void RoarBitVector::write_bit
    (u64	pos,
 	int	val)
 	{
 	if (roarBits != nullptr)
+		{
 		roaring_bitmap_add (roarBits, pos);
+		discard_rank_select();  // (the rank samples are now stale)
+		}
 	else
 		BitVector::write_bit (pos, val);
 	}
 
+//----------
+//
+// RoarBitVector::rank1, select0--
+//
+//----------
+//
+// Notes:
+//	(1)	Roaring divides the vector into 65536-bit containers. We keep one rank
+//		sample per container, giving the number of 1s preceding it; these are
+//		computed with CRoaring's range cardinality, which only has to look at
+//		each container's cardinality. A rank query then adds the rank within
+//		a single container to a sample.
+//	(2)	select0 binary searches the samples for the container holding the
+//		zero we want, then binary searches within that container.
+//	(3)	The samples cost 8 bytes per 65536 bits, negligible compared to the
+//		compressed vector itself.
+//
+//----------
+
+#define roarRankBlockBits 65536
+
 u64 RoarBitVector::rank1
    (u64 pos)
 	{
-	fatal ("internal error for " + identity()
-	     + "; request for rank1(" + std::to_string(pos) + ")"
-	     + " in roar-compressed bit vector");
-	return 0;  // execution never reaches here
+	// see BitVector::rank1() for our mathematical definition of rank1
+
+	if (bits != nullptr) return BitVector::rank1(pos);
+
+	if (roarBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for rank1(" + std::to_string(pos) + ")"
+		     + " in null bit vector");
+
+	if (roarRankSamples == nullptr) prepare_rank_select();
+
+	dbgRankSelect_CountRank;
+	u64 block      = pos / roarRankBlockBits;
+	u64 blockStart = block * roarRankBlockBits;
+	if (pos == blockStart) return roarRankSamples[block];
+	return roarRankSamples[block]
+	     + roaring_bitmap_range_cardinality (roarBits, blockStart, pos);
+	}
+
+void RoarBitVector::rank1_many
+   (u64			numPositions,
+	const u64*	positions,
+	u64*		ranks)
+	{
+	// see BitVector::rank1_many(); consecutive positions in the same roaring
+	// container are ranked by counting within that container only
+
+	if (bits != nullptr) { BitVector::rank1_many(numPositions,positions,ranks);  return; }
+
+	if (roarBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for rank1_many(" + std::to_string(numPositions) + " positions)"
+		     + " in null bit vector");
+
+	u64 prevPos  = 0;
+	u64 prevRank = 0;
+	bool havePrev = false;
+
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		{
+		u64 pos = positions[ix];
+
+		if ((havePrev) && (pos/roarRankBlockBits == prevPos/roarRankBlockBits))
+			{
+			if (pos > prevPos)
+				prevRank += roaring_bitmap_range_cardinality (roarBits, prevPos, pos);
+			}
+		else
+			{
+			prevRank = rank1(pos);
+			havePrev = true;
+			}
+		prevPos = pos;
+
+		ranks[ix] = prevRank;
+		}
 	}
 
 u64 RoarBitVector::select0
    (u64 rank)
 	{
-	fatal ("internal error for " + identity()
-	     + "; request for select0(" + std::to_string(rank) + ")"
-	     + " in roar-compressed bit vector");
-	return 0;  // execution never reaches here
+	// see BitVector::select0() for our mathematical definition of select0
+
+	if (bits != nullptr) return BitVector::select0(rank);
+
+	if (roarBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for select0(" + std::to_string(rank) + ")"
+		     + " in null bit vector");
+
+	if (roarRankSamples == nullptr) prepare_rank_select();
+
+	dbgRankSelect_CountSelect;
+
+	// binary search for the last block that has no more than rank zeros
+	// preceding it; the zero we want is in that block
+
+	u64 lo = 0;
+	u64 hi = numBits / roarRankBlockBits;
+	while (lo < hi)
+		{
+		u64 mid = (lo + hi + 1) / 2;
+		u64 zerosBefore = mid*roarRankBlockBits - roarRankSamples[mid];
+		if (zerosBefore <= rank) lo = mid;
+		                    else hi = mid-1;
+		}
+
+	// binary search within that block for the first position p such that
+	// [blockStart,p] contains more than remaining zeros
+
+	u64 blockStart = lo * roarRankBlockBits;
+	u64 remaining  = rank - (blockStart - roarRankSamples[lo]);
+	u64 pLo = blockStart;
+	u64 pHi = std::min(blockStart+roarRankBlockBits,numBits);
+	if (pLo >= pHi)
+		fatal ("internal error for " + identity()
+		     + "; request for select0(" + std::to_string(rank) + ")"
+		     + " exceeds the number of zeros");
+
+	while (pLo < pHi)
+		{
+		u64 mid   = (pLo + pHi) / 2;
+		u64 zeros = (mid+1-blockStart)
+		          - roaring_bitmap_range_cardinality (roarBits, blockStart, mid+1);
+		if (zeros > remaining) pHi = mid;
+		                  else pLo = mid+1;
+		}
+
+	if (pLo >= std::min(blockStart+roarRankBlockBits,numBits))
+		fatal ("internal error for " + identity()
+		     + "; request for select0(" + std::to_string(rank) + ")"
+		     + " exceeds the number of zeros");
+
+	return pLo;
+	}
+
+void RoarBitVector::prepare_rank_select ()
+	{
+	// see BitVector::prepare_rank_select()
+
+	if (bits != nullptr) { BitVector::prepare_rank_select();  return; }
+
+	if ((roarBits == nullptr) || (roarRankSamples != nullptr)) return;
+
+	dbgRankSelect_CountRankNew;
+	u64 numSamples = numBits/roarRankBlockBits + 1;
+	roarRankSamples = new u64[numSamples];
+	if (trackMemory)
+		cerr << "@+" << roarRankSamples << " creating roarRankSamples for RoarBitVector(" << identity() << " " << this << ")" << endl;
+
+	roarRankSamples[0] = 0;
+	for (u64 sampleIx=1 ; sampleIx<numSamples ; sampleIx++)
+		roarRankSamples[sampleIx] = roarRankSamples[sampleIx-1]
+		                          + roaring_bitmap_range_cardinality
+		                              (roarBits,
+		                               (sampleIx-1)*roarRankBlockBits,
+		                               sampleIx*roarRankBlockBits);
 	}
 
 void RoarBitVector::discard_rank_select ()
 	{
-	// do nothing
+	BitVector::discard_rank_select();
+
+	if ((trackMemory) && (roarRankSamples != nullptr))
+		cerr << "@-" << roarRankSamples << " discarding roarRankSamples for RoarBitVector(" << identity() << " " << this << ")" << endl;
+
+	if (roarRankSamples != nullptr)
+		{ delete[] roarRankSamples;  roarRankSamples = nullptr; }
 	}
 
 u64 RoarBitVector::size () const
@@ -1531,6 +2447,376 @@ void RawBitVector::serialized_in
 	isResident = true;
 	}
 
+//----------
+//
+// MappedBitVector--
+//	Bit vector with an uncompressed underlying file, accessed in place by
+//	mapping the file into memory, rather than by copying it into memory.
+//
+//----------
+//
+// Implementation notes:
+//	(1)	The file is mapped read-only and shared, so that any number of
+//		processes querying the same tree share one copy of its bits, in the
+//		operating system's page cache. Moreover, pages are only read from the
+//		file when they are accessed, so a lookup that touches only a few bits
+//		of a large vector doesn't have to read the whole vector.
+//	(2)	The vector is read-only. Attempts to write bits are fatal errors, as
+//		is anything else that needs BitVector.bits.
+//	(3)	The data in the file is the sdsl serialization of a bit vector, which
+//		is an 8-byte count of bits followed by the bits themselves as 64-bit
+//		words. In order to access the words in place they must be 8-byte
+//		aligned in the file. If they aren't, load() falls back on BitVector's
+//		load(), and the object then behaves just like a BitVector.
+//	(4)	Rank and select are supported with our own (simple) rank samples,
+//		since sdsl's rank/select support only works with an sdslbitvector.
+//		There is one sample per 512 bits, costing about 12.5% of the size of
+//		the vector.
+//
+//----------
+
+#define mappedRankBlockBits 512
+
+MappedBitVector::MappedBitVector
+   (const string& _filename,
+	const size_t _offset,
+	const size_t _numBytes)
+	  :	BitVector(_filename, _offset, _numBytes),
+		mapStart(nullptr),
+		mapLength(0),
+		mappedBits(nullptr),
+		rankSamples(nullptr)
+	{
+	if (trackMemory)
+		cerr << "@+" << this << " constructor MappedBitVector(" << identity() << "), variant 1" << endl;
+	}
+
+MappedBitVector::~MappedBitVector()
+	{
+	if (trackMemory)
+		cerr << "@-" << this << " destructor MappedBitVector(" << identity() << ")" << endl;
+
+	unmap();
+	// bits (if any) will get deleted in BitVector's destructor
+	}
+
+void MappedBitVector::load()
+	{
+	wall_time_ty startTime;
+	double       elapsedTime = 0.0;
+
+	if (isResident) return;
+
+	// if the bits won't be 8-byte aligned, read them the usual way (see note
+	// 3 above)
+
+	if ((offset + sdslbitvectorHeaderBytes) % sizeof(u64) != 0)
+		{
+		BitVector::load();
+		return;
+		}
+
+	if ((verifyChecksums) && (hasChecksum)) verify_checksum();
+
+	if (reportLoad)
+		cerr << "loading " << identity() << endl;
+
+	if (reportLoadTime || reportTotalLoadTime) startTime = get_wall_time();
+
+	int fd = ::open (filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		fatal ("error: MappedBitVector::load(" + identity() + ")"
+		     + " failed to open \"" + filename + "\"");
+
+	struct stat fileInfo;
+	if (fstat (fd, &fileInfo) != 0)
+		fatal ("error: MappedBitVector::load(" + identity() + ")"
+		     + " failed to determine the size of \"" + filename + "\"");
+	size_t fileSize  = (size_t) fileInfo.st_size;
+	size_t endOffset = (numBytes != 0)? offset+numBytes : fileSize;
+	if ((endOffset > fileSize)
+	 || (endOffset < offset + sdslbitvectorHeaderBytes))
+		fatal ("error: MappedBitVector::load(" + identity() + ")"
+		     + " \"" + filename + "\" is too short to contain the bit vector");
+
+	// mmap requires that the file offset be a multiple of the page size
+
+	size_t pageSize  = (size_t) sysconf(_SC_PAGESIZE);
+	size_t mapOffset = offset - (offset % pageSize);
+	mapLength = endOffset - mapOffset;
+	mapStart  = mmap (nullptr, mapLength, PROT_READ, MAP_SHARED, fd, (off_t) mapOffset);
+	::close (fd);
+	if (mapStart == MAP_FAILED)
+		{
+		mapStart = nullptr;
+		fatal ("error: MappedBitVector::load(" + identity() + ")"
+		     + " failed to map " + std::to_string(mapLength) + " bytes"
+		     + " of \"" + filename + "\"");
+		}
+	if (trackMemory)
+		cerr << "@+" << mapStart << " mapping file for MappedBitVector(" << identity() << " " << this << ")" << endl;
+
+	const char* data = ((const char*) mapStart) + (offset - mapOffset);
+	numBits    = *((const u64*) data);
+	mappedBits = (const u64*) (data + sdslbitvectorHeaderBytes);
+
+	u64 numWords = (numBits + 63) / 64;
+	if (offset + sdslbitvectorHeaderBytes + numWords*sizeof(u64) > endOffset)
+		fatal ("error: MappedBitVector::load(" + identity() + ")"
+		     + " \"" + filename + "\" is too short to contain "
+		     + std::to_string(numBits) + " bits");
+
+	if (reportLoadTime || reportTotalLoadTime)
+		{
+		elapsedTime = elapsed_wall_time(startTime);
+		if (reportLoadTime)
+			cerr << "[" << class_identity() << " load-map] " << std::setprecision(6) << std::fixed << elapsedTime << " secs " << filename << "@" << offset << endl;
+		if (reportTotalLoadTime)
+			totalLoadTime += elapsedTime;  // $$$ danger of precision error?
+		}
+
+	isResident = true;
+	}
+
+void MappedBitVector::discard_bits()
+	{
+	unmap();
+	BitVector::discard_bits();
+	}
+
+void MappedBitVector::unmap()
+	{
+	discard_rank_select();
+
+	if ((trackMemory) && (mapStart != nullptr))
+		cerr << "@-" << mapStart << " unmapping file for MappedBitVector(" << identity() << " " << this << ")" << endl;
+
+	if (mapStart != nullptr)
+		{
+		munmap (mapStart, mapLength);
+		mapStart   = nullptr;
+		mapLength  = 0;
+		mappedBits = nullptr;
+		isResident = false;
+		}
+	}
+
+bool MappedBitVector::is_all_zeros ()
+	{
+	if (bits != nullptr) return BitVector::is_all_zeros();
+
+	if (mappedBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; attempt to check null bit vector for all-zeros");
+
+	return bitwise_is_all_zeros(mappedBits,numBits);
+	}
+
+bool MappedBitVector::is_all_ones ()
+	{
+	if (bits != nullptr) return BitVector::is_all_ones();
+
+	if (mappedBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; attempt to check null bit vector for all-ones");
+
+	return bitwise_is_all_ones(mappedBits,numBits);
+	}
+
+int MappedBitVector::operator[]
+   (u64 pos) const
+	{
+	if (bits != nullptr) return BitVector::operator[](pos);
+	return (int) ((mappedBits[pos/64] >> (pos%64)) & 1);
+	}
+
+void MappedBitVector::read_bits
+   (u64			numPositions,
+	const u64*	positions,
+	u8*			bitVals) const
+	{
+	if (bits != nullptr)
+		{ BitVector::read_bits(numPositions,positions,bitVals);  return; }
+
+	if (mappedBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for read_bits(" + std::to_string(numPositions) + " positions)"
+		     + " in unmapped bit vector");
+
+	read_bits_from_words (mappedBits, numPositions, positions, bitVals);
+	}
+
+void MappedBitVector::write_bit
+   (u64	pos,
+	int	val)
+	{
+	if (bits != nullptr)
+		BitVector::write_bit(pos,val);
+	else
+		fatal ("internal error for " + identity()
+		     + "; attempt to modify position " + std::to_string(pos)
+		     + " in memory-mapped bit vector");
+	}
+
+u64 MappedBitVector::rank1
+   (u64 pos)
+	{
+	// see BitVector::rank1() for our mathematical definition of rank1
+
+	if (bits != nullptr) return BitVector::rank1(pos);
+
+	if (mappedBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for rank1(" + std::to_string(pos) + ")"
+		     + " in null bit vector");
+
+	if (rankSamples == nullptr) prepare_rank_select();
+
+	dbgRankSelect_CountRank;
+	u64 block = pos / mappedRankBlockBits;
+	return rankSamples[block]
+	     + bitwise_count(mappedBits + block*(mappedRankBlockBits/64),
+	                     pos % mappedRankBlockBits);
+	}
+
+void MappedBitVector::rank1_many
+   (u64			numPositions,
+	const u64*	positions,
+	u64*		ranks)
+	{
+	// see BitVector::rank1_many(); we count forward through the mapped words,
+	// starting from a rank sample when the gap is large
+
+	if (bits != nullptr) { BitVector::rank1_many(numPositions,positions,ranks);  return; }
+
+	if (mappedBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for rank1_many(" + std::to_string(numPositions) + " positions)"
+		     + " in null bit vector");
+
+	if (rankSamples == nullptr) prepare_rank_select();
+
+	u64 basePos  = 0;
+	u64 baseRank = 0;
+	bool haveBase = false;
+
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		{
+		u64 pos       = positions[ix];
+		u64 wordStart = pos & ~((u64) 63);
+
+		if ((haveBase) && (wordStart - basePos <= rankManyMaxGap))
+			{
+			if (wordStart > basePos)
+				baseRank += bitwise_count (mappedBits+basePos/64, wordStart-basePos);
+			}
+		else
+			{
+			baseRank = rank1(wordStart);
+			haveBase = true;
+			}
+		basePos = wordStart;
+
+		if (pos == wordStart) ranks[ix] = baseRank;
+		                 else ranks[ix] = baseRank + bitwise_count (mappedBits+wordStart/64, pos-wordStart);
+		}
+	}
+
+u64 MappedBitVector::select0
+   (u64 rank)
+	{
+	// see BitVector::select0() for our mathematical definition of select0
+
+	if (bits != nullptr) return BitVector::select0(rank);
+
+	if (mappedBits == nullptr)
+		fatal ("internal error for " + identity()
+		     + "; request for select0(" + std::to_string(rank) + ")"
+		     + " in null bit vector");
+
+	if (rankSamples == nullptr) prepare_rank_select();
+
+	dbgRankSelect_CountSelect;
+
+	// binary search for the last block that has no more than rank zeros
+	// preceding it; the zero we want is in that block
+
+	u64 lo = 0;
+	u64 hi = numBits / mappedRankBlockBits;
+	while (lo < hi)
+		{
+		u64 mid = (lo + hi + 1) / 2;
+		u64 zerosBefore = mid*mappedRankBlockBits - rankSamples[mid];
+		if (zerosBefore <= rank) lo = mid;
+		                    else hi = mid-1;
+		}
+
+	// scan that block, a word at a time
+
+	u64 remaining = rank - (lo*mappedRankBlockBits - rankSamples[lo]);
+	u64 numWords  = (numBits + 63) / 64;
+	for (u64 wIx=lo*(mappedRankBlockBits/64) ; wIx<numWords ; wIx++)
+		{
+		u64 word     = ~mappedBits[wIx];
+		u64 wordBits = std::min((u64) 64, numBits - 64*wIx);
+		u64 numZeros = bitwise_count(&word,wordBits);
+		if (remaining >= numZeros)
+			{ remaining -= numZeros;  continue; }
+		for (u64 bitIx=0 ; bitIx<wordBits ; bitIx++,word>>=1)
+			{
+			if ((word & 1) == 0) continue;
+			if (remaining == 0) return 64*wIx + bitIx;
+			remaining--;
+			}
+		}
+
+	fatal ("internal error for " + identity()
+	     + "; request for select0(" + std::to_string(rank) + ")"
+	     + " exceeds the number of zeros");
+	return 0; // never gets here
+	}
+
+void MappedBitVector::prepare_rank_select ()
+	{
+	// see BitVector::prepare_rank_select(); select0 uses the same samples as
+	// rank1, so there's only one thing to create
+
+	if (bits != nullptr) { BitVector::prepare_rank_select();  return; }
+
+	if ((mappedBits == nullptr) || (rankSamples != nullptr)) return;
+
+	dbgRankSelect_CountRankNew;
+	u64 numSamples = numBits/mappedRankBlockBits + 1;
+	rankSamples = new u64[numSamples];
+	if (trackMemory)
+		cerr << "@+" << rankSamples << " creating rankSamples for MappedBitVector(" << identity() << " " << this << ")" << endl;
+
+	rankSamples[0] = 0;
+	for (u64 sampleIx=1 ; sampleIx<numSamples ; sampleIx++)
+		rankSamples[sampleIx] = rankSamples[sampleIx-1]
+		                      + bitwise_count(mappedBits + (sampleIx-1)*(mappedRankBlockBits/64),
+		                                      mappedRankBlockBits);
+	}
+
+void MappedBitVector::discard_rank_select ()
+	{
+	if ((trackMemory) && (rankSamples != nullptr))
+		cerr << "@-" << rankSamples << " discarding rankSamples for MappedBitVector(" << identity() << " " << this << ")" << endl;
+
+	if (rankSamples != nullptr) { delete[] rankSamples;  rankSamples = nullptr; }
+	BitVector::discard_rank_select();
+	}
+
+u64 MappedBitVector::size () const
+	{
+	if (bits != nullptr) return bits->size();
+	if (mappedBits != nullptr) return numBits;
+
+	fatal ("internal error for " + identity()
+	     + "; request for size() of null bit vector");
+	return 0; // never gets here
+	}
+
 //----------
 //
 // ZerosBitVector--
@@ -1659,7 +2945,7 @@ void ZerosBitVector::copy_from
 	}
 
 void ZerosBitVector::copy_from
-   (const rrrbitvector* srcRrrBits)
+   (const RrrBits* srcRrrBits)
 	{
 	fatal ("internal error for " + identity()
 	     + "; attempt to install an RRR bit vector");
@@ -1706,6 +2992,14 @@ void ZerosBitVector::mask_with
 	     + "; attempt to mask write-protected bit vector");
 	}
 
+void ZerosBitVector::read_bits
+   (u64			numPositions,
+	const u64*	positions,
+	u8*			bitVals) const
+	{
+	std::memset (bitVals, 0, numPositions);
+	}
+
 void ZerosBitVector::write_bit
    (u64	pos,
 	int	val)
@@ -1786,6 +3080,14 @@ OnesBitVector::~OnesBitVector()
 		     + "; destructor encountered non-null bit vector");
 	}
 
+void OnesBitVector::read_bits
+   (u64			numPositions,
+	const u64*	positions,
+	u8*			bitVals) const
+	{
+	std::memset (bitVals, 1, numPositions);
+	}
+
 u64 OnesBitVector::rank1
    (u64 pos)
 	{
@@ -1937,6 +3239,8 @@ string BitVector::compressor_to_string
 //		  <bytes>  gives the number of bytes in the segment (decimal or hex)
 //		  <bits>   gives the number of *bits* in the segment; this only applies
 //		           to "raw" type
+//	(3)	When BitVector::useMemoryMap is true, uncompressed bit vectors are
+//		created as MappedBitVectors, which are read-only.
 //
 //----------
 
@@ -2050,6 +3354,9 @@ BitVector* BitVector::bit_vector
 		cerr << "creating bit_vector type \"" << kind << "\""
 		     << " at offset " << offset << " in \"" << filename << "\"" << endl;
 
+	if ((kind == "bv") && (useMemoryMap))
+		return new MappedBitVector (filename, offset, numBytes);
+
 	if      (kind == "bv")      return new BitVector      (filename, offset, numBytes);
 	else if (kind == "rrr")     return new RrrBitVector   (filename, offset, numBytes);
 	else if (kind == "uncrrr")  return new RrrBitVector   (filename, offset, numBytes, /*uncompressed*/ true);
@@ -2080,14 +3387,25 @@ BitVector* BitVector::bit_vector
 		cerr << "creating bit_vector type " << compressor
 		     << " at offset " << offset << " in \"" << filename << "\"" << endl;
 
-	switch (compressor)
+	// nota bene: for rrr, the second and third bytes of the compressor code
+	//            may give the block size and rank period (as they do in a
+	//            bloom filter file's header); zeros mean the defaults
+
+	u32 rrrBlockSize  = (compressor >> 8)  & 0x000000FF;
+	u32 rrrRankPeriod = (compressor >> 16) & 0x000000FF;
+
+	switch (compressor & 0x000000FF)
 		{
 		case bvcomp_uncompressed:
+			if (useMemoryMap)
+				return new MappedBitVector (filename, offset, numBytes);
 			return new BitVector      (filename, offset, numBytes);
 		case bvcomp_rrr:
-			return new RrrBitVector   (filename, offset, numBytes);
+			return new RrrBitVector   (filename, offset, numBytes, /*uncompressed*/ false,
+			                           rrrBlockSize, rrrRankPeriod);
 		case bvcomp_unc_rrr:
-			return new RrrBitVector   (filename, offset, numBytes, /*uncompressed*/ true);
+			return new RrrBitVector   (filename, offset, numBytes, /*uncompressed*/ true,
+			                           rrrBlockSize, rrrRankPeriod);
 		case bvcomp_roar:
 			return new RoarBitVector  (filename, offset, numBytes);
 		case bvcomp_unc_roar:
@@ -2161,7 +3479,7 @@ BitVector* BitVector::bit_vector
 //----------
 //
 // Arguments:
-//	const rrrbitvector*	rrrBits:	Compressed bit array to read.
+//	const RrrBits*		rrrBits:	Compressed bit array to read.
 //	void*				dstBits:	Uncompressed bit array to fill.
 //	u64					numBits:	The length of the bit array, counted in
 //									.. *bits*. See notes (1) and (2) below.
@@ -2181,7 +3499,7 @@ BitVector* BitVector::bit_vector
 //----------
 
 void decompress_rrr
-   (const rrrbitvector*	rrrBits,
+   (const RrrBits*		rrrBits,
 	void*				dstBits,
 	const u64			_numBits)
 	{
@@ -11,6 +11,11 @@
 // choice can be specified on the build command line by defining RRR_BLOCK_SIZE
 // and/or RRR_RANK_PERIOD. If no choice has been specified we default to block
 // size 255 and rank period 32.
+//
+// Note that these only determine the defaults for newly created RRR vectors.
+// We also support block sizes 63, 127 and 255 with rank periods 8, 16, 32 and
+// 64, selected at run time (see RrrBits below); a file created with any of
+// those can be read, and compress-bf can create them.
 // 
 // RRR_BLOCK_SIZE is the number of uncompressed bits in each block of an RRR
 // bit vector. This corresponds to the t_bs field of the rrr_vector type
@@ -62,11 +67,69 @@ using rrrselect0    = sdsl::select_support_rrr<0,rrr_template_args>;
 using rrrselect1    = sdsl::select_support_rrr<1,rrr_template_args>;
 #undef rrr_template_args
 
+// RrrBits, RrrRankSupport and RrrSelectSupport hide the block size and rank
+// period template arguments of sdsl's rrr types, so that these can be chosen
+// at run time; RrrBits::rrr_bits() creates one for a given (block size, rank
+// period) pair
+
+class RrrRankSupport
+	{
+public:
+	virtual ~RrrRankSupport() {}
+	virtual std::uint64_t rank(std::uint64_t pos) const = 0;
+	std::uint64_t operator()(std::uint64_t pos) const { return rank(pos); }
+	};
+
+class RrrSelectSupport
+	{
+public:
+	virtual ~RrrSelectSupport() {}
+	virtual std::uint64_t select(std::uint64_t rank) const = 0;
+	std::uint64_t operator()(std::uint64_t rank) const { return select(rank); }
+	};
+
+class RrrBits
+	{
+public:
+	virtual ~RrrBits() {}
+	virtual std::uint32_t block_size() const = 0;
+	virtual std::uint32_t rank_period() const = 0;
+	virtual std::uint64_t size() const = 0;
+	virtual int operator[](std::uint64_t pos) const = 0;
+	virtual void read_bits(std::uint64_t numPositions, const std::uint64_t* positions,
+	                       std::uint8_t* bitVals) const = 0;
+	virtual std::uint64_t get_int(std::uint64_t pos, std::uint8_t len=64) const = 0;
+	virtual void load(std::istream& in) = 0;
+	virtual size_t serialize(std::ostream& out) const = 0;
+	virtual RrrBits* clone() const = 0;
+	virtual RrrRankSupport*   new_rank0() const = 0;
+	virtual RrrRankSupport*   new_rank1() const = 0;
+	virtual RrrSelectSupport* new_select0() const = 0;
+	virtual RrrSelectSupport* new_select1() const = 0;
+
+public:
+	static bool     valid_parameters (std::uint32_t blockSize, std::uint32_t rankPeriod);
+	static RrrBits* rrr_bits (std::uint32_t blockSize, std::uint32_t rankPeriod);
+	static RrrBits* rrr_bits (std::uint32_t blockSize, std::uint32_t rankPeriod,
+	                          const sdslbitvector& srcBits);
+	};
+
 //using    roarbitvector = roaring_bitmap_t
 
 #define sdslbitvectorHeaderBytes 8	// to grab "raw" bits, skip this many bytes
 									// at the start of an sdslbitvector file
 
+// operations for BitVector::combine_with()
+
+enum
+	{
+	bvop_union            = 1,
+	bvop_union_complement = 2,
+	bvop_intersect        = 3,
+	bvop_mask             = 4,
+	bvop_xor              = 5
+	};
+
 //----------
 //
 // classes in this module--
@@ -93,6 +156,8 @@ public:
 	virtual void save();
 	virtual size_t serialized_out(std::ofstream& out, const std::string& filename, const size_t offset=0);
 	virtual size_t serialized_out(std::ofstream& out);
+	virtual size_t checksummed_out(std::ofstream& out, std::uint32_t& crc);
+	virtual void verify_checksum();
 
 	virtual void discard_bits();
 	virtual void new_bits(std::uint64_t numBits);
@@ -109,12 +174,20 @@ public:
 	virtual void mask_with(const sdslbitvector* srcBits);
 	virtual void xor_with(const sdslbitvector* srcBits);
 	virtual void squeeze_by(const sdslbitvector* srcBits);
+	virtual void combine_with(const BitVector* srcBv, int operation);
+	virtual void extract_words(std::uint64_t startWord, std::uint64_t numWords,
+	                           std::uint64_t* dstWords) const;
 
 	virtual int operator[](std::uint64_t pos) const;
+	virtual void read_bits(std::uint64_t numPositions, const std::uint64_t* positions,
+	                       std::uint8_t* bitVals) const;
 	virtual void write_bit(std::uint64_t pos, int val=1);
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
+	virtual void rank1_many(std::uint64_t numPositions, const std::uint64_t* positions,
+	                        std::uint64_t* ranks);
 	virtual std::uint64_t select0(std::uint64_t rank);
+	virtual void prepare_rank_select();
 	virtual void discard_rank_select();
 
 	virtual std::uint64_t num_bits() const { return numBits; }
@@ -134,6 +207,9 @@ public:
 	sdslselect0* selector0;
 	std::uint64_t filterInfo; // filter-dependent info for this bit vector;
 							// .. typically zero
+	bool hasChecksum = false; // true => checksum is the CRC32C of the
+							// .. vector's data in the file
+	std::uint32_t checksum = 0;
 
 public:
 	bool reportLoad     = false;
@@ -155,6 +231,12 @@ public:
 	static std::uint64_t totalSelectNews;
 	static std::uint64_t totalRankCalls;
 	static std::uint64_t totalSelectCalls;
+	static bool useMemoryMap;   // true => uncompressed vectors read from files
+	                            //         .. are memory-mapped, rather than
+	                            //         .. copied into memory
+	static bool verifyChecksums; // true => when a vector with a checksum is
+	                            //         .. loaded, its data is first read
+	                            //         .. and checked against it
 
 public:
 	static bool       valid_filename (const std::string& filename);
@@ -177,7 +259,8 @@ public:
 class RrrBitVector: public BitVector
 	{
 public:
-	RrrBitVector(const std::string& filename, const size_t offset=0, size_t numBytes=0, bool readAsUncompressed=false);
+	RrrBitVector(const std::string& filename, const size_t offset=0, size_t numBytes=0, bool readAsUncompressed=false,
+	             std::uint32_t blockSize=0, std::uint32_t rankPeriod=0);
 	RrrBitVector(const BitVector* srcBv);
 	RrrBitVector(std::uint64_t numBits=0);
 	virtual ~RrrBitVector();
@@ -194,17 +277,24 @@ public:
 	virtual void discard_bits();
 	virtual void new_bits(std::uint64_t numBits);
 	virtual void copy_from(const sdslbitvector* srcBits);
-	virtual void copy_from(const rrrbitvector* srcRrrBits);
+	virtual void copy_from(const RrrBits* srcRrrBits);
 	virtual void compress();
 
 	virtual bool is_all_zeros();
 	virtual bool is_all_ones();
+	virtual void extract_words(std::uint64_t startWord, std::uint64_t numWords,
+	                           std::uint64_t* dstWords) const;
 
 	virtual int operator[](std::uint64_t pos) const;
+	virtual void read_bits(std::uint64_t numPositions, const std::uint64_t* positions,
+	                       std::uint8_t* bitVals) const;
 	virtual void write_bit(std::uint64_t pos, int val=1);
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
+	virtual void rank1_many(std::uint64_t numPositions, const std::uint64_t* positions,
+	                        std::uint64_t* ranks);
 	virtual std::uint64_t select0(std::uint64_t rank);
+	virtual void prepare_rank_select();
 	virtual void discard_rank_select();
 
 	virtual std::uint64_t size() const;
@@ -213,11 +303,17 @@ public:
 								// .. in uncompressed form
 	bool writeAsUncompressed;	// true => output file is to contain the vector
 								// .. still in uncompressed form
-	rrrbitvector* rrrBits;		// exclusive of BitVector.bits; at most one of
+	std::uint32_t rrrBlockSize;	// block size and rank period for rrrBits
+	std::uint32_t rrrRankPeriod;
+	RrrBits* rrrBits;			// exclusive of BitVector.bits; at most one of
 								// .. bits and rrrBits is non-null at a given
 								// .. time
-	rrrrank1*   rrrRanker1;		// exclusive of BitVector.ranker1
-	rrrselect0* rrrSelector0;	// exclusive of BitVector.selector0
+	RrrRankSupport*   rrrRanker1;	// exclusive of BitVector.ranker1
+	RrrSelectSupport* rrrSelector0;	// exclusive of BitVector.selector0
+
+public:
+	static std::uint32_t defaultBlockSize;	// block size and rank period for
+	static std::uint32_t defaultRankPeriod;	// .. newly created vectors
 	};
 
 
@@ -246,12 +342,19 @@ public:
 
 	virtual bool is_all_zeros();
 	virtual bool is_all_ones();
+	virtual void extract_words(std::uint64_t startWord, std::uint64_t numWords,
+	                           std::uint64_t* dstWords) const;
 
 	virtual int operator[](std::uint64_t pos) const;
+	virtual void read_bits(std::uint64_t numPositions, const std::uint64_t* positions,
+	                       std::uint8_t* bitVals) const;
 	virtual void write_bit(std::uint64_t pos, int val=1);
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
+	virtual void rank1_many(std::uint64_t numPositions, const std::uint64_t* positions,
+	                        std::uint64_t* ranks);
 	virtual std::uint64_t select0(std::uint64_t rank);
+	virtual void prepare_rank_select();
 	virtual void discard_rank_select();
 
 	virtual std::uint64_t size() const;
@@ -263,6 +366,10 @@ public:
 	roaring_bitmap_t* roarBits;	// exclusive of BitVector.bits; at most one of
 								// .. bits and roarBits is non-null at a given
 								// .. time
+	std::uint64_t* roarRankSamples; // roarRankSamples[i] is the number of 1s
+								// .. in the first i*65536 bits (i.e. before
+								// .. roaring container i); exclusive of
+								// .. BitVector.ranker1 and .selector0
 	};
 
 
@@ -279,6 +386,48 @@ public:
 	};
 
 
+class MappedBitVector: public BitVector
+	{
+public:
+	MappedBitVector(const std::string& filename, const size_t offset=0, size_t numBytes=0);
+	// MappedBitVector(BitVector* srcBv);  we intentionally omit this constructor
+	virtual ~MappedBitVector();
+
+	virtual std::string class_identity() const { return "MappedBitVector"; }
+	virtual bool modifiable() { return false; }
+	virtual void load();
+	virtual void discard_bits();
+	virtual void unmap();
+
+	virtual bool is_all_zeros();
+	virtual bool is_all_ones();
+
+	virtual int operator[](std::uint64_t pos) const;
+	virtual void read_bits(std::uint64_t numPositions, const std::uint64_t* positions,
+	                       std::uint8_t* bitVals) const;
+	virtual void write_bit(std::uint64_t pos, int val=1);
+
+	virtual std::uint64_t rank1(std::uint64_t pos);
+	virtual void rank1_many(std::uint64_t numPositions, const std::uint64_t* positions,
+	                        std::uint64_t* ranks);
+	virtual std::uint64_t select0(std::uint64_t rank);
+	virtual void prepare_rank_select();
+	virtual void discard_rank_select();
+
+	virtual std::uint64_t size() const;
+
+	void* mapStart;				// start of the mapped region of the file, or
+								// .. nullptr if nothing is mapped; exclusive
+								// .. of BitVector.bits
+	size_t mapLength;			// number of bytes mapped
+	const std::uint64_t* mappedBits; // the vector's bits, inside the mapped
+								// .. region
+	std::uint64_t* rankSamples;	// rankSamples[i] is the number of 1s in the
+								// .. first i*512 bits; exclusive of
+								// .. BitVector.ranker1 and .selector0
+	};
+
+
 class ZerosBitVector: public BitVector
 	{
 public:
@@ -297,7 +446,7 @@ public:
 	virtual void discard_bits();
 	virtual void new_bits(std::uint64_t numBits);
 	virtual void copy_from(const sdslbitvector* srcBits);
-	virtual void copy_from(const rrrbitvector* srcRrrBits);
+	virtual void copy_from(const RrrBits* srcRrrBits);
 	virtual void copy_from(const roaring_bitmap_t* srcRoarBits);
 
 	virtual bool is_all_zeros() { return true; }
@@ -309,6 +458,8 @@ public:
 	virtual void mask_with(const sdslbitvector* srcBits);
 
 	virtual int operator[](std::uint64_t pos) const { return 0; }
+	virtual void read_bits(std::uint64_t numPositions, const std::uint64_t* positions,
+	                       std::uint8_t* bitVals) const;
 	virtual void write_bit(std::uint64_t pos, int val=1);
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
@@ -334,6 +485,8 @@ public:
 	virtual bool is_all_ones() { return true; }
 
 	virtual int operator[](std::uint64_t pos) const { return 1; }
+	virtual void read_bits(std::uint64_t numPositions, const std::uint64_t* positions,
+	                       std::uint8_t* bitVals) const;
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
 	virtual std::uint64_t select0(std::uint64_t rank);
@@ -348,5 +501,5 @@ public:
 //
 //----------
 
-void decompress_rrr (const rrrbitvector* rrrBits,
+void decompress_rrr (const RrrBits* rrrBits,
                      void* dstBits, const std::uint64_t numBits);
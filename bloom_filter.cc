@@ -14,6 +14,7 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <chrono>
 
 #include "utilities.h"
@@ -394,15 +395,20 @@ void BloomFilter::save()
 			}
 		}
 
-// $$$ this needs to make sure the file isn't currently opened for read!!!!
+	// if the file is currently opened for read, close it; we're about to
+	// replace it
 
-	// allocate the header, with enough room for a bfvectorinfo record for each
-	// component
+	if (FileManager::openedFilename == filename)
+		FileManager::close_file();
+
+	// allocate the header, with enough room for a bfvectorinfo record and a
+	// checksum for each component
 	//
 	// note that we are assuming that the header size for the current file
 	// format version is at least as large as that for any earlier versions
 
-	u64 headerBytesNeeded = bffileheader_size(numBitVectors);
+	u64 crcOffset = bffileheader_size(numBitVectors);
+	u64 headerBytesNeeded = crcOffset + bffileheader_crcs_size(numBitVectors);
 	headerBytesNeeded = round_up_16(headerBytesNeeded);
 
 	u32 headerSize = (u32) headerBytesNeeded;
@@ -422,6 +428,11 @@ void BloomFilter::save()
 	// write a fake header to the file; after we write the rest of the file
 	// we'll rewind and write the real header; we do this because we don't know
 	// the component offsets and sizes until after we've written them
+	//
+	// nota bene: we write to a temporary file, and only replace the real file
+	//            once the temporary file is complete and flushed to disk;
+	//            so a crash can't leave a partially-written filter in place
+	//            of a good one
 
 	if (reportSave)
 		cerr << "Saving " << filename << endl;
@@ -430,12 +441,13 @@ void BloomFilter::save()
 	header->magic      = bffileheaderMagicUn;
 	header->headerSize = (u32) sizeof(bffileprefix);
 
-	std::ofstream out (filename, std::ios::binary | std::ios::trunc | std::ios::out);
+	string tempFilename = temp_filename (filename);
+	std::ofstream out (tempFilename, std::ios::binary | std::ios::trunc | std::ios::out);
 	out.write ((char*)header, headerSize);
 	size_t bytesWritten = headerSize; // (based on assumption of success)
 	if (not out)
 		fatal ("error: " + class_identity() + "::save(" + identity() + ")"
-		     + " failed to open \"" + filename + "\"");
+		     + " failed to open \"" + tempFilename + "\"");
 
 	// start the real header
 
@@ -443,7 +455,7 @@ void BloomFilter::save()
 	header->headerSize   = headerSize;
 	header->version      = bffileheaderVersion;
 	header->bfKind       = kind();
-	header->padding1     = 0;
+	header->crcOffset    = (u32) crcOffset;
 	header->kmerSize     = kmerSize;
 	header->numHashes    = numHashes;
 	header->hashSeed1    = hashSeed1;
@@ -454,7 +466,9 @@ void BloomFilter::save()
 	header->setSizeKnown = setSizeKnown;
 	header->setSize      = (setSizeKnown)? setSize : 0;
 
-	// write the component(s)
+	u32* crcs = (u32*) (((char*) header) + crcOffset);
+
+	// write the component(s), computing each one's checksum as it is written
 
 	for (int bvIx=0 ; bvIx<numBitVectors ; bvIx++)
 		{
@@ -466,23 +480,36 @@ void BloomFilter::save()
 		if ((header->info[bvIx].compressor == bvcomp_rrr)
 		 || (header->info[bvIx].compressor == bvcomp_unc_rrr))
 			{
-			header->info[bvIx].compressor |= (RRR_BLOCK_SIZE  << 8);
-			header->info[bvIx].compressor |= (RRR_RANK_PERIOD << 16);
+			RrrBitVector* rrrBv = (RrrBitVector*) bv;
+			header->info[bvIx].compressor |= (rrrBv->rrrBlockSize  << 8);
+			header->info[bvIx].compressor |= (rrrBv->rrrRankPeriod << 16);
 			}
 
-		size_t numBytes = bv->serialized_out (out, filename, header->info[bvIx].offset);
+		u32 crc;
+		size_t numBytes = bv->checksummed_out (out, crc);
+		bv->filename = filename;
+		bv->offset   = header->info[bvIx].offset;
 		bytesWritten += numBytes;
 
 		header->info[bvIx].numBytes   = numBytes;
 		header->info[bvIx].filterInfo = bv->filterInfo;
+		crcs[bvIx] = crc;
+		bv->numBytes    = numBytes;
+		bv->hasChecksum = true;
+		bv->checksum    = crc;
 		}
 
 	// rewind and overwrite header
 
 	out.seekp(std::ios::beg);
 	out.write ((char*)header, headerSize);
+	if (not out)
+		fatal ("error: " + class_identity() + "::save(" + identity() + ")"
+		     + " problem writing \"" + tempFilename + "\"");
 	out.close();
 
+	commit_temp_file (tempFilename, filename);
+
 	// clean up
 
 	if ((trackMemory) && (header != nullptr))
@@ -696,9 +723,21 @@ void BloomFilter::new_bits
 
 	if (bvs[whichBv] != nullptr) delete bvs[whichBv];
 
+	// if the source is rrr- or roar-compressed and we want it uncompressed,
+	// decompress it a chunk at a time, by union into an empty vector
+
+	u32 srcCompressor = srcBv->compressor();
+	if ((srcBv->bits == nullptr)
+	 && ((srcCompressor == bvcomp_rrr) || (srcCompressor == bvcomp_roar))
+	 && (compressor == bvcomp_uncompressed))
+		{
+		bvs[whichBv] = BitVector::bit_vector(compressor,srcBv->num_bits());
+		bvs[whichBv]->combine_with(srcBv,bvop_union);
+		return;
+		}
+
 	if (srcBv->bits == nullptr)
 		{
-		u32 srcCompressor = srcBv->compressor();
 		if ((srcCompressor != bvcomp_zeros) && (srcCompressor != bvcomp_ones))
 			fatal ("internal error for " + identity()
 			     + "; attempt to copy bits from null or compressed bitvector " + srcBv->identity());
@@ -808,7 +847,10 @@ void BloomFilter::union_with
 			bvs[whichDstBv]->fill(1);
 			break;
 		default:
-			bvs[whichDstBv]->union_with(srcBv->bits);
+			if (srcBv->is_compressed())
+				bvs[whichDstBv]->combine_with(srcBv,bvop_union);
+			else
+				bvs[whichDstBv]->union_with(srcBv->bits);
 			break;
 		}
 	}
@@ -829,7 +871,10 @@ void BloomFilter::union_with_complement
 		case bvcomp_ones:
 			break;
 		default:
-			bvs[whichDstBv]->union_with_complement(srcBv->bits);
+			if (srcBv->is_compressed())
+				bvs[whichDstBv]->combine_with(srcBv,bvop_union_complement);
+			else
+				bvs[whichDstBv]->union_with_complement(srcBv->bits);
 			break;
 		}
 	}
@@ -850,7 +895,10 @@ void BloomFilter::intersect_with
 		case bvcomp_ones:
 			break;
 		default:
-			bvs[whichDstBv]->intersect_with(srcBv->bits);
+			if (srcBv->is_compressed())
+				bvs[whichDstBv]->combine_with(srcBv,bvop_intersect);
+			else
+				bvs[whichDstBv]->intersect_with(srcBv->bits);
 			break;
 		}
 
@@ -872,7 +920,10 @@ void BloomFilter::mask_with
 			bvs[whichDstBv]->fill(0);
 			break;
 		default:
-			bvs[whichDstBv]->mask_with(srcBv->bits);
+			if (srcBv->is_compressed())
+				bvs[whichDstBv]->combine_with(srcBv,bvop_mask);
+			else
+				bvs[whichDstBv]->mask_with(srcBv->bits);
 			break;
 		}
 	}
@@ -893,7 +944,10 @@ void BloomFilter::xor_with
 			bvs[whichDstBv]->complement();
 			break;
 		default:
-			bvs[whichDstBv]->xor_with(srcBv->bits);
+			if (srcBv->is_compressed())
+				bvs[whichDstBv]->combine_with(srcBv,bvop_xor);
+			else
+				bvs[whichDstBv]->xor_with(srcBv->bits);
 			break;
 		}
 	}
@@ -965,6 +1019,19 @@ u64 BloomFilter::mer_to_position
 	              else return npos;  // position is *not* in the filter
 	}
 
+// hash_to_position--
+//	Report the position corresponding to a kmer's hash value (e.g. as computed
+//	by hasher1's rolling hash); as with mer_to_position, we return
+//	BloomFilter::npos if the position is not within the filter
+
+u64 BloomFilter::hash_to_position
+   (const u64 h) const
+	{
+	u64 pos = h % hashModulus;
+	if (pos < numBits) return pos;
+	              else return npos;  // position is *not* in the filter
+	}
+
 // add--
 //	Add a kmer to the filter; the kmer can be a string or 2-bit encoded data
 
@@ -1108,6 +1175,63 @@ int BloomFilter::lookup
 	                else return unresolved;
 	}
 
+//----------
+//
+// lookup_many--
+//	Look up each of a list of positions, as per lookup().
+//
+//----------
+//
+// Arguments:
+//	const u64*	positions:		The positions to look up.
+//	u64			numPositions:	The number of entries in positions[].
+//	int8_t*		resolutions:	Place to return the results; resolutions[i] is
+//								.. lookup(positions[i]).
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	Each filter kind reads its bit vectors with BitVector::read_bits(), so
+//		there is one virtual call per bit vector rather than two (lookup() and
+//		operator[]) per position; read_bits() is a tight loop over the vector's
+//		concrete representation.
+//	(2)	Where a second vector only needs to be consulted for some positions
+//		(e.g. bvSome in an all/some filter), those positions are gathered and
+//		read with a second read_bits() call.
+//	(3)	Subclasses may also take advantage of positions that are in
+//		increasing order, but they must still give correct results for
+//		unsorted positions.
+//	(4)	The query search calls this once per chunk of lookupChunkSize
+//		positions (in bloom_tree.cc), at every node it visits. So subclasses
+//		keep their scratch space for the gathered positions on the stack, for
+//		up to lookupManyStackPositions positions, and only allocate for larger
+//		requests.
+//
+//----------
+
+#define lookupManyStackPositions 64		// (same as lookupChunkSize in
+										// .. bloom_tree.cc)
+
+void BloomFilter::lookup_many
+   (const u64*	positions,
+	u64			numPositions,
+	std::int8_t* resolutions) const
+	{
+	BitVector* bv = bvs[0];
+
+	// we assume, without checking, that 0 <= pos < numBits
+
+	std::uint8_t* bitVals = (std::uint8_t*) resolutions;
+	bv->read_bits(numPositions,positions,bitVals);
+
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		resolutions[ix] = (bitVals[ix] == 0)? (std::int8_t) absent
+		                                     : (std::int8_t) unresolved;
+	}
+
 //----------
 //
 // AllSomeFilter--
@@ -1192,6 +1316,61 @@ int AllSomeFilter::lookup
 	else                          return unresolved;
 	}
 
+void AllSomeFilter::lookup_many
+   (const u64*	positions,
+	u64			numPositions,
+	std::int8_t* resolutions) const
+	{
+	// positions that aren't in bvAll need their bit in bvSome; we collect
+	// those and read them together
+
+	BitVector* bvAll  = bvs[0];
+	BitVector* bvSome = bvs[1];
+
+	std::uint8_t* bitVals = (std::uint8_t*) resolutions;
+	bvAll->read_bits(numPositions,positions,bitVals);
+
+	u64          stackScratch[2*lookupManyStackPositions];
+	std::uint8_t stackVals[lookupManyStackPositions];
+	vector<u64>          heapScratch;
+	vector<std::uint8_t> heapVals;
+	u64*          somePositions = stackScratch;
+	u64*          someIndexes   = stackScratch + lookupManyStackPositions;
+	std::uint8_t* someVals      = stackVals;
+	if (numPositions > lookupManyStackPositions)
+		{
+		heapScratch.resize(2*numPositions);
+		heapVals.resize(numPositions);
+		somePositions = heapScratch.data();
+		someIndexes   = somePositions + numPositions;
+		someVals      = heapVals.data();
+		}
+
+	u64 numSome = 0;
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		{
+		if (bitVals[ix] == 1)
+			resolutions[ix] = (std::int8_t) present;
+		else
+			{
+			somePositions[numSome] = positions[ix];
+			someIndexes[numSome++] = ix;
+			}
+		}
+
+	if (numSome == 0) return;
+
+	bvSome->read_bits(numSome,somePositions,someVals);
+
+	for (u64 someIx=0 ; someIx<numSome ; someIx++)
+		{
+		if (someVals[someIx] == 0)
+			resolutions[someIndexes[someIx]] = (std::int8_t) absent;
+		else
+			resolutions[someIndexes[someIx]] = (std::int8_t) unresolved;
+		}
+	}
+
 //----------
 //
 // DeterminedFilter--
@@ -1246,6 +1425,61 @@ int DeterminedFilter::lookup
 	else                         return absent;
 	}
 
+void DeterminedFilter::lookup_many
+   (const u64*	positions,
+	u64			numPositions,
+	std::int8_t* resolutions) const
+	{
+	// positions that are determined need their bit in bvHow; we collect those
+	// and read them together
+
+	BitVector* bvDet = bvs[0];
+	BitVector* bvHow = bvs[1];
+
+	std::uint8_t* bitVals = (std::uint8_t*) resolutions;
+	bvDet->read_bits(numPositions,positions,bitVals);
+
+	u64          stackScratch[2*lookupManyStackPositions];
+	std::uint8_t stackVals[lookupManyStackPositions];
+	vector<u64>          heapScratch;
+	vector<std::uint8_t> heapVals;
+	u64*          detPositions = stackScratch;
+	u64*          detIndexes   = stackScratch + lookupManyStackPositions;
+	std::uint8_t* howVals      = stackVals;
+	if (numPositions > lookupManyStackPositions)
+		{
+		heapScratch.resize(2*numPositions);
+		heapVals.resize(numPositions);
+		detPositions = heapScratch.data();
+		detIndexes   = detPositions + numPositions;
+		howVals      = heapVals.data();
+		}
+
+	u64 numDetermined = 0;
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		{
+		if (bitVals[ix] == 0)
+			resolutions[ix] = (std::int8_t) unresolved;
+		else
+			{
+			detPositions[numDetermined] = positions[ix];
+			detIndexes[numDetermined++] = ix;
+			}
+		}
+
+	if (numDetermined == 0) return;
+
+	bvHow->read_bits(numDetermined,detPositions,howVals);
+
+	for (u64 detIx=0 ; detIx<numDetermined ; detIx++)
+		{
+		if (howVals[detIx] == 1)
+			resolutions[detIndexes[detIx]] = (std::int8_t) present;
+		else
+			resolutions[detIndexes[detIx]] = (std::int8_t) absent;
+		}
+	}
+
 //----------
 //
 // DeterminedBriefFilter--
@@ -1308,6 +1542,84 @@ int DeterminedBriefFilter::lookup
 	else                       return absent;
 	}
 
+void DeterminedBriefFilter::lookup_many
+   (const u64*	positions,
+	u64			numPositions,
+	std::int8_t* resolutions) const
+	{
+	// positions that are determined need a rank1 to find their how bit; we
+	// collect those and, if they are in increasing order, rank them together
+
+	BitVector* bvDet = bvs[0];
+	BitVector* bvHow = bvs[1];
+
+	std::uint8_t* bitVals = (std::uint8_t*) resolutions;
+	bvDet->read_bits(numPositions,positions,bitVals);
+
+	u64          stackScratch[3*lookupManyStackPositions];
+	std::uint8_t stackVals[lookupManyStackPositions];
+	vector<u64>          heapScratch;
+	vector<std::uint8_t> heapVals;
+	u64*          detPositions = stackScratch;
+	u64*          detIndexes   = stackScratch + lookupManyStackPositions;
+	u64*          howPositions = stackScratch + 2*lookupManyStackPositions;
+	std::uint8_t* howVals      = stackVals;
+	if (numPositions > lookupManyStackPositions)
+		{
+		heapScratch.resize(3*numPositions);
+		heapVals.resize(numPositions);
+		detPositions = heapScratch.data();
+		detIndexes   = detPositions + numPositions;
+		howPositions = detPositions + 2*numPositions;
+		howVals      = heapVals.data();
+		}
+
+	u64 numDetermined = 0;
+	for (u64 ix=0 ; ix<numPositions ; ix++)
+		{
+		if (bitVals[ix] == 0)
+			resolutions[ix] = (std::int8_t) unresolved;
+		else
+			{
+			detPositions[numDetermined] = positions[ix];
+			detIndexes[numDetermined++] = ix;
+			}
+		}
+
+	if (numDetermined == 0) return;
+
+	if (std::is_sorted(detPositions,detPositions+numDetermined))
+		bvDet->rank1_many(numDetermined,detPositions,howPositions);
+	else
+		{
+		for (u64 detIx=0 ; detIx<numDetermined ; detIx++)
+			howPositions[detIx] = bvDet->rank1(detPositions[detIx]);
+		}
+
+	bvHow->read_bits(numDetermined,howPositions,howVals);
+
+	for (u64 detIx=0 ; detIx<numDetermined ; detIx++)
+		{
+		if (howVals[detIx] == 1)
+			resolutions[detIndexes[detIx]] = (std::int8_t) present;
+		else
+			resolutions[detIndexes[detIx]] = (std::int8_t) absent;
+		}
+	}
+
+//----------
+//
+// DeterminedBriefFilter::adjust_positions_in_list--
+//
+//----------
+//
+// Notes:
+//	(1)	The unresolved positions are ranked in increasing order, using
+//		rank1_many(), and the results written back to their original slots;
+//		so the order of the list is unchanged.
+//
+//----------
+
 void DeterminedBriefFilter::adjust_positions_in_list
    (vector<u64> &kmerPositions,
 	u64 numUnresolved)
@@ -1315,10 +1627,29 @@ void DeterminedBriefFilter::adjust_positions_in_list
 	BitVector* bvDet = bvs[0];
 	dbgAdjust_pos_list1;
 
+	if (numUnresolved == 0) return;
+
+	// sort the unresolved positions, remembering where each came from
+
+	vector<u64> order(numUnresolved);
 	for (u64 posIx=0 ; posIx<numUnresolved ; posIx++)
+		order[posIx] = posIx;
+	std::sort(order.begin(),order.end(),
+	          [&](const u64 a, const u64 b)
+	            { return kmerPositions[a] < kmerPositions[b]; });
+
+	vector<u64> sortedPositions(numUnresolved);
+	for (u64 sortIx=0 ; sortIx<numUnresolved ; sortIx++)
+		sortedPositions[sortIx] = kmerPositions[order[sortIx]];
+
+	vector<u64> ranks(numUnresolved);
+	bvDet->rank1_many(numUnresolved,sortedPositions.data(),ranks.data());
+
+	for (u64 sortIx=0 ; sortIx<numUnresolved ; sortIx++)
 		{
-		u64 pos  = kmerPositions[posIx];
-		u64 rank = bvDet->rank1(pos);
+		u64 posIx = order[sortIx];
+		u64 pos   = sortedPositions[sortIx];
+		u64 rank  = ranks[sortIx];
 		kmerPositions[posIx] = pos - rank;  // $$$ isn't this just rank0(pos)?
 		dbgAdjust_pos_list2;
 		}
@@ -1655,6 +1986,26 @@ BloomFilter* BloomFilter::bloom_filter
 //
 //----------
 //
+// Arguments (variant 2):
+//	const bffileheader*	header:		The file's header, already read into
+//									memory (e.g. from a packed tree's
+//									directory).
+//	const string&	filename:		The name of the bloom filter file the
+//									header came from.  This is used for error
+//									messages and for deriving filter names.
+//	const string&	dataFilename:	The name of the file that actually contains
+//									the bit vectors' data.  Usually this is the
+//									same as filename, but for a packed tree it
+//									is the packed file.
+//	u64				dataOffset:		Offset (into dataFilename) at which the
+//									bloom filter file begins.  The offsets in
+//									the header are relative to this.
+//
+// Returns (variant 2):
+//	Same as variant 1.
+//
+//----------
+//
 // Notes:
 //	(1)	Each bloom filter created also has a bit vector  (or bit vectors)
 //		created for it.  The bit vector has the proper information about where
@@ -1663,6 +2014,43 @@ BloomFilter* BloomFilter::bloom_filter
 //
 //----------
 
+// check_header_prefix--
+//	Validate the magic number, version, and size claimed by a bloom filter
+//	file's header.
+
+static void check_header_prefix
+   (const bffileprefix&	prefix,
+	const string&		filename)
+	{
+	if (prefix.magic == bffileheaderMagicUn)
+		fatal ("error: BloomFilter::identify_content(" + filename + ")"
+		       " looks like an incomplete bloom filter file"
+		       " (it seems the file was not completely written)");
+
+	if (prefix.magic != bffileheaderMagic)
+		fatal ("error: BloomFilter::identify_content(" + filename + ")"
+		       " doesn't look like a bloom filter file"
+		       " (incorrect magic number)");
+
+	if ((prefix.version != bffileheaderVersion)
+	 && (prefix.version != bffileheaderVersion2)
+	 && (prefix.version != bffileheaderVersion1))
+		fatal ("error: BloomFilter::identify_content(" + filename + ")"
+		       " bloom filter file version " + std::to_string(prefix.version)
+		     + " is not supported by this program");
+
+	if (prefix.headerSize <= sizeof(prefix))
+		fatal ("error: BloomFilter::identify_content(" + filename + ")"
+		       " header impossibly small (" + std::to_string(prefix.headerSize) + " bytes)");
+
+	if (prefix.headerSize > max_bffileheader_size)
+		fatal ("error: BloomFilter::identify_content(" + filename + ")"
+		       " headers larger than " + std::to_string(max_bffileheader_size) + " bytes are not supported,"
+		     + " this file's header claims to be " + std::to_string(prefix.headerSize) + " bytes");
+	}
+
+//=== variant 1 ===
+
 vector<pair<string,BloomFilter*>> BloomFilter::identify_content
    (std::ifstream&	in,
 	const string&	filename)
@@ -1693,30 +2081,7 @@ vector<pair<string,BloomFilter*>> BloomFilter::identify_content
 	if (countFileBytes)
 		{ totalFileReads++;  totalFileBytesRead += sizeof(prefix); }
 
-	if (prefix.magic == bffileheaderMagicUn)
-		fatal ("error: BloomFilter::identify_content(" + filename + ")"
-		       " looks like an incomplete bloom filter file"
-		       " (it seems the file was not completely written)");
-
-	if (prefix.magic != bffileheaderMagic)
-		fatal ("error: BloomFilter::identify_content(" + filename + ")"
-		       " doesn't look like a bloom filter file"
-		       " (incorrect magic number)");
-
-	if ((prefix.version != bffileheaderVersion)
-	 && (prefix.version != bffileheaderVersion1))
-		fatal ("error: BloomFilter::identify_content(" + filename + ")"
-		       " bloom filter file version " + std::to_string(prefix.version)
-		     + " is not supported by this program");
-
-	if (prefix.headerSize <= sizeof(prefix))
-		fatal ("error: BloomFilter::identify_content(" + filename + ")"
-		       " header impossibly small (" + std::to_string(prefix.headerSize) + " bytes)");
-
-	if (prefix.headerSize > max_bffileheader_size)
-		fatal ("error: BloomFilter::identify_content(" + filename + ")"
-		       " headers larger than " + std::to_string(max_bffileheader_size) + " bytes are not supported,"
-		     + " this file's header claims to be " + std::to_string(prefix.headerSize) + " bytes");
+	check_header_prefix (prefix, filename);
 
 	//---- read the rest of the header, and validate ----
 
@@ -1748,6 +2113,32 @@ vector<pair<string,BloomFilter*>> BloomFilter::identify_content
 	if (reportTotalLoadTime)
 		totalLoadTime += elapsedTime;  // $$$ danger of precision error?
 
+	content = identify_content (header, filename, filename);
+
+	if (trackMemory)
+		cerr << "@-" << header << " discarding bf file header for \"" << filename << "\"" << endl;
+
+	delete[] header;
+
+	return content;
+	}
+
+//=== variant 2 ===
+
+vector<pair<string,BloomFilter*>> BloomFilter::identify_content
+   (const bffileheader*	header,
+	const string&		filename,
+	const string&		dataFilename,
+	u64					dataOffset)
+	{
+	vector<pair<string,BloomFilter*>> content;
+
+	//---- validate the header ----
+
+	bffileprefix prefix;
+	std::memcpy (/*to*/ &prefix, /*from*/ header, /*how much*/ sizeof(prefix));
+	check_header_prefix (prefix, filename);
+
 	if ((header->bfKind != bfkind_simple)
 	 && (header->bfKind != bfkind_allsome)
 	 && (header->bfKind != bfkind_determined)
@@ -1776,9 +2167,23 @@ vector<pair<string,BloomFilter*>> BloomFilter::identify_content
 		     + " is not a multiple of the number of vectors per filter"
 		     + "(" + std::to_string(vectorsPerFilter) + ")");
 
-	if (header->padding1 != 0)
-		fatal ("error: BloomFilter::identify_content(" + filename + ")"
-		       " non-zero padding field 1: " + std::to_string(header->padding1));
+	const u32* crcs = nullptr;
+	if (prefix.version != bffileheaderVersion)
+		{
+		// (in earlier versions, crcOffset was padding1)
+		if (header->crcOffset != 0)
+			fatal ("error: BloomFilter::identify_content(" + filename + ")"
+			       " non-zero padding field 1: " + std::to_string(header->crcOffset));
+		}
+	else if (header->crcOffset != 0)
+		{
+		if ((header->crcOffset < minHeaderSize)
+		 || (header->crcOffset + bffileheader_crcs_size(header->numVectors) > header->headerSize))
+			fatal ("error: BloomFilter::identify_content(" + filename + ")"
+			       " checksum array (at offset " + std::to_string(header->crcOffset) + ")"
+			     + " doesn't fit within the header");
+		crcs = (const u32*) (((const char*) header) + header->crcOffset);
+		}
 
 	if (prefix.version == bffileheaderVersion1)
 		{
@@ -1856,22 +2261,21 @@ vector<pair<string,BloomFilter*>> BloomFilter::identify_content
 				if ((bvInfo.compressor & 0xFF000000) != 0) goto bad_compressor_code;
 				rrrBlockSize  = (bvInfo.compressor >> 8)  & 0x000000FF;
 				rrrRankPeriod = (bvInfo.compressor >> 16) & 0x000000FF;
-				if (rrrBlockSize != RRR_BLOCK_SIZE)
+				if (rrrRankPeriod == 0) rrrRankPeriod = DEFAULT_RRR_RANK_PERIOD;
+				if (not RrrBits::valid_parameters(rrrBlockSize,rrrRankPeriod))
 					fatal ("error: BloomFilter::identify_content(" + filename + ")"
 					       " bitvector-" + std::to_string(bvIx)
-					     + ", rrr block size mismatch"
+					     + ", unsupported rrr parameters"
 					     + "\nthe file's block size is " + std::to_string(rrrBlockSize)
-					     + ", program's block size is " + std::to_string(RRR_BLOCK_SIZE)
+					     + " and its rank period is " + std::to_string(rrrRankPeriod)
 					     + "\n(see notes regarding RRR_BLOCK_SIZE in bit_vector.h)");
-				if (rrrRankPeriod == 0) rrrRankPeriod = DEFAULT_RRR_RANK_PERIOD;
-				if (rrrRankPeriod != RRR_RANK_PERIOD)
-					fatal ("error: BloomFilter::identify_content(" + filename + ")"
-					       " bitvector-" + std::to_string(bvIx)
-					     + ", rrr rank period mismatch"
-					     + "\nthe file's rank period is " + std::to_string(rrrRankPeriod)
-					     + ", program's rank period is " + std::to_string(RRR_RANK_PERIOD)
-					     + "\n(see notes regarding RRR_RANK_PERIOD in bit_vector.h)");
-				bvInfo.compressor &= 0x000000FF;
+
+				// nota bene: we leave the block size and rank period in the
+				//            compressor code, for BitVector::bit_vector()
+
+				bvInfo.compressor = (bvInfo.compressor & 0x000000FF)
+				                  | (rrrBlockSize  << 8)
+				                  | (rrrRankPeriod << 16);
 				break;
 			default:
 			bad_compressor_code:
@@ -1923,7 +2327,7 @@ vector<pair<string,BloomFilter*>> BloomFilter::identify_content
 			if (reportCreation)
 				cerr << "about to construct BloomFilter for " << filename << " content " << whichBv << endl;
 			bf = bloom_filter(header->bfKind,
-			                  filename, header->kmerSize,
+			                  dataFilename, header->kmerSize,
 			                  header->numHashes, header->hashSeed1, header->hashSeed2,
 			                  header->numBits, header->hashModulus);
 
@@ -1944,16 +2348,21 @@ vector<pair<string,BloomFilter*>> BloomFilter::identify_content
 
 			if (reportCreation)
 				cerr << "about to construct BitVector for " << filename << " content " << whichBv << endl;
-			bf->bvs[0] = BitVector::bit_vector(filename,bvInfo.compressor,bvInfo.offset,bvInfo.numBytes);
+			bf->bvs[0] = BitVector::bit_vector(dataFilename,bvInfo.compressor,dataOffset+bvInfo.offset,bvInfo.numBytes);
 			}
 		else
 			{
 			if (reportCreation)
 				cerr << "about to construct BitVector for " << filename << " content " << whichBv << endl;
-			bf->bvs[whichBv] = BitVector::bit_vector(filename,bvInfo.compressor,bvInfo.offset,bvInfo.numBytes);
+			bf->bvs[whichBv] = BitVector::bit_vector(dataFilename,bvInfo.compressor,dataOffset+bvInfo.offset,bvInfo.numBytes);
 			}
 
 		bf->bvs[whichBv]->filterInfo = header->info[infoIx].filterInfo;
+		if (crcs != nullptr)
+			{
+			bf->bvs[whichBv]->hasChecksum = true;
+			bf->bvs[whichBv]->checksum    = crcs[infoIx];
+			}
 
 		if (whichBv == vectorsPerFilter-1)
 			{
@@ -1962,11 +2371,6 @@ vector<pair<string,BloomFilter*>> BloomFilter::identify_content
 			}
 		}
 
-	if ((trackMemory) && (header != nullptr))
-		cerr << "@-" << header << " discarding bf file header for \"" << filename << "\"" << endl;
-
-	if (header != nullptr) delete[] header;
-
 	return content;
 	}
 
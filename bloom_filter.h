@@ -9,6 +9,7 @@
 #include "bit_vector.h"
 
 class FileManager;
+struct bffileheader;
 
 //----------
 //
@@ -66,11 +67,14 @@ public:
 
 	virtual std::uint64_t mer_to_position(const std::string& mer) const;
 	virtual std::uint64_t mer_to_position(const std::uint64_t* merData) const;
+	virtual std::uint64_t hash_to_position(const std::uint64_t h) const;
 	virtual void add (const std::string& mer);
 	virtual void add (const std::uint64_t* merData);
 	virtual bool contains (const std::string& mer) const;
 	virtual bool contains (const std::uint64_t* merData) const;
 	virtual int lookup (const std::uint64_t pos) const;
+	virtual void lookup_many (const std::uint64_t* positions, std::uint64_t numPositions,
+	                          std::int8_t* resolutions) const;
 
 	virtual std::uint64_t hash_modulus() const { return hashModulus; }
 	virtual std::uint64_t num_bits()     const { return numBits; }
@@ -145,6 +149,9 @@ public:
 	    (const BloomFilter* templateBf, const std::string& newFilename="");
 	static std::vector<std::pair<std::string,BloomFilter*>> identify_content
 	    (std::ifstream& in, const std::string& filename="");
+	static std::vector<std::pair<std::string,BloomFilter*>> identify_content
+	    (const bffileheader* header, const std::string& filename,
+	     const std::string& dataFilename, std::uint64_t dataOffset=0);
 	static double false_positive_rate
 		(std::uint32_t numHashes,std::uint64_t numBits,std::uint64_t numItems);
 
@@ -186,6 +193,8 @@ public:
 	virtual bool contains (const std::string& mer) const;
 	virtual bool contains (const std::uint64_t* merData) const;
 	virtual int lookup (const std::uint64_t pos) const;
+	virtual void lookup_many (const std::uint64_t* positions, std::uint64_t numPositions,
+	                          std::int8_t* resolutions) const;
 	};
 
 
@@ -208,6 +217,8 @@ public:
 	virtual std::uint32_t kind() const { return bfkind_determined; }
 
 	virtual int lookup (const std::uint64_t pos) const;
+	virtual void lookup_many (const std::uint64_t* positions, std::uint64_t numPositions,
+	                          std::int8_t* resolutions) const;
 	};
 
 class DeterminedBriefFilter: public DeterminedFilter
@@ -237,6 +248,8 @@ public:
 	virtual std::uint32_t kind() const { return bfkind_determined_brief; }
 
 	virtual int lookup (const std::uint64_t pos) const;
+	virtual void lookup_many (const std::uint64_t* positions, std::uint64_t numPositions,
+	                          std::int8_t* resolutions) const;
 
 	virtual bool is_position_adjustor  () { return true; }
 	virtual void adjust_positions_in_list  (std::vector<std::uint64_t> &kmerPositions,
@@ -23,6 +23,10 @@
 //	[4]	We require the bit data to be in the same order as the components and
 //		back-to-back within the file (i.e. no empty space). This is necessary
 //		so that the data can be read from the file without having to do seeks.
+//	[5]	Beginning with version 3, the header may contain a checksum (CRC32C)
+//		of each bit vector's data; these are in an array of numVectors u32s,
+//		located at crcOffset (after the info[] array and before the names).
+//		If crcOffset is zero, the file has no checksums.
 //
 //----------
 
@@ -81,14 +85,15 @@ struct bffileprefix // convenience type, matching the beginning of bffileheader;
 	std::uint32_t	version;
 	};
 
-const std::uint64_t bffileheaderVersion  = 2;
+const std::uint64_t bffileheaderVersion  = 3;
 struct bffileheader
 	{
 	// current version of the header format; note that file format versions
 	// track with the major program version (in cmd_version.h); e.g. file
 	// format version 2 begins with program version 2; file version 2 might
 	// also be in vogue for higher program versions if those program versions
-	// don't necessitate a new file version
+	// don't necessitate a new file version; version 3 differs from version 2
+	// only in that it may contain checksums
 	//
 	// NOTE: any new versions of the header MUST be at least as large as
 	//       earlier versions, and MUST overlay bffileheaderv1
@@ -100,10 +105,13 @@ struct bffileheader
 								//      .. includes, e.g., all entries in the
 								//      .. info[] array, and bfvectorinfo.name
 								//      .. characters (if any)
-	std::uint32_t	version;	// [0C] file format version (2)
+	std::uint32_t	version;	// [0C] file format version (3)
     std::uint32_t	bfKind;		// [10] (one of bfkind_xxx) identifier for the
     							//      .. type of bloom filter
-	std::uint32_t	padding1;	// [14] (expected to be 0)
+	std::uint32_t	crcOffset;	// [14] (was padding1 in v1 and v2)
+								//      offset (from start of file) to the
+								//      .. array of bit vector checksums;
+								//      .. zero means there are no checksums
 	std::uint32_t	kmerSize;	// [18]
 	std::uint32_t	numHashes;	// [1C]
 	std::uint64_t	hashSeed1;	// [20]
@@ -125,9 +133,14 @@ struct bffileheader
 								//      number of distinct kmers that were
 								//      .. inserted during construction
     bfvectorinfo	info[1];	// [50] (array with numVectors entries)
-    // after info[], characters for the bfvectorinfo.name fields 
+    // after info[], the checksum array (if any), then characters for the
+    // bfvectorinfo.name fields 
 	};							// size: 0x70 (of just this base struct)
 
+const std::uint64_t bffileheaderVersion2 = 2;
+//	(version 2 is identical to version 3, except that crcOffset is padding1,
+//	 and is expected to be 0)
+
 const std::uint64_t bffileheaderVersion1 = 1;
 //struct bffileheaderv1
 //	{
@@ -168,13 +181,14 @@ const std::uint64_t bffileheaderVersion1 = 1;
 //	};
 
 #define bffileheader_size(numVectors) (sizeof(bffileheader) + ((numVectors)-1)*sizeof(bfvectorinfo))
+#define bffileheader_crcs_size(numVectors) ((numVectors)*sizeof(std::uint32_t))
 
 const std::uint64_t bffileheaderMagic    = 0xD532006662544253; // little-endian ascii "SBTbf" plus some extra bits
 const std::uint64_t bffileheaderMagicUn  = 0xCD96AD692C96649A; // (used for header written to an unfinished file)
 
 #define max_bffile_bit_vectors (1000*1000)
 #define bffile_avg_chars_per_name 15
-#define max_bffileheader_size (bffileheader_size(max_bffile_bit_vectors)   + max_bffile_bit_vectors*(bffile_avg_chars_per_name+1))
+#define max_bffileheader_size (bffileheader_size(max_bffile_bit_vectors) + bffileheader_crcs_size(max_bffile_bit_vectors) + max_bffile_bit_vectors*(bffile_avg_chars_per_name+1))
 
 enum
 	{
@@ -11,14 +11,21 @@
 #include <cstdint>
 #include <cmath>
 #include <iostream>
+#include <algorithm>
+#include <tuple>
+#include <unordered_map>
+#include <thread>
+#include <sstream>
 
 #include "utilities.h"
 #include "bit_utilities.h"
 #include "file_manager.h"
+#include "packed_tree_file.h"
 #include "bloom_tree.h"
 
 using std::string;
 using std::vector;
+using std::tuple;
 using std::cout;
 using std::cerr;
 using std::endl;
@@ -31,10 +38,33 @@ using std::endl;
 //
 //----------
 
-bool BloomTree::inhibitBvSimplify   = false;
-bool BloomTree::trackMemory         = false;
-bool BloomTree::reportUnload        = false;
-int  BloomTree::dbgTraversalCounter = -1;
+bool                 BloomTree::inhibitBvSimplify   = false;
+bool                 BloomTree::trackMemory         = false;
+bool                 BloomTree::reportUnload        = false;
+std::atomic<int>     BloomTree::dbgTraversalCounter(-1);
+std::atomic<int>     BloomTree::idleWorkers(0);
+std::recursive_mutex BloomTree::loadLock;
+u64                  BloomTree::cacheBudget         = 0;
+u64                  BloomTree::cacheBytes          = 0;
+u64                  BloomTree::cacheHits           = 0;
+u64                  BloomTree::cacheMisses         = 0;
+u64                  BloomTree::cacheEvictions      = 0;
+vector<std::list<BloomTree*>> BloomTree::cacheLevels;
+bool                 BloomTree::prefetchFilters     = false;
+u64                  BloomTree::prefetchLoads       = 0;
+std::mutex           BloomTree::prefetchLock;
+std::condition_variable BloomTree::prefetchSignal;
+std::deque<BloomTree*> BloomTree::prefetchQueue;
+std::thread          BloomTree::prefetcher;
+u32                  BloomTree::prefetchClients     = 0;
+bool                 BloomTree::prefetcherStop      = false;
+u64                  BloomTree::holdBudget          = 0;
+u64                  BloomTree::heldBytesTotal      = 0;
+u64                  BloomTree::numHolds            = 0;
+u64                  BloomTree::numSpills           = 0;
+bool                 BloomTree::checkConsistency    = false;
+BloomFilter*         BloomTree::consistencyModel    = nullptr;
+bool                 BloomTree::mergeLookups        = false;
 
 //----------
 //
@@ -55,6 +85,14 @@ BloomTree::BloomTree
 		fpRateKnown(false),
 		fpRate(0.0),
 		nodesShareFiles(false),
+		filterUsers(0),
+		isCached(false),
+		cacheLevel(0),
+		cachedBytes(0),
+		prefetchWanted(false),
+		prefetchHeld(false),
+		isHeld(false),
+		heldBytes(0),
 		queryStats(nullptr)
 	{
 	if (trackMemory)
@@ -76,6 +114,14 @@ BloomTree::BloomTree
 		isLeaf(root->isLeaf),
 		parent(nullptr),
 		nodesShareFiles(false),
+		filterUsers(0),
+		isCached(false),
+		cacheLevel(0),
+		cachedBytes(0),
+		prefetchWanted(false),
+		prefetchHeld(false),
+		isHeld(false),
+		heldBytes(0),
 		queryStats(nullptr)
 	{
 	// nota bene: this doesn't copy the subtree, just the root node; we expect
@@ -104,6 +150,8 @@ BloomTree::~BloomTree()
 			cerr << "@-" << this << " destructor BloomTree(" << bfFilename << ")" << endl;
 		}
 
+	if (isCached) uncache_filter();
+	if (isHeld) heldBytesTotal -= heldBytes;
 	if (bf != nullptr) delete bf;
 	for (const auto& subtree : children)
 		delete subtree;
@@ -116,13 +164,31 @@ BloomTree::~BloomTree()
 
 void BloomTree::preload()
 	{
+	std::lock_guard<std::recursive_mutex> guard(loadLock);
+
+	// nota bene: a packed file's name doesn't tell us the filter type, so we
+	//            let the manager create the filter from the node's header
+
+	if ((bf == nullptr) and (manager != nullptr) and (bfFilename == manager->packFilename))
+		manager->preload_content(bfFilename,name);
+
 	if (bf == nullptr) bf = BloomFilter::bloom_filter(bfFilename);
 	relay_debug_settings();
 	bf->preload();
+	check_consistency();
 	}
 
 void BloomTree::load()
 	{
+	// nota bene: loading is serialized, since bit vectors are read through
+	//            FileManager's single open file, and since a file manager may
+	//            populate several nodes' filters from one file
+
+	std::lock_guard<std::recursive_mutex> guard(loadLock);
+
+	if ((bf == nullptr) and (manager != nullptr) and (bfFilename == manager->packFilename))
+		manager->preload_content(bfFilename,name);
+
 	if (bf == nullptr)
 		{
 		if (FileManager::dbgContentLoad)
@@ -134,6 +200,33 @@ void BloomTree::load()
 	bf->reportSave = reportSave;
 	if (manager != nullptr) bf->manager = manager;
 	bf->load(/*bypassManager*/false,/*whichNodeName*/name);
+	check_consistency();
+	}
+
+//----------
+//
+// check_consistency--
+//	If checkConsistency is set, make sure a node's filter has the same
+//	properties as the first filter we encountered.
+//
+//----------
+//
+// Notes:
+//	(1)	This replaces preloading every node before a search begins; nodes
+//		the search never reaches are never read. An inconsistency is reported
+//		(fatally) when the offending node is first reached.
+//	(2)	The caller is expected to hold loadLock.
+//
+//----------
+
+void BloomTree::check_consistency()
+	{
+	if ((not checkConsistency) or (bf == nullptr) or (not bf->ready)) return;
+
+	if (consistencyModel == nullptr)
+		consistencyModel = BloomFilter::bloom_filter(bf);
+	else
+		bf->is_consistent_with (consistencyModel, /*beFatal*/ true);
 	}
 
 void BloomTree::save(bool finished)
@@ -157,22 +250,356 @@ void BloomTree::save(bool finished)
 	bf->save();
 	}
 
+//----------
+//
+// hold_or_save--
+//	Save a node's filter during a build, or hold it in memory instead, until
+//	its parent finishes it.
+//
+//----------
+//
+// Arguments:
+//	bool	finished:	true  => the filter is in its final form
+//						false => the filter is unfinished; its parent will
+//						         .. modify it and save it again
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	When building an allsome or determined tree, each node is first
+//		computed in an unfinished form, which its parent needs in order to
+//		compute itself; the parent then modifies the child and saves it in its
+//		final form. Without a hold budget, the unfinished form is written to
+//		disk and read back by the parent, so every node is written twice.
+//	(2)	If holdBudget allows, an unfinished filter is kept resident instead,
+//		and the parent picks it up with load(), which does nothing for a
+//		resident filter. The node is then written only once, by its parent.
+//		When the budget is exhausted, we spill (save and unload) as before.
+//	(3)	The held filter is released by unloadable(), which the parent calls
+//		right after saving the finished child.
+//	(4)	Finished filters, and builds that inhibit the child update (a debug
+//		option), are always saved.
+//
+//----------
+
+void BloomTree::hold_or_save
+   (bool	finished)
+	{
+	if ((not finished) and (holdBudget > 0) and (not dbgInhibitChildUpdate))
+		{
+		u64 numBytes = filter_bytes();
+
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
+		if (heldBytesTotal + numBytes <= holdBudget)
+			{
+			// mark the bit vectors the same way save() would have, so that the
+			// filter is in the same state as if the parent had read it back
+
+			for (int bvIx=0 ; bvIx<bf->numBitVectors ; bvIx++)
+				bf->get_bit_vector(bvIx)->unfinished();
+
+			isHeld         =  true;
+			heldBytes      =  numBytes;
+			heldBytesTotal += numBytes;
+			numHolds++;
+			return;
+			}
+		numSpills++;
+		}
+
+	save(finished);
+	unloadable();
+	}
+
 void BloomTree::unloadable()
 	{
-	// $$$ eventually we will want a more sophisticated caching mechanism
+	// nota bene: searches that share the tree go through release_filter(),
+	//            which may keep the filter resident in the node cache, rather
+	//            than calling this directly
+
+	std::lock_guard<std::recursive_mutex> guard(loadLock);
+
+	if (isCached) uncache_filter();
+
+	if (isHeld)
+		{
+		heldBytesTotal -= heldBytes;
+		isHeld    = false;
+		heldBytes = 0;
+		}
 
 	if (reportUnload)
 		cerr << "marking " << name << " as unloadable" << endl;
 
+	// nota bene: with a manager, we keep the filter and its bit vector
+	//            objects (which know where their bits are in the file), and
+	//            just discard the bits, so that a later load() can read them
+	//            back without the manager having to identify the content
+	//            again
+
 	if (bf != nullptr)
 		{
 		if (bf->manager != nullptr)
-			bf->discard_bits();
+			{
+			for (int bvIx=0 ; bvIx<bf->numBitVectors ; bvIx++)
+				{
+				BitVector* bv = bf->get_bit_vector(bvIx);
+				if (bv != nullptr) bv->discard_bits();
+				}
+			}
 		else
 			{ delete bf;  bf = nullptr; }
 		}
 	}
 
+//----------
+//
+// acquire_filter, release_filter--
+//	Load/unload this node's filter on behalf of one of possibly several
+//	concurrent searches sharing the tree.
+//
+//----------
+//
+// Notes:
+//	(1)	The filter is loaded by the first user to acquire it, and only marked
+//		as unloadable when the last user releases it. So one search thread
+//		can't discard the filter out from under another.
+//	(2)	Rank/select support is created when the filter is acquired, since
+//		the lazy creation in rank1() and select0() isn't safe when several
+//		threads look up positions in the same bit vector.
+//	(3)	load() and unloadable() are still used directly elsewhere (e.g.
+//		during tree construction), where a node's filter is never shared.
+//	(4)	If the node cache is enabled (cacheBudget is non-zero), a released
+//		filter stays resident in the cache until it is acquired again, or
+//		until it is evicted to make room for other filters. See
+//		cache_filter().
+//	(5)	If the prefetcher has already acquired the filter (see
+//		request_prefetch()), its hold is simply handed over to the caller.
+//
+//----------
+
+void BloomTree::acquire_filter()
+	{
+	std::lock_guard<std::recursive_mutex> guard(loadLock);
+
+	prefetchWanted = false;
+	if (prefetchHeld)
+		{ prefetchHeld = false;  return; }
+
+	filterUsers++;
+	if (isCached)
+		{ uncache_filter();  cacheHits++; }
+	else if (filterUsers == 1)
+		cacheMisses++;
+	load();
+
+	if (bf->is_position_adjustor())
+		{
+		for (int bvIx=0 ; bvIx<bf->numBitVectors ; bvIx++)
+			{
+			BitVector* bv = bf->get_bit_vector(bvIx);
+			if (bv != nullptr) bv->prepare_rank_select();
+			}
+		}
+	}
+
+void BloomTree::release_filter()
+	{
+	std::lock_guard<std::recursive_mutex> guard(loadLock);
+
+	if (filterUsers > 0) filterUsers--;
+	if (filterUsers != 0) return;
+
+	if (cacheBudget == 0)
+		unloadable();
+	else
+		{
+		cache_filter();
+		evict_filters();
+		}
+	}
+
+//----------
+//
+// cache_filter, uncache_filter, evict_filters--
+//	Maintain the node cache, a set of resident filters that no search is
+//	currently using, but which we'd like to keep for subsequent searches.
+//
+//----------
+//
+// Notes:
+//	(1)	Eviction is level-aware. Filters are evicted from the deepest level
+//		of the tree first, and least-recently-used first within a level. A
+//		query batch releases a node's filter before it descends to the
+//		node's children (except for position adjustors), so plain LRU would
+//		evict the nodes nearest the root first; but those are the nodes that
+//		every query batch visits.
+//	(2)	A filter's size is estimated as the number of bytes its bit vectors
+//		occupy in the file.
+//	(3)	The caller must hold loadLock.
+//
+//----------
+
+void BloomTree::cache_filter()
+	{
+	if (isCached) return;
+
+	u64 numBytes = filter_bytes();
+	if (numBytes > cacheBudget)
+		{ unloadable();  return; }
+
+	u32 level = 0;
+	for (BloomTree* ancestor=parent ; ancestor!=nullptr ; ancestor=ancestor->parent)
+		level++;
+	if (cacheLevels.size() <= level)
+		cacheLevels.resize(level+1);
+
+	cacheLevels[level].emplace_front(this);
+	isCached      = true;
+	cacheLevel    = level;
+	cachedBytes   = numBytes;
+	cachePosition = cacheLevels[level].begin();
+	cacheBytes   += numBytes;
+	}
+
+void BloomTree::uncache_filter()
+	{
+	if (not isCached) return;
+
+	cacheLevels[cacheLevel].erase(cachePosition);
+	cacheBytes -= cachedBytes;
+	isCached    = false;
+	cachedBytes = 0;
+	}
+
+void BloomTree::evict_filters()
+	{
+	size_t level = cacheLevels.size();
+	while ((cacheBytes > cacheBudget) && (level > 0))
+		{
+		if (cacheLevels[level-1].empty())
+			{ level--;  continue; }
+
+		BloomTree* victim = cacheLevels[level-1].back();
+		if (reportUnload)
+			cerr << "evicting " << victim->name << " from node cache" << endl;
+		victim->unloadable();  // (this removes it from the cache)
+		cacheEvictions++;
+		}
+	}
+
+u64 BloomTree::filter_bytes()
+	{
+	if (bf == nullptr) return 0;
+
+	u64 numBytes = 0;
+	for (int bvIx=0 ; bvIx<bf->numBitVectors ; bvIx++)
+		{
+		BitVector* bv = bf->get_bit_vector(bvIx);
+		if (bv == nullptr) continue;
+		if (bv->numBytes != 0) numBytes += bv->numBytes;
+		                  else numBytes += (bv->num_bits()+7) / 8;
+		}
+
+	return numBytes;
+	}
+
+//----------
+//
+// request_prefetch, start_prefetcher, stop_prefetcher--
+//	Load filters in the background, ahead of the search that will need them.
+//
+//----------
+//
+// Notes:
+//	(1)	A search calls request_prefetch() for nodes it knows it will visit
+//		soon. The prefetcher thread works through the requests in order,
+//		acquiring each node's filter; this overlaps the file reads with the
+//		search's lookups in other nodes.
+//	(2)	The prefetcher's hold on a filter is handed to the next search that
+//		acquires it (see acquire_filter()). If a search acquires the filter
+//		before the prefetcher gets to it, the request is dropped. So the
+//		prefetcher never loads a filter that nobody is going to use, provided
+//		requests are only made for nodes that are certain to be visited.
+//	(3)	Loading is still serialized by loadLock, so a search that needs a
+//		filter the prefetcher is loading waits for it rather than loading it
+//		a second time.
+//	(4)	Several batch queries (e.g. query shards) can share the prefetcher;
+//		it runs for as long as any of them has it started.
+//
+//----------
+
+void BloomTree::request_prefetch()
+	{
+	if (isDummy) return;
+
+	{
+	std::lock_guard<std::recursive_mutex> guard(loadLock);
+	if ((prefetchWanted) || (prefetchHeld) || (filterUsers > 0)) return;
+	prefetchWanted = true;
+	}
+
+	std::lock_guard<std::mutex> guard(prefetchLock);
+	prefetchQueue.emplace_back(this);
+	prefetchSignal.notify_one();
+	}
+
+void BloomTree::start_prefetcher()
+	{
+	std::lock_guard<std::mutex> guard(prefetchLock);
+
+	if (prefetchClients++ > 0) return;
+
+	prefetcherStop = false;
+	prefetcher = std::thread(prefetcher_main);
+	}
+
+void BloomTree::stop_prefetcher()
+	{
+	{
+	std::lock_guard<std::mutex> guard(prefetchLock);
+	if (prefetchClients == 0) return;
+	if (--prefetchClients > 0) return;
+	prefetcherStop = true;
+	prefetchSignal.notify_one();
+	}
+
+	prefetcher.join();
+
+	// drop any requests that were never acted on
+
+	std::lock_guard<std::recursive_mutex> guard(loadLock);
+	std::lock_guard<std::mutex> queueGuard(prefetchLock);
+	for (const auto& node : prefetchQueue)
+		node->prefetchWanted = false;
+	prefetchQueue.clear();
+	}
+
+void BloomTree::prefetcher_main()
+	{
+	while (true)
+		{
+		BloomTree* node;
+		{
+		std::unique_lock<std::mutex> guard(prefetchLock);
+		prefetchSignal.wait(guard,[]{ return (prefetcherStop) || (not prefetchQueue.empty()); });
+		if (prefetcherStop) return;
+		node = prefetchQueue.front();
+		prefetchQueue.pop_front();
+		}
+
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
+		if (not node->prefetchWanted) continue;  // (already acquired by a search)
+
+		node->acquire_filter();  // (this clears prefetchWanted)
+		node->prefetchHeld = true;
+		prefetchLoads++;
+		}
+	}
+
 void BloomTree::relay_debug_settings()
 	{
 	if (bf != nullptr)
@@ -216,6 +643,8 @@ BloomFilter* BloomTree::real_filter()
 
 	if (not is_dummy())
 		{
+		if ((bf == nullptr) and (manager != nullptr) and (bfFilename == manager->packFilename))
+			manager->preload_content(bfFilename,name);
 		if (bf == nullptr) bf = BloomFilter::bloom_filter(bfFilename);
 		if (manager != nullptr) bf->manager = manager;
 		return bf;
@@ -303,7 +732,11 @@ void BloomTree::construct_union_nodes (u32 compressor)
 	// state (or beyond)
 
 	if (bf != nullptr)
-		{ bf->preload();  return; }
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
+		bf->preload();
+		return;
+		}
 
 	// if we're compressing, compose a filename for the compressed version of
 	// the node;  note that we keep that new name separate from the node's
@@ -334,7 +767,10 @@ void BloomTree::construct_union_nodes (u32 compressor)
 			}
 
 		bf = BloomFilter::bloom_filter(bfFilename);
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
 		bf->load();
+		}
 
 		if (compressor != bvcomp_uncompressed)
 			{
@@ -348,6 +784,11 @@ void BloomTree::construct_union_nodes (u32 compressor)
 			newBf.new_bits(bvInput,compressor);
 			newBf.reportSave = reportSave;
 			newBf.save();
+
+			// keep only the compressed copy resident; the parent reads it
+			// directly, a chunk at a time (see BitVector::combine_with)
+
+			bf->steal_bits(&newBf,/*src*/0,/*dst*/0,newBf.get_bit_vector(0)->compressor());
 			}
 
 		return;
@@ -363,8 +804,7 @@ void BloomTree::construct_union_nodes (u32 compressor)
 			cerr << "\n=== constructing children of " << name << " (#" << (++dbgTraversalCounter) << ") ===" << endl;
 		}
 
-	for (const auto& child : children)
-			child->construct_union_nodes(compressor);
+	construct_children(compressor,&BloomTree::construct_union_nodes);
 
 	// if this is a dummy node, we don't need to build it, but we do mark its
 	// children as unloadable
@@ -405,12 +845,18 @@ void BloomTree::construct_union_nodes (u32 compressor)
 		BitVector* childBv = child->bf->get_bit_vector(0);
 		if (childBv == nullptr)
 			fatal ("internal error: failed to load bit vector for " + child->bfFilename);
-		if (childBv->compressor() != bvcomp_uncompressed)
-			fatal ("error: " + child->bfFilename + " contains compressed bit vector(s)");
+		u32 childCompressor = childBv->compressor();
+		if ((childCompressor != bvcomp_uncompressed)
+		 && (childCompressor != bvcomp_rrr)
+		 && (childCompressor != bvcomp_roar))
+			fatal ("error: " + child->bfFilename + " contains unsupported compressed bit vector(s)");
 
 		if (dbgTraversal)
 			cerr << "incorporating " << child->name << " into parent" << endl;
 
+		// nota bene: an rrr or roar child is read directly, a chunk at a time,
+		//            without decompressing the whole vector
+
 		if (isFirstChild) // incorporate first child's filters
 			{
 			bf = BloomFilter::bloom_filter(child->bf,bfFilename);
@@ -451,6 +897,11 @@ void BloomTree::construct_union_nodes (u32 compressor)
 		newBf.new_bits(bvInput,compressor);
 		newBf.reportSave = reportSave;
 		newBf.save();
+
+		// keep only the compressed copy resident, as for leaves
+
+		if (parent != nullptr)
+			bf->steal_bits(&newBf,/*src*/0,/*dst*/0,newBf.get_bit_vector(0)->compressor());
 		}
 
 	if (parent == nullptr)
@@ -464,6 +915,66 @@ void BloomTree::construct_union_nodes (u32 compressor)
 		}
 	}
 
+//----------
+//
+// construct_children--
+//	Construct the subtrees below this node, as part of building the tree.
+//
+//----------
+//
+// Arguments:
+//	u32		compressor:		(same as for the construct_*_nodes functions)
+//	void	(BloomTree::*construct)(u32):
+//							The construct_*_nodes function to apply to each
+//							.. child.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	Sibling subtrees don't depend on each other, so if worker threads are
+//		available (see idleWorkers) we construct them concurrently. The caller
+//		only combines the children after all of them are finished, and does so
+//		in child order, so the files written are the same as for a serial
+//		build.
+//	(2)	Each child is given to a worker if one is idle at the time we get to
+//		it, otherwise we construct it in this thread. The last child is always
+//		constructed in this thread, since we'd only be waiting otherwise.
+//	(3)	Reading filters during construction is serialized by loadLock, since
+//		the reads go through FileManager's single open file; the bit vector
+//		operations and compression, which dominate the build time, run in
+//		parallel.
+//
+//----------
+
+void BloomTree::construct_children
+   (u32		compressor,
+	void	(BloomTree::*construct)(u32))
+	{
+	size_t				numChildren = children.size();
+	vector<std::thread>	workers;
+
+	for (size_t childIx=0 ; childIx<numChildren ; childIx++)
+		{
+		BloomTree* child = children[childIx];
+		if ((childIx+1 < numChildren) and (claim_worker()))
+			{
+			workers.emplace_back([child,construct,compressor]()
+				{
+				(child->*construct)(compressor);
+				release_worker();
+				});
+			}
+		else
+			(child->*construct)(compressor);
+		}
+
+	for (auto& worker : workers)
+		worker.join();
+	}
+
 //~~~~~~~~~~
 // build allsome tree
 //~~~~~~~~~~
@@ -474,7 +985,11 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 	// state (or beyond)
 
 	if (bf != nullptr)
-		{ bf->preload();  return; }
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
+		bf->preload();
+		return;
+		}
 
 	string bfKindStr       = "." + BloomFilter::filter_kind_to_string(bfkind_allsome);
 	string compressionDesc = "." + BitVector::compressor_to_string(compressor);
@@ -492,7 +1007,10 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 			cerr << "\n=== constructing leaf (for allsome) " << name << " ===" << endl;
 
 		BloomFilter* bfInput = BloomFilter::bloom_filter(bfFilename);
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
 		bfInput->load();
+		}
 
 		if (bfInput->numBitVectors!=1)
 			fatal ("error: " + bfFilename + " contains more than one bit vector");
@@ -515,14 +1033,11 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 		if ((parent == nullptr) || (parent->is_dummy()))
 			finished = true;
 
-		// $$$ we don't necessarily want to save it;  we want to mark it to be
-		//     .. saved, but keep it around if we have enough room, since we'll
-		//     .. need it to compute its parent, at which time we'll change it
+		// save the filter, or hold it in memory until its parent finishes it
 
 		bfFilename = newBfFilename;
 		bf->reportSave = reportSave;
-		save(finished);
-		unloadable();
+		hold_or_save(finished);
 		return;
 		}
 
@@ -536,8 +1051,7 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 			cerr << "\n=== constructing children of " << name << " (#" << (++dbgTraversalCounter) << ") ===" << endl;
 		}
 
-	for (const auto& child : children)
-		child->construct_allsome_nodes(compressor);
+	construct_children(compressor,&BloomTree::construct_allsome_nodes);
 
 	// if this is a dummy node, we don't need to build it, but we do mark its
 	// children as unloadable
@@ -640,14 +1154,11 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 	if ((parent == nullptr) || (parent->is_dummy()))
 		finished = true;
 
-	// $$$ we don't necessarily want to save it;  we want to mark it to be
-	//     .. saved, but keep it around if we have enough room, since we'll
-	//     .. need it to compute its parent, at which time we'll change it
+	// save the filter, or hold it in memory until its parent finishes it
 
 	bfFilename = newBfFilename;
 	bf->reportSave = reportSave;
-	save(finished);
-	unloadable();
+	hold_or_save(finished);
 	}
 
 //~~~~~~~~~~
@@ -660,7 +1171,11 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 	// state (or beyond)
 
 	if (bf != nullptr)
-		{ bf->preload();  return; }
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
+		bf->preload();
+		return;
+		}
 
 	string bfKindStr       = "." + BloomFilter::filter_kind_to_string(bfkind_determined);
 	string compressionDesc = "." + BitVector::compressor_to_string(compressor);
@@ -678,7 +1193,10 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 			cerr << "\n=== constructing leaf (for determined) " << name << " ===" << endl;
 
 		BloomFilter* bfInput = BloomFilter::bloom_filter(bfFilename);
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
 		bfInput->load();
+		}
 
 		if (bfInput->numBitVectors!=1)
 			fatal ("error: " + bfFilename + " contains more than one bit vector");
@@ -707,14 +1225,11 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 			finished = true;
 			}
 
-		// $$$ we don't necessarily want to save it;  we want to mark it to be
-		//     .. saved, but keep it around if we have enough room, since we'll
-		//     .. need it to compute its parent, at which time we'll change it
+		// save the filter, or hold it in memory until its parent finishes it
 
 		bfFilename = newBfFilename;
 		bf->reportSave = reportSave;
-		save(finished);
-		unloadable();
+		hold_or_save(finished);
 		return;
 		}
 
@@ -728,8 +1243,7 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 			cerr << "\n=== constructing children of " << name << " (#" << (++dbgTraversalCounter) << ") ===" << endl;
 		}
 
-	for (const auto& child : children)
-		child->construct_determined_nodes(compressor);
+	construct_children(compressor,&BloomTree::construct_determined_nodes);
 
 	// if this is a dummy node, we don't need to build it, but we do mark its
 	// children as unloadable
@@ -851,14 +1365,11 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 		finished = true;
 		}
 
-	// $$$ we don't necessarily want to save it;  we want to mark it to be
-	//     .. saved, but keep it around if we have enough room, since we'll
-	//     .. need it to compute its parent, at which time we'll change it
+	// save the filter, or hold it in memory until its parent finishes it
 
 	bfFilename = newBfFilename;
 	bf->reportSave = reportSave;
-	save(finished);
-	unloadable();
+	hold_or_save(finished);
 	}
 
 //~~~~~~~~~~
@@ -871,7 +1382,11 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 	// state (or beyond)
 
 	if (bf != nullptr)
-		{ bf->preload();  return; }
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
+		bf->preload();
+		return;
+		}
 
 	string bfKindStr       = "." + BloomFilter::filter_kind_to_string(bfkind_determined_brief);
 	string compressionDesc = "." + BitVector::compressor_to_string(compressor);
@@ -889,7 +1404,10 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 			cerr << "\n=== constructing leaf (for determined,brief) " << name << " ===" << endl;
 
 		BloomFilter* bfInput = BloomFilter::bloom_filter(bfFilename);
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
 		bfInput->load();
+		}
 
 		if (bfInput->numBitVectors!=1)
 			fatal ("error: " + bfFilename + " contains more than one bit vector");
@@ -922,14 +1440,11 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 			finished = true;
 			}
 
-		// $$$ we don't necessarily want to save it;  we want to mark it to be
-		//     .. saved, but keep it around if we have enough room, since we'll
-		//     .. need it to compute its parent, at which time we'll change it
+		// save the filter, or hold it in memory until its parent finishes it
 
 		bfFilename = newBfFilename;
 		bf->reportSave = reportSave;
-		save(finished);
-		unloadable();
+		hold_or_save(finished);
 		return;
 		}
 
@@ -943,8 +1458,7 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 			cerr << "\n=== constructing children of " << name << " (#" << (++dbgTraversalCounter) << ") ===" << endl;
 		}
 
-	for (const auto& child : children)
-		child->construct_determined_brief_nodes(compressor);
+	construct_children(compressor,&BloomTree::construct_determined_brief_nodes);
 
 	// if this is a dummy node, we don't need to build it, but we do mark its
 	// children as unloadable
@@ -1089,14 +1603,11 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 		finished = true;
 		}
 
-	// $$$ we don't necessarily want to save it;  we want to mark it to be
-	//     .. saved, but keep it around if we have enough room, since we'll
-	//     .. need it to compute its parent, at which time we'll change it
+	// save the filter, or hold it in memory until its parent finishes it
 
 	bfFilename = newBfFilename;
 	bf->reportSave = reportSave;
-	save(finished);
-	unloadable();
+	hold_or_save(finished);
 	}
 
 //~~~~~~~~~~
@@ -1116,7 +1627,11 @@ void BloomTree::construct_intersection_nodes (u32 compressor)
 	// state (or beyond)
 
 	if (bf != nullptr)
-		{ bf->preload();  return; }
+		{
+		std::lock_guard<std::recursive_mutex> guard(loadLock);
+		bf->preload();
+		return;
+		}
 
 	string bfKindStr     = "." + BloomFilter::filter_kind_to_string(bfkind_intersection);
 	string newBfFilename = name + bfKindStr + ".bf";
@@ -1223,36 +1738,440 @@ void BloomTree::construct_intersection_nodes (u32 compressor)
 	}
 
 //~~~~~~~~~~
-// query operations
+// build any kind of tree
 //~~~~~~~~~~
 
-void BloomTree::batch_query
-   (vector<Query*>	queries,
-	bool			isLeafOnly,
-	bool			distinctKmers,
-	bool			completeKmerCounts,
-    bool            adjustKmerCounts)
+void BloomTree::construct_nodes
+   (u32		bfKind,
+	u32		compressor)
 	{
-	// preload a root, and make sure that a leaf-only operation can work with
-	// the type of filter we have
-
-	BloomFilter* bf = real_filter();
-	if (bf == nullptr)
-		fatal ("internal error: batch_query() unable to locate any bloom filter");
-	bf->preload();
-
-	if ((isLeafOnly) && (bf->kind() != bfkind_simple))
-		fatal ("batch_query() can't work for trees made of "
-		     + BloomFilter::filter_kind_to_string(bf->kind(),false) + " filters");
-
-	// convert the queries to kmers/positions
-
-	for (auto& q : queries)
-		{
-		q->kmerize(bf,distinctKmers);
-		if (dbgSortKmerPositions) q->sort_kmer_positions();
-		if (dbgKmerPositions)     q->dump_kmer_positions();
+	switch (bfKind)
+		{
+		case bfkind_simple:
+			construct_union_nodes (compressor);
+			break;
+		case bfkind_allsome:
+			construct_allsome_nodes (compressor);
+			break;
+		case bfkind_determined:
+			construct_determined_nodes (compressor);
+			break;
+		case bfkind_determined_brief:
+			construct_determined_brief_nodes (compressor);
+			break;
+		case bfkind_intersection:   // to assist in debugging
+			construct_intersection_nodes (compressor);
+			break;
+		default:
+			fatal ("error: in BloomTree::construct_nodes():"
+			       " bad filter code: \"" + std::to_string(bfKind) + "\"");
 		}
+	}
+
+//~~~~~~~~~~
+// modify a tree that has already been built
+//~~~~~~~~~~
+
+//----------
+//
+// identify_build--
+//	Determine the kind of tree, and the compressor it was built with, from the
+//	nodes' saved filters.
+//
+//----------
+//
+// Arguments:
+//	u32&	bfKind:		Place to return the kind of the tree's filters.
+//	u32&	compressor:	Place to return the compressor the tree was built with.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	A build may have simplified some bit vectors to all-zeros or all-ones,
+//		so those don't tell us the compressor. We read headers of nodes, in
+//		pre-order, until we find a bit vector that does. If we never find one,
+//		we report the tree as uncompressed.
+//
+//----------
+
+void BloomTree::identify_build
+   (u32&	bfKind,
+	u32&	compressor)
+	{
+	vector<BloomTree*> order;
+	pre_order(order);
+	if (order.empty())
+		fatal ("internal error: in identify_build(), the tree has no nodes");
+
+	bfKind     = bfkind_simple;
+	compressor = bvcomp_unknown;
+	bool isFirstNode = true;
+	for (const auto& node : order)
+		{
+		BloomFilter* nodeBf = BloomFilter::bloom_filter(node->bfFilename);
+		nodeBf->preload();
+
+		if (isFirstNode)
+			{ bfKind = nodeBf->kind();  isFirstNode = false; }
+
+		for (int bvIx=0 ; bvIx<nodeBf->numBitVectors ; bvIx++)
+			{
+			u32 bvCompressor = nodeBf->get_bit_vector(bvIx)->compressor();
+			if ((bvCompressor == bvcomp_zeros) || (bvCompressor == bvcomp_ones))
+				continue;
+			compressor = bvCompressor;
+			break;
+			}
+
+		delete nodeBf;
+		if (compressor != bvcomp_unknown) break;
+		}
+
+	if (compressor == bvcomp_unknown)
+		compressor = bvcomp_uncompressed;
+	}
+
+//----------
+//
+// unfinished_filter--
+//	Reconstruct the unfinished form of a node's filter, from the finished form
+//	that was saved when the tree was built.
+//
+//----------
+//
+// Arguments:
+//	const BloomFilter*	parentBf:	The unfinished form of the parent's filter,
+//									.. as reconstructed by this function. This
+//									.. is null if the node has no parent (or if
+//									.. its parent is a dummy).
+//
+// Returns:
+//	A new filter, of the same kind as the node's, holding uncompressed bit
+//	vectors in the form construct_*_nodes() computes for the node before its
+//	parent finishes it. The caller is responsible for deleting it.
+//
+//----------
+//
+// Notes:
+//	(1)	This allows a tree to be modified without rebuilding it. When a subtree
+//		is changed, only the nodes on its path to the root have to be computed
+//		anew, but each of their other children has to be finished again. For
+//		that we need those children in their unfinished forms, which we derive
+//		here, top-down along the path.
+//	(2)	Finishing a node only removes information that is present in its
+//		parent, so the unfinished form can be recovered from the parent's
+//		unfinished form (see the comments in construct_*_nodes()).
+//		  union:             nothing is removed
+//		  allsome:           all(x)  = all'(x) union all(p)
+//		                     some(x) = some'(x)
+//		  determined:        det(x)  = det'(x) union det(p)
+//		                     how(x)  = how'(x) union how(p)
+//		  determined,brief:  as for determined, after det'(x) is unsqueezed by
+//		                     the complement of det(p), and how'(x) by det'(x)
+//		For a node with no parent, take all(p), det(p) and how(p) as all zeros.
+//
+//----------
+
+void BloomTree::unfinished_filter_unsqueeze
+   (const BitVector*	squeezedBv,
+	const void*			specBits,
+	BitVector*			dstBv)
+	{
+	if ((squeezedBv->bits == nullptr) or (squeezedBv->num_bits() == 0))
+		return;  // (an empty squeezed vector unsqueezes to all zeros)
+
+	bitwise_unsqueeze (/*src*/ squeezedBv->bits->data(), squeezedBv->num_bits(),
+	                   specBits, dstBv->num_bits(),
+	                   /*dst*/ dstBv->bits->data(), dstBv->num_bits());
+	}
+
+BloomFilter* BloomTree::unfinished_filter
+   (const BloomFilter*	parentBf)
+	{
+	if (is_dummy())
+		fatal ("internal error: attempt to reconstruct the filter of a dummy node");
+
+	BloomFilter* savedBf = BloomFilter::bloom_filter(bfFilename);
+	{
+	std::lock_guard<std::recursive_mutex> guard(loadLock);
+	savedBf->load();
+	}
+	if (parentBf != nullptr)
+		parentBf->is_consistent_with (savedBf, /*beFatal*/ true);
+
+	// make an uncompressed copy of the saved filter
+
+	BloomFilter* unfinishedBf = BloomFilter::bloom_filter(savedBf);
+	if (trackMemory)
+		cerr << "@+" << unfinishedBf << " creating unfinished filter for " << bfFilename << endl;
+	for (int bvIx=0 ; bvIx<savedBf->numBitVectors ; bvIx++)
+		unfinishedBf->new_bits(savedBf->get_bit_vector(bvIx),bvcomp_uncompressed,bvIx);
+	delete savedBf;
+
+	// restore the information that was removed when the node was finished
+
+	switch (unfinishedBf->kind())
+		{
+		case bfkind_simple:
+			break;
+
+		case bfkind_allsome:
+			if (parentBf != nullptr)
+				unfinishedBf->union_with(parentBf->get_bit_vector(0),0);
+			break;
+
+		case bfkind_determined:
+			if (parentBf != nullptr)
+				{
+				unfinishedBf->union_with(parentBf->get_bit_vector(0),0);
+				unfinishedBf->union_with(parentBf->get_bit_vector(1),1);
+				}
+			break;
+
+		case bfkind_determined_brief:
+			{
+			u64 numBits = unfinishedBf->numBits;
+			BitVector* squeezedDet = unfinishedBf->surrender_bit_vector(0);
+			BitVector* squeezedHow = unfinishedBf->surrender_bit_vector(1);
+			unfinishedBf->new_bits(bvcomp_uncompressed);
+			BitVector* bvDet = unfinishedBf->get_bit_vector(0);
+			BitVector* bvHow = unfinishedBf->get_bit_vector(1);
+
+			//   Idet(x) = complement of det(p)
+			//   Ihow(x) = det'(x), unsqueezed
+
+			sdslbitvector* iDet = new sdslbitvector(numBits,1);
+			if (trackMemory)
+				cerr << "@+" << iDet << " creating iDet sdslbitvector for " << bfFilename << endl;
+			if (parentBf != nullptr)
+				bitwise_complement (/*src*/ parentBf->get_bit_vector(0)->bits->data(),
+				                    /*dst*/ iDet->data(), numBits);
+
+			unfinished_filter_unsqueeze (squeezedDet, iDet->data(), bvDet);
+			unfinished_filter_unsqueeze (squeezedHow, bvDet->bits->data(), bvHow);
+
+			if (trackMemory)
+				cerr << "@-" << iDet << " discarding iDet sdslbitvector for " << bfFilename << endl;
+			delete iDet;
+			delete squeezedDet;
+			delete squeezedHow;
+
+			if (parentBf != nullptr)
+				{
+				unfinishedBf->union_with(parentBf->get_bit_vector(0),0);
+				unfinishedBf->union_with(parentBf->get_bit_vector(1),1);
+				}
+
+			bvDet->filterInfo = DeterminedBriefFilter::notSqueezed;
+			bvHow->filterInfo = DeterminedBriefFilter::notSqueezed;
+			}
+			break;
+
+		default:
+			fatal ("error: " + bfFilename + " is a "
+			     + BloomFilter::filter_kind_to_string(unfinishedBf->kind(),false)
+			     + " filter; trees of that kind can't be modified");
+		}
+
+	return unfinishedBf;
+	}
+
+//----------
+//
+// adopt_unfinished--
+//	Install a reconstructed unfinished filter as the node's filter, so that
+//	construct_*_nodes() will finish it, rather than building the node's
+//	subtree.
+//
+//----------
+//
+// Arguments:
+//	BloomFilter*	unfinishedBf:	The node's filter, as returned by
+//									.. unfinished_filter(). We take ownership of
+//									.. this.
+//	u32				compressor:		The compressor that the tree was built with.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	construct_*_nodes() doesn't descend into a node that already has a
+//		filter. The node's parent reads this filter with load(), which does
+//		nothing for a resident filter, finishes it, and saves it. It is saved
+//		in place, to the node's current file.
+//	(2)	Union nodes are saved in their unfinished form, so for a union tree
+//		we install the node's saved filter instead; the parent reads it, and
+//		the file is not rewritten.
+//
+//----------
+
+void BloomTree::adopt_unfinished
+   (BloomFilter*	unfinishedBf,
+	u32				compressor)
+	{
+	if (bf != nullptr)
+		fatal ("internal error: unexpected non-null filter for " + bfFilename);
+
+	if (unfinishedBf->kind() == bfkind_simple)
+		bf = BloomFilter::bloom_filter(bfFilename);
+	else
+		{
+		bf = BloomFilter::bloom_filter(unfinishedBf,bfFilename);
+		for (int bvIx=0 ; bvIx<unfinishedBf->numBitVectors ; bvIx++)
+			{
+			BitVector* bv = unfinishedBf->get_bit_vector(bvIx);
+			bf->new_bits(bv,compressor,bvIx);
+			bf->get_bit_vector(bvIx)->filterInfo = bv->filterInfo;
+			bf->get_bit_vector(bvIx)->unfinished();
+			}
+		}
+
+	if (trackMemory)
+		cerr << "@-" << unfinishedBf << " discarding unfinished filter for " << bfFilename << endl;
+	delete unfinishedBf;
+	}
+
+//----------
+//
+// finish_parentless--
+//	Finish and save a node's adopted unfinished filter, when the node has no
+//	parent to do that for it.
+//
+//----------
+//
+// Arguments:
+//	(none)
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	This is for a node that was given a parent when the tree was built,
+//		but has since become a root (or a child of a dummy), e.g. because its
+//		only sibling was removed. construct_*_nodes() only finishes an adopted
+//		filter from the parent, so we apply the same finishing here that
+//		construct_*_nodes() applies to any other parentless node.
+//	(2)	The filter is left resident, so that a subsequent construct_*_nodes()
+//		treats the node as already built. Callers must do this *before*
+//		construct_*_nodes(), since a dummy parent discards its children's
+//		filters.
+//
+//----------
+
+void BloomTree::finish_parentless()
+	{
+	if ((parent != nullptr) and (not parent->is_dummy()))
+		fatal ("internal error: in finish_parentless(\"" + name + "\")"
+		     + ", the node has a parent");
+	if (bf == nullptr)
+		fatal ("internal error: in finish_parentless(\"" + name + "\")"
+		     + ", the node has no filter");
+
+	switch (bf->kind())
+		{
+		case bfkind_simple:
+			return;  // (union nodes are saved unfinished; the file is unchanged)
+
+		case bfkind_allsome:
+			break;
+
+		case bfkind_determined:
+			bf->intersect_with(bf->get_bit_vector(0),1);
+			break;
+
+		case bfkind_determined_brief:
+			bf->squeeze_by(bf->get_bit_vector(0),1);
+			bf->get_bit_vector(0)->filterInfo = DeterminedBriefFilter::squeezed;
+			bf->get_bit_vector(1)->filterInfo = DeterminedBriefFilter::squeezed;
+			break;
+
+		default:
+			fatal ("error: " + bfFilename + " is a "
+			     + BloomFilter::filter_kind_to_string(bf->kind(),false)
+			     + " filter; trees of that kind can't be modified");
+		}
+
+	bf->reportSave = reportSave;
+	save(/*finished*/ true);
+	}
+
+void BloomTree::replace_child
+   (BloomTree*	oldChild,
+	BloomTree*	newChild)
+	{
+	for (auto& child : children)
+		{
+		if (child != oldChild) continue;
+		child = newChild;
+		newChild->parent = this;
+		oldChild->parent = nullptr;
+		return;
+		}
+
+	fatal ("internal error: " + oldChild->name + " is not a child of " + name);
+	}
+
+void BloomTree::remove_child
+   (BloomTree*	offspring)
+	{
+	auto iter = std::find (children.begin(), children.end(), offspring);
+	if (iter == children.end())
+		fatal ("internal error: " + offspring->name + " is not a child of " + name);
+
+	children.erase(iter);
+	offspring->parent = nullptr;
+	if (children.empty()) isLeaf = true;
+	}
+
+//~~~~~~~~~~
+// query operations
+//~~~~~~~~~~
+
+void BloomTree::batch_query
+   (vector<Query*>	queries,
+	bool			isLeafOnly,
+	bool			distinctKmers,
+	bool			completeKmerCounts,
+    bool            adjustKmerCounts,
+	u32				numThreads,
+	bool			levelOrder)
+	{
+	// preload a root, and make sure that a leaf-only operation can work with
+	// the type of filter we have
+	//
+	// nota bene: batch_query may be running on several threads at once (each
+	//            with a different subset of the queries), so this and the
+	//            kmerization are serialized; the filter's hasher isn't
+	//            thread-safe
+
+	std::unique_lock<std::recursive_mutex> guard(loadLock);
+
+	BloomFilter* bf = real_filter();
+	if (bf == nullptr)
+		fatal ("internal error: batch_query() unable to locate any bloom filter");
+	bf->preload();
+
+	if ((isLeafOnly) && (bf->kind() != bfkind_simple))
+		fatal ("batch_query() can't work for trees made of "
+		     + BloomFilter::filter_kind_to_string(bf->kind(),false) + " filters");
+
+	// convert the queries to kmers/positions
+
+	for (auto& q : queries)
+		{
+		q->kmerize(bf,distinctKmers);
+		if (dbgSortKmerPositions) q->sort_kmer_positions();
+		if (dbgKmerPositions)     q->dump_kmer_positions();
+		}
+
+	guard.unlock();
 
 	// make a local copy of the query list (consisting of the same instances)
 	// while initializing each query's search details; we need a copy because
@@ -1288,74 +2207,294 @@ void BloomTree::batch_query
 			}
 		}
 
-	// perform the query
+	// perform the query
+
+	if (dbgTraversal)
+		dbgTraversalCounter = 0;
+
+	idleWorkers = (numThreads > 1)? (int) (numThreads-1) : 0;
+
+	if (prefetchFilters) start_prefetcher();
+
+	u64 activeQueries = localQueries.size();
+	if ((activeQueries > 0) and (levelOrder))
+		perform_level_batch_query(activeQueries,localQueries,completeKmerCounts);
+	else if (activeQueries > 0)
+		perform_batch_query(activeQueries,localQueries,completeKmerCounts);
+
+	if (prefetchFilters) stop_prefetcher();
+	}
+
+void BloomTree::perform_batch_query
+   (u64				activeQueries,
+	vector<Query*>	queries,
+	bool			completeKmerCounts)
+	{
+	u64				incomingQueries = activeQueries;
+	u64				qIx;
+
+	// skip through dummy nodes
+
+	if (isDummy)
+		{
+		if (dbgTraversal)
+			cerr << "(skipping through dummy node)" << endl;
+
+		perform_children_batch_query(activeQueries,queries,completeKmerCounts);
+		return;
+		}
+
+	// collect some stats
+
+	if (queryStats != nullptr)
+		{
+		for (qIx=0 ; qIx<incomingQueries ; qIx++)
+			{
+			Query* q = queries[qIx];
+			queryStats[q->batchIx].examined = true;
+			}
+		}
+
+	if (dbgTraversal)
+		cerr << "examining " << name << " (#" << (++dbgTraversalCounter) << ")" << endl;
+
+	// save query state
+
+	for (qIx=0 ; qIx<incomingQueries ; qIx++)
+		{
+		Query* q = queries[qIx];
+		q->numUnresolvedStack.emplace_back(q->numUnresolved);
+		q->numPassedStack.emplace_back(q->numPassed);
+		q->numFailedStack.emplace_back(q->numFailed);
+
+		if (dbgKmerPositionsByHash)
+			{
+			u64 kmerPositionsHash = q->kmer_positions_hash(q->numUnresolved);
+			q->dbgKmerPositionsHashStack.emplace_back(kmerPositionsHash);
+			}
+		}
+
+	// make sure this node's filter is resident
+
+	acquire_filter();
+
+	// operate on each query in the batch
+
+	activeQueries = examine_batch(activeQueries,queries,completeKmerCounts);
+
+	// unless we're going to adjust kmers/positions, we don't need this node's
+	// filter to be resident any more
+
+	bool isPositionAdjustor = bf->is_position_adjustor();
+	if (!isPositionAdjustor) release_filter();
+
+	// sanity check: if we're at a leaf, we should have resolved all queries
+
+	if ((isLeaf) and (activeQueries > 0))
+		{
+		cerr << "internal error: failed to resolve queries at leaf"
+			 << " \"" << bfFilename << "\"" << endl;
+		cerr << "unresolved queries:";
+		for (qIx=0 ; qIx<activeQueries ; qIx++)
+			{
+			Query* q = queries[qIx];
+			if (qIx == 0) cerr << " " << q->name;
+			         else cerr << ", " << q->name;
+			}
+		cerr << endl;
+		fatal ();
+		}
+
+	// adjust kmer/position lists as we move down the tree; for most node types
+	// this would be a null operation, but for nodes that use rank/select the
+	// position values are modified to reflect the removal of inactive bits in
+	// the bloom filters
+
+	if (isPositionAdjustor)
+		{
+		for (qIx=0 ; qIx<activeQueries ; qIx++)
+			{
+			Query* q = queries[qIx];
+			bf->adjust_positions_in_list(q->kmerPositions,q->numUnresolved);
+
+			if (dbgKmerPositions)
+				{
+				cerr << "positions after r/s adjusting " << name << ":";
+				q->dump_kmer_positions(q->numUnresolved);
+				}
+			}
+		}
+
+	// pass whatever queries remain down to the subtrees; the first child will
+	// be visited next, so we can ask for its filter to be loaded ahead of
+	// time (perform_children_batch_query asks for each later child's filter
+	// as it begins the child before it)
+
+	if ((activeQueries > 0) and (prefetchFilters) and (not children.empty()))
+		children[0]->request_prefetch();
+
+	if (activeQueries > 0)
+		perform_children_batch_query(activeQueries,queries,completeKmerCounts);
+
+	// restore kmer/position lists as we move up the tree
+
+	if (isPositionAdjustor)
+		{
+		for (qIx=0 ; qIx<activeQueries ; qIx++)
+			{
+			Query* q = queries[qIx];
+			bf->restore_positions_in_list(q->kmerPositions,q->numUnresolved);
+
+			if (dbgKmerPositions)
+				{
+				cerr << "positions after r/s restoring " << name << ":";
+				q->dump_kmer_positions(q->numUnresolved);
+				}
+			}
+		}
+
+	// if we were adjusting kmers/positions, we finally don't need this node's
+	// filter to be resident any more
+
+	if (isPositionAdjustor) release_filter();
+
+	// restore query state
+
+	for (qIx=0 ; qIx<incomingQueries ; qIx++)
+		{
+		Query* q = queries[qIx];
+		q->numUnresolved = q->numUnresolvedStack.back();
+		q->numUnresolvedStack.pop_back();
+
+		q->numPassed = q->numPassedStack.back();
+		q->numPassedStack.pop_back();
+
+		q->numFailed = q->numFailedStack.back();
+		q->numFailedStack.pop_back();
+
+		u64 dbgKmerPositionsHash = 0;
+		if (dbgKmerPositionsByHash)
+			{
+			dbgKmerPositionsHash = q->dbgKmerPositionsHashStack.back();
+			q->dbgKmerPositionsHashStack.pop_back();
+			}
+
+		if (dbgKmerPositions || dbgKmerPositionsByHash)
+			{
+			cerr << "positions restored to pre-" << name << " state";
+			if (!dbgKmerPositions)
+				cerr << " for " << q->name;
+			if (dbgKmerPositionsByHash)
+				{
+				u64 kmerPositionsHash = q->kmer_positions_hash(q->numUnresolved);
+				cerr << " (H=" << kmerPositionsHash << ")";
+				if (kmerPositionsHash != dbgKmerPositionsHash)
+					cerr << " BAD (expected " << dbgKmerPositionsHash << ")";
+				}
+			cerr << ":" << endl;
+			if (dbgKmerPositions)
+				q->dump_kmer_positions(q->numUnresolved);
+			}
+		}
+
+	}
 
-	if (dbgTraversal)
-		dbgTraversalCounter = 0;
+//----------
+//
+// examine_batch--
+//	Look up the unresolved kmers of each active query in this node's filter,
+//	deciding which queries pass or fail at this node.
+//
+//----------
+//
+// Arguments:
+//	u64				activeQueries:		The number of queries (at the start of
+//										.. the queries list) that are still
+//										.. unresolved.
+//	vector<Query*>&	queries:			The query list. Queries that are
+//										.. resolved at this node are moved to
+//										.. the end of the active part of the
+//										.. list.
+//	bool			completeKmerCounts:	(same as for perform_batch_query)
+//
+// Returns:
+//	The number of queries that are still unresolved; these are at the start
+//	of the queries list.
+//
+//----------
+//
+// Notes:
+//	(1)	The caller is responsible for making sure the node's filter is
+//		resident.
+//	(2)	If mergeLookups is set, the unresolved positions of all the active
+//		queries are first collected into a single sorted list, without
+//		duplicates, and each is looked up once, in increasing order. This
+//		gives sequential access to the filter's bit vector (and to its RRR
+//		blocks, if it is compressed), and avoids repeating a lookup for a kmer
+//		that many queries share. The per-query loop then takes each
+//		resolution from that list instead of from the filter.
+//		  The price is that positions a query would never have reached (had
+//		it passed or failed early) are looked up anyway, so this only pays off
+//		for large batches.
+//	(3)	Otherwise, each query's positions are looked up in chunks of
+//		lookupChunkSize, with BloomFilter::lookup_many(). This replaces the
+//		per-position virtual calls (filter lookup and bit vector access) with
+//		a few per chunk, and lets the bit vector prefetch ahead. A query that
+//		passes or fails early wastes at most one chunk's worth of lookups.
+//
+//----------
 
-	u64 activeQueries = localQueries.size();
-	if (activeQueries > 0)
-		perform_batch_query(activeQueries,localQueries,completeKmerCounts);
-	}
+static const u64 lookupChunkSize = 64;  // (positions)
 
-void BloomTree::perform_batch_query
+u64 BloomTree::examine_batch
    (u64				activeQueries,
-	vector<Query*>	queries,
+	vector<Query*>&	queries,
 	bool			completeKmerCounts)
 	{
-	u64				incomingQueries = activeQueries;
 	u64				qIx;
 
-	// skip through dummy nodes
-
-	if (isDummy)
-		{
-		if (dbgTraversal)
-			cerr << "(skipping through dummy node)" << endl;
-
-		for (const auto& child : children)
-			child->perform_batch_query(activeQueries,queries,completeKmerCounts);
-		return;
-		}
+	// if we're merging lookups, look up each distinct unresolved position
+	// once, in increasing order
 
-	// collect some stats
+	vector<u64>			probePositions;
+	vector<signed char>	probeResolutions;
+	bool				useProbeList = (mergeLookups) and (activeQueries > 1);
+	std::int8_t			chunkResolutions[lookupChunkSize];
 
-	if (queryStats != nullptr)
+	if (useProbeList)
 		{
-		for (qIx=0 ; qIx<incomingQueries ; qIx++)
+		u64 numProbes = 0;
+		for (qIx=0 ; qIx<activeQueries ; qIx++)
+			numProbes += queries[qIx]->numUnresolved;
+
+		probePositions.reserve(numProbes);
+		for (qIx=0 ; qIx<activeQueries ; qIx++)
 			{
 			Query* q = queries[qIx];
-			queryStats[q->batchIx].examined = true;
+			probePositions.insert(probePositions.end(),
+			                      q->kmerPositions.begin(),
+			                      q->kmerPositions.begin()+q->numUnresolved);
 			}
-		}
 
-	if (dbgTraversal)
-		cerr << "examining " << name << " (#" << (++dbgTraversalCounter) << ")" << endl;
-
-	// save query state
+		std::sort(probePositions.begin(),probePositions.end());
+		auto probeEnd = std::unique(probePositions.begin(),probePositions.end());
+		probePositions.erase(probeEnd,probePositions.end());
 
-	for (qIx=0 ; qIx<incomingQueries ; qIx++)
-		{
-		Query* q = queries[qIx];
-		q->numUnresolvedStack.emplace_back(q->numUnresolved);
-		q->numPassedStack.emplace_back(q->numPassed);
-		q->numFailedStack.emplace_back(q->numFailed);
+		// nota bene: this has to agree with BloomTree::lookup(), which treats
+		//            an unresolved position in a leaf as present
 
-		if (dbgKmerPositionsByHash)
+		probeResolutions.resize(probePositions.size());
+		bf->lookup_many(probePositions.data(),probePositions.size(),probeResolutions.data());
+		if (isLeaf)
 			{
-			u64 kmerPositionsHash = q->kmer_positions_hash(q->numUnresolved);
-			q->dbgKmerPositionsHashStack.emplace_back(kmerPositionsHash);
+			for (auto& resolution : probeResolutions)
+				{
+				if (resolution == BloomFilter::unresolved)
+					resolution = BloomFilter::present;
+				}
 			}
 		}
 
-	// make sure this node's filter is resident
-
-	load();
-
-	// operate on each query in the batch
-	//……… ideally, we'd like to perform this for all siblings, then unload the
-	//……… .. siblings, before we descend to the siblings' children
-
 	qIx = 0;
 	while (qIx < activeQueries)
 		{ // note that activeQueries may change during this loop
@@ -1375,67 +2514,106 @@ void BloomTree::perform_batch_query
 				     << "; U+P+F = " << q->numUnresolved << "+" << q->numPassed << "+" << q->numFailed << " != " << q->numPositions << endl;
 			}
 
+		// look up the query's unresolved positions a chunk at a time, with
+		// one call to the filter's lookup_many() per chunk; the chunks are
+		// small so that we don't do much wasted work if the query passes or
+		// fails early
+		//
+		// in a non-leaf, resolved positions are moved toward the end of the
+		// list and the unresolved ones are kept at the front (in their
+		// original order); positions before keepIx are the unresolved ones
+		// we've seen so far, and those from keepIx to posIx are resolved
+		//
+		// Attribution: the technique of moving resolved positions to the end
+		// of the list was inspired by reference [1]
+
 		u64 positionsToTest = q->numUnresolved;
-		u64 posIx = 0;
-		while (posIx < positionsToTest)
+		u64 keepIx = 0;
+		u64 posIx  = 0;
+		while ((posIx < positionsToTest) and (not queryPasses) and (not queryFails))
 			{
-			// each pass through this loop either increases posIx OR decreases
-			// positionsToTest
-			//
-			// Attribution: the technique of swapping resolved positions to the
-			// end of the list was inspired by reference [1]
-
-			u64 pos = q->kmerPositions[posIx];
-			bool posIsResolved = true;
-			int resolution = lookup(pos);
-
-			if (resolution == BloomFilter::absent)
-				{
-				if (dbgLookups)
-					cerr << "  " << q->name << ".lookup(" << bfFilename << "," << pos << ")"
-					     << " fail=" << (q->numFailed+1) << endl;
-				if (++q->numFailed >= q->neededToFail)
-					{ queryFails = true;  break; }
-				}
-			else if (resolution == BloomFilter::present)
+			u64 chunkSize = std::min(positionsToTest-posIx,lookupChunkSize);
+			if (useProbeList)
 				{
-				// if we're NOT computing complete kmer counts, we can check
-				// whether we've observed enough hits to pass this node early
-
-				if (dbgLookups)
-					cerr << "  " << q->name << ".lookup(" << bfFilename << "," << pos << ")"
-					     << " pass=" << (q->numPassed+1) << endl;
-				q->numPassed++;
-				if ((not completeKmerCounts) and (q->numPassed >= q->neededToPass))
-					{ queryPasses = true;  break; }
+				for (u64 chunkIx=0 ; chunkIx<chunkSize ; chunkIx++)
+					{
+					u64 pos = q->kmerPositions[posIx+chunkIx];
+					auto probe = std::lower_bound(probePositions.begin(),probePositions.end(),pos);
+					chunkResolutions[chunkIx] = probeResolutions[probe-probePositions.begin()];
+					}
 				}
-			else // if (resolution == BloomFilter::unresolved)
+			else
 				{
-				if (dbgLookups)
-					cerr << "  " << q->name << ".lookup(" << bfFilename << "," << pos << ")"
-					     << " unres" << endl;
-				posIsResolved = false;
+				// nota bene: this has to agree with BloomTree::lookup()
+				bf->lookup_many(&q->kmerPositions[posIx],chunkSize,chunkResolutions);
+				if (isLeaf)
+					{
+					for (u64 chunkIx=0 ; chunkIx<chunkSize ; chunkIx++)
+						{
+						if (chunkResolutions[chunkIx] == BloomFilter::unresolved)
+							chunkResolutions[chunkIx] = BloomFilter::present;
+						}
+					}
 				}
 
-			// if pos is resolved, swap it with the end of list, and shorten
-			// the list; note that we *don't* increase posIx in this case, as
-			// the next iteration needs to process the position we just swapped
-			// into that slot
-
-			if ((posIsResolved) and (not isLeaf))
+			for (u64 chunkIx=0 ; chunkIx<chunkSize ; chunkIx++)
 				{
-				positionsToTest--;
-				q->kmerPositions[posIx] = q->kmerPositions[positionsToTest];
-				q->kmerPositions[positionsToTest] = pos;
-				}
+				u64 pos = q->kmerPositions[posIx];
+				int resolution = chunkResolutions[chunkIx];
+
+				if (resolution == BloomFilter::absent)
+					{
+					if (dbgLookups)
+						cerr << "  " << q->name << ".lookup(" << bfFilename << "," << pos << ")"
+						     << " fail=" << (q->numFailed+1) << endl;
+					if (++q->numFailed >= q->neededToFail)
+						{ queryFails = true;  break; }
+					}
+				else if (resolution == BloomFilter::present)
+					{
+					// if we're NOT computing complete kmer counts, we can
+					// check whether we've observed enough hits to pass this
+					// node early
+
+					if (dbgLookups)
+						cerr << "  " << q->name << ".lookup(" << bfFilename << "," << pos << ")"
+						     << " pass=" << (q->numPassed+1) << endl;
+					q->numPassed++;
+					if ((not completeKmerCounts) and (q->numPassed >= q->neededToPass))
+						{ queryPasses = true;  break; }
+					}
+				else // if (resolution == BloomFilter::unresolved)
+					{
+					if (dbgLookups)
+						cerr << "  " << q->name << ".lookup(" << bfFilename << "," << pos << ")"
+						     << " unres" << endl;
+
+					// keep the unresolved pos at the front of the list, by
+					// swapping it with the first resolved position
+
+					if ((not isLeaf) and (keepIx != posIx))
+						{
+						q->kmerPositions[posIx]  = q->kmerPositions[keepIx];
+						q->kmerPositions[keepIx] = pos;
+						}
+					keepIx++;
+					}
 
-			// otherwise, move on to the next pos
-
-			else
 				posIx++;
+				}
 			}
 
-		q->numUnresolved = positionsToTest;
+		// nota bene: if the query passed or failed early, the positions we
+		//            didn't get to are still counted as unresolved, but the
+		//            list is no longer partitioned; that's harmless, since
+		//            the query won't proceed any further down this subtree
+
+		if (isLeaf)
+			q->numUnresolved = positionsToTest;
+		else if ((queryPasses) or (queryFails))
+			q->numUnresolved = keepIx + (positionsToTest - posIx);
+		else
+			q->numUnresolved = keepIx;
 
 		if (dbgLookups)
 			{
@@ -1455,9 +2633,14 @@ void BloomTree::perform_batch_query
 				cerr << " for " << q->name;
 			if (dbgKmerPositionsByHash)
 				{
+				// (level-order searches don't keep the stack, so there may be
+				// no before-hash to report)
 				u64 kmerPositionsHash = q->kmer_positions_hash(q->numUnresolved);
-				cerr << " (H.before=" << q->dbgKmerPositionsHashStack.back()
-				     <<  " H.after="  << kmerPositionsHash << ")";
+				if (q->dbgKmerPositionsHashStack.empty())
+					cerr << " (H.after=" << kmerPositionsHash << ")";
+				else
+					cerr << " (H.before=" << q->dbgKmerPositionsHashStack.back()
+					     <<  " H.after="  << kmerPositionsHash << ")";
 				}
 			cerr << ":" << endl;
 			if (dbgKmerPositions)
@@ -1515,118 +2698,314 @@ void BloomTree::perform_batch_query
 			}
 		}
 
-	// unless we're going to adjust kmers/positions, we don't need this node's
-	// filter to be resident any more
+	return activeQueries;
+	}
 
-	bool isPositionAdjustor = bf->is_position_adjustor();
-	if (!isPositionAdjustor) unloadable();
+//----------
+//
+// perform_level_batch_query--
+//	Search the tree for a batch of queries in level order (breadth-first),
+//	rather than depth-first.
+//
+//----------
+//
+// Arguments:
+//	u64				activeQueries:		The number of queries (at the start of
+//										.. the queries list) to search for.
+//	vector<Query*>&	queries:			The query list.
+//	bool			completeKmerCounts:	(same as for perform_batch_query)
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	All the (node, active queries) pairs at one depth are processed
+//		before any at the next depth. Within a level the nodes are visited
+//		grouped by filename (stably, so otherwise left-to-right), so that
+//		nodes sharing a file (e.g. siblings combined by combinebf) are loaded
+//		one after another while that file is open, and each filter is
+//		unloaded before we move on. On storage where seeks are expensive,
+//		this turns the depth-first search's scattered reads into a sweep
+//		through each level.
+//	(2)	A query may be active at several nodes in one level, each with a
+//		different kmerPositions arrangement and different counts; so every
+//		(node, query) pair gets its own worker copy of the query. This costs
+//		more memory than the depth-first search, in proportion to the width
+//		of the search.
+//	(3)	For position adjustors, a node's adjusted positions are carried into
+//		its children's copies, so there's nothing to restore.
+//	(4)	Each worker copy's matches and stats are merged back into the
+//		original query in pre-order of the nodes, so the matches appear in
+//		the same order as they would in the depth-first search.
+//
+//----------
 
-	// sanity check: if we're at a leaf, we should have resolved all queries
+struct levelwork
+	{
+	BloomTree*		node;
+	vector<Query*>	queries;		// worker copies, one per active query
+	};
 
-	if ((isLeaf) and (activeQueries > 0))
+void BloomTree::perform_level_batch_query
+   (u64				activeQueries,
+	vector<Query*>&	queries,
+	bool			completeKmerCounts)
+	{
+	u64				qIx;
+
+	// rank the nodes in pre-order, for merging the matches (see note 4)
+
+	vector<BloomTree*> preOrder;
+	pre_order(preOrder);
+	std::unordered_map<BloomTree*,u64> nodeRank;
+	for (u64 rank=0 ; rank<preOrder.size() ; rank++)
+		nodeRank[preOrder[rank]] = rank;
+
+	std::unordered_map<Query*,Query*> originalQuery;  // worker copy -> query
+	vector<tuple<u64,Query*,Query*>>  finished;       // (rank, query, copy)
+
+	// start the search at this node
+
+	vector<levelwork> level(1);
+	level[0].node = this;
+	for (qIx=0 ; qIx<activeQueries ; qIx++)
 		{
-		cerr << "internal error: failed to resolve queries at leaf"
-			 << " \"" << bfFilename << "\"" << endl;
-		cerr << "unresolved queries:";
-		for (qIx=0 ; qIx<activeQueries ; qIx++)
-			{
-			Query* q = queries[qIx];
-			if (qIx == 0) cerr << " " << q->name;
-			         else cerr << ", " << q->name;
-			}
-		cerr << endl;
-		fatal ();
+		Query* wq = queries[qIx]->worker_copy();
+		originalQuery[wq] = queries[qIx];
+		level[0].queries.emplace_back(wq);
 		}
 
-	// adjust kmer/position lists as we move down the tree; for most node types
-	// this would be a null operation, but for nodes that use rank/select the
-	// position values are modified to reflect the removal of inactive bits in
-	// the bloom filters
-
-	if (isPositionAdjustor)
+	while (not level.empty())
 		{
-		for (qIx=0 ; qIx<activeQueries ; qIx++)
+		std::stable_sort(level.begin(),level.end(),
+		                 [](const levelwork& a, const levelwork& b)
+		                   { return a.node->bfFilename < b.node->bfFilename; });
+
+		vector<levelwork> nextLevel;
+		for (size_t workIx=0 ; workIx<level.size() ; workIx++)
 			{
-			Query* q = queries[qIx];
-			bf->adjust_positions_in_list(q->kmerPositions,q->numUnresolved);
+			levelwork& work = level[workIx];
+			BloomTree* node = work.node;
+			u64 nodeActive = work.queries.size();
 
-			if (dbgKmerPositions)
+			if ((prefetchFilters) and (workIx+1 < level.size()))
+				level[workIx+1].node->request_prefetch();
+
+			// examine the node; dummy nodes just pass their queries through
+			// to their children
+
+			if (not node->isDummy)
 				{
-				cerr << "positions after r/s adjusting " << name << ":";
-				q->dump_kmer_positions(q->numUnresolved);
+				if (node->queryStats != nullptr)
+					{
+					for (const auto& wq : work.queries)
+						node->queryStats[wq->batchIx].examined = true;
+					}
+
+				if (dbgTraversal)
+					cerr << "examining " << node->name << " (#" << (++dbgTraversalCounter) << ")" << endl;
+
+				node->acquire_filter();
+				nodeActive = node->examine_batch(nodeActive,work.queries,completeKmerCounts);
+
+				if ((node->isLeaf) and (nodeActive > 0))
+					{
+					cerr << "internal error: failed to resolve queries at leaf"
+						 << " \"" << node->bfFilename << "\"" << endl;
+					fatal ();
+					}
+
+				if (node->bf->is_position_adjustor())
+					{
+					for (qIx=0 ; qIx<nodeActive ; qIx++)
+						{
+						Query* wq = work.queries[qIx];
+						node->bf->adjust_positions_in_list(wq->kmerPositions,wq->numUnresolved);
+						}
+					}
+
+				node->release_filter();
+				}
+
+			// give each child its own copy of the queries that are still
+			// active
+
+			for (const auto& child : node->children)
+				{
+				if (nodeActive == 0) break;
+				nextLevel.emplace_back();
+				levelwork& childWork = nextLevel.back();
+				childWork.node = child;
+				for (qIx=0 ; qIx<nodeActive ; qIx++)
+					{
+					Query* wq = work.queries[qIx]->worker_copy();
+					originalQuery[wq] = originalQuery[work.queries[qIx]];
+					childWork.queries.emplace_back(wq);
+					}
+				}
+
+			// this node is finished with its copies; we hold on to them (less
+			// their kmers) until we merge them
+
+			for (const auto& wq : work.queries)
+				{
+				vector<u64>().swap(wq->kmerPositions);
+				finished.emplace_back(nodeRank[node],originalQuery[wq],wq);
 				}
 			}
+
+		level.swap(nextLevel);
 		}
 
-	// pass whatever queries remain down to the subtrees
+	// merge the copies' results into the queries, in pre-order
 
-	if (activeQueries > 0)
+	std::stable_sort(finished.begin(),finished.end(),
+	                 [](const tuple<u64,Query*,Query*>& a, const tuple<u64,Query*,Query*>& b)
+	                   { return std::get<0>(a) < std::get<0>(b); });
+
+	for (const auto& item : finished)
 		{
-		for (const auto& child : children)
-			child->perform_batch_query(activeQueries,queries,completeKmerCounts);
+		Query* q  = std::get<1>(item);
+		Query* wq = std::get<2>(item);
+		q->absorb_worker_copy(wq);
+		delete wq;
 		}
+	}
 
-	// restore kmer/position lists as we move up the tree
+//----------
+//
+// perform_children_batch_query--
+//	Pass a batch of queries down to each of this node's subtrees, handing
+//	subtrees to idle worker threads when there are any.
+//
+//----------
+//
+// Arguments:
+//	u64				activeQueries:		The number of queries (at the start of
+//										.. the queries list) that are still
+//										.. unresolved.
+//	vector<Query*>&	queries:			The query list.
+//	bool			completeKmerCounts:	(same as for perform_batch_query)
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	The query state (kmerPositions order, and the numUnresolved/numPassed/
+//		numFailed stacks) is modified as a subtree is searched, so subtrees
+//		can't be searched concurrently with the same Query objects. Each
+//		subtree other than the first is given its own worker copy of the
+//		active queries; the first subtree uses the original queries.
+//	(2)	The worker copies' matches are merged back into the original queries
+//		in child order, so the matches appear in the same order as they would
+//		with a single thread. Copies have to be made before any subtree is
+//		searched, since the search reorders each query's kmerPositions.
+//	(3)	Workers are started only when one is idle; subtrees that don't get a
+//		worker are searched by the current thread (using their copies), after
+//		the first subtree. A worker that finishes its subtree becomes idle
+//		again, and can pick up a subtree anywhere else in the tree.
+//
+//----------
 
-	if (isPositionAdjustor)
+void BloomTree::perform_children_batch_query
+   (u64				activeQueries,
+	vector<Query*>&	queries,
+	bool			completeKmerCounts)
+	{
+	size_t			numChildren = children.size();
+	size_t			childIx;
+	u64				qIx;
+
+	// if no worker is available, just search the subtrees one after another;
+	// nota bene: we only prefetch the next sibling's filter, rather than all
+	// of them, since a prefetched filter stays resident until its node is
+	// visited; this way the prefetcher holds at most one filter per level
+
+	if ((numChildren < 2) or (not claim_worker()))
 		{
-		for (qIx=0 ; qIx<activeQueries ; qIx++)
+		for (childIx=0 ; childIx<numChildren ; childIx++)
 			{
-			Query* q = queries[qIx];
-			bf->restore_positions_in_list(q->kmerPositions,q->numUnresolved);
-
-			if (dbgKmerPositions)
-				{
-				cerr << "positions after r/s restoring " << name << ":";
-				q->dump_kmer_positions(q->numUnresolved);
-				}
+			if ((prefetchFilters) and (childIx+1 < numChildren))
+				children[childIx+1]->request_prefetch();
+			children[childIx]->perform_batch_query(activeQueries,queries,completeKmerCounts);
 			}
+		return;
 		}
 
-	// if we were adjusting kmers/positions, we finally don't need this node's
-	// filter to be resident any more
+	// give each child after the first a copy of the active queries, and start
+	// a worker for as many of those children as we can
 
-	if (isPositionAdjustor) unloadable();
+	vector<vector<Query*>> childQueries(numChildren);
+	vector<std::thread>    workers;
+	vector<size_t>         inlineChildren;
+	bool                   haveWorker = true;  // (we claimed one above)
 
-	// restore query state
+	for (childIx=1 ; childIx<numChildren ; childIx++)
+		{
+		for (qIx=0 ; qIx<activeQueries ; qIx++)
+			childQueries[childIx].emplace_back(queries[qIx]->worker_copy());
 
-	for (qIx=0 ; qIx<incomingQueries ; qIx++)
+		if (not haveWorker) haveWorker = claim_worker();
+		if (not haveWorker)
+			{ inlineChildren.emplace_back(childIx);  continue; }
+
+		BloomTree*      child    = children[childIx];
+		vector<Query*>* wQueries = &childQueries[childIx];
+		workers.emplace_back([child,activeQueries,wQueries,completeKmerCounts]()
+			{
+			child->perform_batch_query(activeQueries,*wQueries,completeKmerCounts);
+			release_worker();
+			});
+		haveWorker = false;
+		}
+
+	// search the remaining subtrees in this thread, then wait for the workers
+
+	if ((prefetchFilters) and (not inlineChildren.empty()))
+		children[inlineChildren[0]]->request_prefetch();
+	children[0]->perform_batch_query(activeQueries,queries,completeKmerCounts);
+	for (size_t inlineIx=0 ; inlineIx<inlineChildren.size() ; inlineIx++)
 		{
-		Query* q = queries[qIx];
-		q->numUnresolved = q->numUnresolvedStack.back();
-		q->numUnresolvedStack.pop_back();
+		if ((prefetchFilters) and (inlineIx+1 < inlineChildren.size()))
+			children[inlineChildren[inlineIx+1]]->request_prefetch();
+		size_t ix = inlineChildren[inlineIx];
+		children[ix]->perform_batch_query(activeQueries,childQueries[ix],completeKmerCounts);
+		}
 
-		q->numPassed = q->numPassedStack.back();
-		q->numPassedStack.pop_back();
+	for (auto& worker : workers)
+		worker.join();
 
-		q->numFailed = q->numFailedStack.back();
-		q->numFailedStack.pop_back();
+	// merge the copies' results into the original queries, in child order
 
-		u64 dbgKmerPositionsHash = 0;
-		if (dbgKmerPositionsByHash)
+	for (childIx=1 ; childIx<numChildren ; childIx++)
+		{
+		for (qIx=0 ; qIx<activeQueries ; qIx++)
 			{
-			dbgKmerPositionsHash = q->dbgKmerPositionsHashStack.back();
-			q->dbgKmerPositionsHashStack.pop_back();
+			Query* wq = childQueries[childIx][qIx];
+			queries[qIx]->absorb_worker_copy(wq);
+			delete wq;
 			}
+		}
+	}
 
-		if (dbgKmerPositions || dbgKmerPositionsByHash)
-			{
-			cerr << "positions restored to pre-" << name << " state";
-			if (!dbgKmerPositions)
-				cerr << " for " << q->name;
-			if (dbgKmerPositionsByHash)
-				{
-				u64 kmerPositionsHash = q->kmer_positions_hash(q->numUnresolved);
-				cerr << " (H=" << kmerPositionsHash << ")";
-				if (kmerPositionsHash != dbgKmerPositionsHash)
-					cerr << " BAD (expected " << dbgKmerPositionsHash << ")";
-				}
-			cerr << ":" << endl;
-			if (dbgKmerPositions)
-				q->dump_kmer_positions(q->numUnresolved);
-			}
+bool BloomTree::claim_worker()
+	{
+	int idle = idleWorkers;
+	while (idle > 0)
+		{ // (on failure, compare_exchange_weak reloads idle)
+		if (idleWorkers.compare_exchange_weak(idle,idle-1))
+			return true;
 		}
+	return false;
+	}
 
+void BloomTree::release_worker()
+	{
+	idleWorkers++;
 	}
 
 void BloomTree::query_matches_leaves
@@ -1643,6 +3022,7 @@ void BloomTree::query_matches_leaves
 		q->matchesNumPassed.emplace_back (q->numPassed);
 		if (q->adjustKmerCounts)
 			{
+			std::unique_lock<std::recursive_mutex> guard(loadLock);
 			if (not fpRateKnown)
 				{
 				if (not bf->setSizeKnown)
@@ -1652,6 +3032,7 @@ void BloomTree::query_matches_leaves
 				fpRate = BloomFilter::false_positive_rate(bf->numHashes,bf->numBits,numItems);
 				fpRateKnown = true;
 				}
+			guard.unlock();
 
 			u64 querySize = q->numPositions;
 			u64 bfHits    = q->numPassed;
@@ -1759,15 +3140,25 @@ void BloomTree::perform_batch_count_kmer_hits
 
 	// operate on each query in the batch
 
+	vector<std::int8_t> resolutions;
+
 	for (auto& q : queries)
 		{
 		q->nodesExamined++;
 		q->numPassed = q->numFailed = 0;
 
+		// look up all the query's positions together; as in lookup(), an
+		// unresolved position in a leaf counts as present
+
+		resolutions.resize(q->kmerPositions.size());
+		bf->lookup_many(q->kmerPositions.data(),q->kmerPositions.size(),resolutions.data());
+
 		for (u64 posIx=0 ; posIx<q->kmerPositions.size() ; posIx++)
 			{
 			u64 pos = q->kmerPositions[posIx];
-			int resolution = lookup(pos);
+			int resolution = resolutions[posIx];
+			if (resolution == BloomFilter::unresolved)
+				resolution = BloomFilter::present;
 
 			if (resolution == BloomFilter::absent)
 				{
@@ -1960,6 +3351,9 @@ bool BloomTree::report_query_stats  // returns true if anything was reported
 //	(7)	Upon completion, the tree contains *only* BloomTree nodes, none of the
 //		underlying bloom filters are loaded; in fact, the underlying bloom
 //		filter files are not read, and need not even exist.
+//	(8)	The file may instead be a packed tree file (see packed_tree_file.h),
+//		in which case the topology is read from within it, and every node's
+//		filename is the packed file itself.
 //
 //----------
 
@@ -2033,7 +3427,7 @@ BloomTree* BloomTree::read_topology
    (const string&	filename,
 	bool			onlyLeaves)
 	{
-	std::ifstream in (filename);
+	std::ifstream in (filename, std::ios::binary|std::ios::in);
 	if (not in)
 		fatal ("error: failed to open \"" + filename + "\"");
 
@@ -2044,6 +3438,42 @@ BloomTree* BloomTree::read_topology
 	if (slashIx != string::npos)
 		basePath = filename.substr(0,slashIx+1);
 
+	// if this is a packed tree file, read the embedded topology; otherwise
+	// the file *is* the topology
+
+	bool isPacked = false;
+	std::istringstream packedTopology;
+
+	packedtreeheader packHeader;
+	in.read ((char*) &packHeader, sizeof(packHeader));
+	if ((in.gcount() == sizeof(packHeader))
+	 && ((packHeader.magic == packedtreeheaderMagic)
+	  || (packHeader.magic == packedtreeheaderMagicUn)))
+		{
+		if (packHeader.magic == packedtreeheaderMagicUn)
+			fatal ("error: \"" + filename + "\" looks like an incomplete packed tree file"
+			       " (it seems the file was not completely written)");
+		if (packHeader.version != packedtreeheaderVersion)
+			fatal ("error: packed tree file version " + std::to_string(packHeader.version)
+			     + " is not supported by this program (\"" + filename + "\")");
+
+		string topology(packHeader.topologyBytes,'\0');
+		in.seekg (packHeader.topologyOffset, in.beg);
+		in.read (&topology[0], packHeader.topologyBytes);
+		if ((u64) in.gcount() != packHeader.topologyBytes)
+			fatal ("error: problem reading topology from \"" + filename + "\"");
+		packedTopology.str(topology);
+		isPacked = true;
+		}
+	else
+		{
+		in.clear();
+		in.seekg (0, in.beg);
+		}
+
+	std::istream& topoIn = (isPacked)? (std::istream&) packedTopology
+	                                 : (std::istream&) in;
+
 	// create a dummy, filterless, node for the root, whose children will
 	// comprise a forest; if the root ends up with a single child, we'll use
 	// that child as the root instead
@@ -2062,7 +3492,7 @@ BloomTree* BloomTree::read_topology
 
 		string line;
 		int lineNum = 0;
-		while (std::getline (in, line))
+		while (std::getline (topoIn, line))
 			{
 			lineNum++;
 			line = strip_blank_ends (line);
@@ -2072,6 +3502,7 @@ BloomTree* BloomTree::read_topology
 			if (p.hasProblem)
 				fatal ("error: unable to parse (\"" + filename
 					 + "\", line " + std::to_string(lineNum) + ")");
+			if (isPacked) p.bfFilename = filename;
 
 			numNodes++;
 			BloomTree* node = new BloomTree(p.name,p.bfFilename);
@@ -2106,7 +3537,7 @@ BloomTree* BloomTree::read_topology
 
 		string line;
 		int lineNum = 0;
-		while (std::getline (in, line))
+		while (std::getline (topoIn, line))
 			{
 			lineNum++;
 			line = strip_blank_ends (line);
@@ -2116,6 +3547,7 @@ BloomTree* BloomTree::read_topology
 			if (p.hasProblem)
 				fatal ("error: unable to parse (\"" + filename
 					 + "\", line " + std::to_string(lineNum) + ")");
+			if (isPacked) p.bfFilename = filename;
 
 			numNodes++;
 			if ((numNodes == 0) and (p.level != 0))
@@ -2166,7 +3598,8 @@ BloomTree* BloomTree::read_topology
 		delete oldRoot;
 		}
 
-	root->nodesShareFiles = nodesShareFiles;
+	root->nodesShareFiles = nodesShareFiles or isPacked;
+	if (isPacked) root->packFilename = filename;
 	return root;
 	}
 
@@ -3,7 +3,13 @@
 
 #include <string>
 #include <vector>
+#include <list>
+#include <deque>
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 #include "bloom_filter.h"
 #include "query.h"
@@ -45,12 +51,30 @@ public:
 
 	virtual void preload();
 	virtual void load();
+	virtual void check_consistency();
 	virtual void save(bool finished=true);
+	virtual void hold_or_save(bool finished=true);
 	virtual void unloadable();
+	virtual void acquire_filter();
+	virtual void release_filter();
+private:
+	virtual void cache_filter();
+	virtual void uncache_filter();
+	virtual std::uint64_t filter_bytes();
+	static void evict_filters();
+public:
+	virtual void request_prefetch();
+	static void start_prefetcher();
+	static void stop_prefetcher();
+private:
+	static void prefetcher_main();
+public:
 
 	virtual void relay_debug_settings();
 
 	virtual void add_child(BloomTree* offspring);
+	virtual void replace_child(BloomTree* oldChild, BloomTree* newChild);
+	virtual void remove_child(BloomTree* offspring);
 	virtual void disown_children();
 	virtual size_t num_children() { return children.size(); }
 	virtual bool is_dummy() const { return isDummy; }
@@ -68,14 +92,38 @@ public:
 	virtual void construct_determined_nodes (std::uint32_t compressor);
 	virtual void construct_determined_brief_nodes (std::uint32_t compressor);
 	virtual void construct_intersection_nodes (std::uint32_t compressor);
+	virtual void construct_nodes (std::uint32_t bfKind, std::uint32_t compressor);
+private:
+	virtual void construct_children (std::uint32_t compressor,
+	                                 void (BloomTree::*construct)(std::uint32_t));
+public:
+
+	virtual void identify_build (std::uint32_t& bfKind, std::uint32_t& compressor);
+	virtual BloomFilter* unfinished_filter (const BloomFilter* parentBf);
+	virtual void adopt_unfinished (BloomFilter* unfinishedBf, std::uint32_t compressor);
+	virtual void finish_parentless (void);
+private:
+	static void unfinished_filter_unsqueeze (const BitVector* squeezedBv,
+	                                         const void* specBits, BitVector* dstBv);
+public:
 
 	virtual void batch_query (std::vector<Query*> queries,
 	                          bool isLeafOnly=false, bool distinctKmers=false,
 	                          bool completeKmerCounts=false,
-	                          bool adjustKmerCounts=false);
+	                          bool adjustKmerCounts=false,
+	                          std::uint32_t numThreads=1,
+	                          bool levelOrder=false);
 private:
 	virtual void perform_batch_query (std::uint64_t activeQueries, std::vector<Query*> queries,
 	                                  bool completeKmerCounts=false);
+	virtual std::uint64_t examine_batch (std::uint64_t activeQueries, std::vector<Query*>& queries,
+	                                  bool completeKmerCounts=false);
+	virtual void perform_level_batch_query (std::uint64_t activeQueries, std::vector<Query*>& queries,
+	                                  bool completeKmerCounts=false);
+	virtual void perform_children_batch_query (std::uint64_t activeQueries, std::vector<Query*>& queries,
+	                                  bool completeKmerCounts=false);
+	static bool claim_worker();
+	static void release_worker();
 	virtual void query_matches_leaves (Query* q);
 
 public:
@@ -108,6 +156,32 @@ public:
 	bool nodesShareFiles;				// (only applicable at root)
 										// true => tree may contain nodes that
 										//         .. share files with each other
+	std::string packFilename;			// (only applicable at root)
+										// non-empty => the tree was read from
+										//         .. this packed tree file, and
+										//         .. all its filters are in it
+	std::uint32_t filterUsers;			// number of searches (e.g. query
+										// .. threads) currently using the
+										// .. filter; see acquire_filter()
+	bool isCached;						// true => the filter is resident but
+										// .. idle, and is in the node cache
+	std::uint32_t cacheLevel;			// (only valid if isCached) depth of
+										// .. this node in the tree
+	std::uint64_t cachedBytes;			// (only valid if isCached) size of the
+										// .. filter, as counted by the cache
+	std::list<BloomTree*>::iterator cachePosition; // (only valid if isCached)
+	bool prefetchWanted;				// true => the node is in the prefetch
+										// .. queue, and its filter hasn't been
+										// .. acquired since it was queued
+	bool prefetchHeld;					// true => the prefetcher has acquired
+										// .. the filter on behalf of the next
+										// .. search to acquire it
+	bool isHeld;						// true => (during a build) the filter
+										// .. is unfinished and has not been
+										// .. saved; it is being held in memory
+										// .. until the parent finishes it
+	std::uint64_t heldBytes;			// (only valid if isHeld) size of the
+										// .. filter, as counted by the build
 
 public:
 	bool reportLoad = false;
@@ -115,7 +189,53 @@ public:
 	static bool inhibitBvSimplify;
 	static bool trackMemory;
 	static bool reportUnload;
-	static int  dbgTraversalCounter;
+	static std::atomic<int> dbgTraversalCounter;
+	static std::atomic<int> idleWorkers;	// number of additional threads
+										// .. a batch query or a tree build
+										// .. may still start
+	static std::recursive_mutex loadLock; // serializes filter loading and
+										// .. unloading, which share
+										// .. FileManager's open file
+	static std::uint64_t cacheBudget;	// number of bytes of idle filters that
+										// .. may be kept resident; zero means
+										// .. filters are unloaded as soon as
+										// .. they are released
+	static std::uint64_t cacheBytes;	// number of bytes of filters currently
+										// .. in the node cache
+	static std::uint64_t cacheHits;
+	static std::uint64_t cacheMisses;
+	static std::uint64_t cacheEvictions;
+	static std::vector<std::list<BloomTree*>> cacheLevels; // cached nodes, by
+										// .. depth in the tree; each list is
+										// .. in most-recently-used order
+	static bool prefetchFilters;		// true => batch queries load filters
+										// .. in the background, ahead of the
+										// .. search
+	static std::uint64_t prefetchLoads;	// number of filters the prefetcher
+										// .. loaded
+	static std::mutex prefetchLock;		// protects the prefetch queue and
+										// .. prefetcher thread state
+	static std::condition_variable prefetchSignal;
+	static std::deque<BloomTree*> prefetchQueue;
+	static std::thread prefetcher;
+	static std::uint32_t prefetchClients; // number of batch queries currently
+										// .. using the prefetcher
+	static bool prefetcherStop;
+	static std::uint64_t holdBudget;	// number of bytes of unfinished
+										// .. filters that a build may hold in
+										// .. memory rather than saving them
+	static std::uint64_t heldBytesTotal; // number of bytes of filters
+										// .. currently held
+	static std::uint64_t numHolds;		// number of filters that were held
+	static std::uint64_t numSpills;		// number of unfinished filters that
+										// .. had to be saved
+	static bool checkConsistency;		// true => as each node's filter is
+										// .. preloaded, check it against the
+										// .. first filter encountered
+	static BloomFilter* consistencyModel; // (only used if checkConsistency)
+	static bool mergeLookups;			// true => at each node, the positions
+										// .. of all active queries are looked
+										// .. up together, in sorted order
 
 public:
 	std::uint32_t queryStatsLen;
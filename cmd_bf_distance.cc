@@ -26,6 +26,8 @@ using std::endl;
 #define u32 std::uint32_t
 #define u64 std::uint64_t
 
+#define bfdistance_rows_per_block 256
+
 
 void BFDistanceCommand::short_description
    (std::ostream& s)
@@ -64,6 +66,8 @@ void BFDistanceCommand::usage
 	s << "                     number of 1s in A and N is the number of 1s A and B have" << endl;
 	s << "                     in common; when A is a query and B is a node, this metric" << endl;
 	s << "                     corresponds to the threshold setting in the query command" << endl;
+	s << "  --threads=<N>      number of threads to use for computing distances" << endl;
+	s << "                     (default is 1)" << endl;
 	s << "" << endl;
 	s << "  Compute all-vs-all distances between bloom filters. The <filename>s, plus any" << endl;
 	s << "  filenames listed in the list file, comprise a collection of bloom filters." << endl;
@@ -94,6 +98,7 @@ void BFDistanceCommand::parse
 	startPosition  = 0;
 	endPosition    = UINT64_MAX;   // this will be reduced to min filter length
 	showDistanceAs = "hamming";
+	numThreads     = 1;
 
 	// skip command name
 
@@ -151,6 +156,18 @@ void BFDistanceCommand::parse
 			continue;
 			}
 
+		// --threads=<N>
+
+		if ((is_prefix_of (arg, "--threads="))
+		 ||	(is_prefix_of (arg, "T="))
+		 ||	(is_prefix_of (arg, "--T=")))
+			{
+			numThreads = string_to_u32(argVal);
+			if (numThreads == 0)
+				chastise ("(in \"" + arg + "\") number of threads cannot be zero");
+			continue;
+			}
+
 		// --show:hamming, etc.
 
 		if ((arg == "--show:hamming")
@@ -353,87 +370,133 @@ int BFDistanceCommand::execute()
 
 	u32 numComparisonVectors = (haveFocus)? focusBvs.size() : bvs.size();
 
+	// load all the bit vectors; we do this up front, in this thread, since
+	// loading isn't thread-safe
+
+	for (const auto& bv : bvs)
+		bv->load();
+	for (const auto& bv : focusBvs)
+		bv->load();
+
+	// process the vectors a block of rows (u vectors) at a time; within a
+	// block the counts are computed by tiles (see for_each_tile_pair),
+	// possibly in several threads, and then reported in the usual order
+	//
+	// for each (u,v) pair we compute up to two counts, count1 and count2;
+	// which counts depends on showDistanceAs; only jaccard needs count2
+
+	u32 tileSize     = bitwise_tile_size(numBits);
+	u32 rowsPerBlock = std::max (tileSize, (u32) bfdistance_rows_per_block);
+	vector<u64> count1(((u64) rowsPerBlock) * numComparisonVectors);
+	vector<u64> count2;
+	if (showDistanceAs == "jaccard")
+		count2.resize(((u64) rowsPerBlock) * numComparisonVectors);
+	vector<u64> uOnes(rowsPerBlock);
+
 	bool isFirst = true;
-	for (u32 uIx=0 ; uIx<bvs.size() ; uIx++)
+	for (u32 blockStart=0 ; blockStart<bvs.size() ; blockStart+=rowsPerBlock)
 		{
-		BitVector* u = bvs[uIx];
-		u->load();
-		string uName = u->filename + ":" + std::to_string(u->offset);
-		const void*	uBits = ((u8*) u->bits->data()) + (startPosition/8);
+		u32 blockEnd = std::min (blockStart+rowsPerBlock, (u32) bvs.size());
 
-		u64 numer = 0;
-		u64 denom = 0;
-		if (showDistanceAs == "theta")
-			denom = bitwise_count(uBits,numBits);
+		for_each_tile_pair (blockEnd-blockStart, numComparisonVectors, tileSize, numThreads,
+		                    /*upperTriangle*/ false,
+			[&](u32 threadNum, u32 rowStart, u32 rowEnd, u32 colStart, u32 colEnd)
+				{
+				for (u32 rowIx=rowStart ; rowIx<rowEnd ; rowIx++)
+					{
+					u32 uIx = blockStart + rowIx;
+					const void*	uBits = ((u8*) bvs[uIx]->bits->data()) + (startPosition/8);
+
+					if ((showDistanceAs == "theta") && (colStart == 0))
+						uOnes[rowIx] = bitwise_count(uBits,numBits);
+
+					for (u32 vIx=colStart ; vIx<colEnd ; vIx++)
+						{
+						if (not haveFocus)
+							{
+							if (vIx == uIx) continue;
+							if ((distanceIsSymmetric) and (vIx < uIx)) continue;
+							}
+
+						BitVector* v = (haveFocus)? focusBvs[vIx] : bvs[vIx];
+						const void*	vBits = ((u8*) v->bits->data()) + (startPosition/8);
+
+						u64 pairIx = ((u64) rowIx) * numComparisonVectors + vIx;
+						if (showDistanceAs == "intersection")
+							count1[pairIx] = bitwise_and_count(uBits,vBits,numBits);
+						else if (showDistanceAs == "union")
+							count1[pairIx] = bitwise_or_count(uBits,vBits,numBits);
+						else if (showDistanceAs == "jaccard")
+							{
+							count1[pairIx] = bitwise_and_count(uBits,vBits,numBits);
+							count2[pairIx] = bitwise_or_count(uBits,vBits,numBits);
+							}
+						else if (showDistanceAs == "theta")
+							count1[pairIx] = bitwise_and_count(uBits,vBits,numBits);
+						else // if (showDistanceAs == "hamming")
+							count1[pairIx] = hamming_distance(uBits,vBits,numBits);
+						}
+					}
+				});
 
-		for (u32 vIx=0 ; vIx<numComparisonVectors ; vIx++)
+		// report this block's distances
+
+		for (u32 uIx=blockStart ; uIx<blockEnd ; uIx++)
 			{
-			if (not haveFocus)
+			u32 rowIx = uIx - blockStart;
+			BitVector* u = bvs[uIx];
+			string uName = u->filename + ":" + std::to_string(u->offset);
+
+			u64 numer = 0;
+			u64 denom = 0;
+			if (showDistanceAs == "theta")
+				denom = uOnes[rowIx];
+
+			for (u32 vIx=0 ; vIx<numComparisonVectors ; vIx++)
 				{
-				if (vIx == uIx) continue;
-				if ((distanceIsSymmetric) and (vIx < uIx)) continue;
-				}
+				if (not haveFocus)
+					{
+					if (vIx == uIx) continue;
+					if ((distanceIsSymmetric) and (vIx < uIx)) continue;
+					}
 
-			BitVector* v = (haveFocus)? focusBvs[vIx] : bvs[vIx];
-			v->load();
-			string vName = v->filename + ":" + std::to_string(v->offset);
-			const void*	vBits = ((u8*) v->bits->data()) + (startPosition/8);
+				BitVector* v = (haveFocus)? focusBvs[vIx] : bvs[vIx];
+				string vName = v->filename + ":" + std::to_string(v->offset);
+				u64 pairIx = ((u64) rowIx) * numComparisonVectors + vIx;
 
-			cout << std::setw(nameWidth+1) << std::left << uName
-			     << std::setw(nameWidth+1) << std::left << vName;
+				cout << std::setw(nameWidth+1) << std::left << uName
+				     << std::setw(nameWidth+1) << std::left << vName;
 
-			if (showDistanceAs == "intersection")
-				{
-				u64 distance = bitwise_and_count(uBits,vBits,numBits);
-				cout << std::setw(distanceWidth) << std::right << distance;
-				}
-			else if (showDistanceAs == "union")
-				{
-				u64 distance = bitwise_or_count(uBits,vBits,numBits);
-				cout << std::setw(distanceWidth) << std::right << distance;
-				}
-			else if (showDistanceAs == "jaccard")
-				{
-				double distance;
-				numer = bitwise_and_count(uBits,vBits,numBits);
-				denom = bitwise_or_count(uBits,vBits,numBits);
-				cout << std::setw(distanceWidth) << std::right << numer
-				     << "/" << std::setw(distanceWidth) << std::left << denom;
-				if (denom > 0)
+				if ((showDistanceAs == "jaccard")
+				 || (showDistanceAs == "theta"))
 					{
-					distance = numer / float(denom);
-					cout.precision(4);
-					cout << " " << std::setw(6) << std::left << distance;
+					double distance;
+					numer = count1[pairIx];
+					if (showDistanceAs == "jaccard")
+						denom = count2[pairIx];
+					cout << std::setw(distanceWidth) << std::right << numer
+					     << "/" << std::setw(distanceWidth) << std::left << denom;
+					if (denom > 0)
+						{
+						distance = numer / float(denom);
+						cout.precision(4);
+						cout << " " << std::setw(6) << std::left << distance;
+						}
 					}
-				}
-			else if (showDistanceAs == "theta")
-				{
-				double distance;
-				numer = bitwise_and_count(uBits,vBits,numBits);
-				cout << std::setw(distanceWidth) << std::right << numer
-				     << "/" << std::setw(distanceWidth) << std::left << denom;
-				if (denom > 0)
+				else // hamming, intersection, or union
 					{
-					distance = numer / float(denom);
-					cout.precision(4);
-					cout << " " << std::setw(6) << std::left << distance;
+					u64 distance = count1[pairIx];
+					cout << std::setw(distanceWidth) << std::right << distance;
 					}
-				}
-			else // if (showDistanceAs == "hamming")
-				{
-				u64 distance = hamming_distance(uBits,vBits,numBits);
-				cout << std::setw(distanceWidth) << std::right << distance;
-				}
 
-			if (isFirst)
-				{ cout << " (" << showDistanceAs << ")";  isFirst = false; }
-			cout << endl;
+				if (isFirst)
+					{ cout << " (" << showDistanceAs << ")";  isFirst = false; }
+				cout << endl;
 
-			// v->unloadable(); øøø add this
-			cout.flags(saveCoutFlags);
-			cout.precision(saveCoutPrecision);
+				cout.flags(saveCoutFlags);
+				cout.precision(saveCoutPrecision);
+				}
 			}
-		// u->unloadable(); øøø add this
 		}
 
 	// clean up
@@ -25,6 +25,7 @@ public:
 	std::uint64_t startPosition;	// origin-zero, half-open
 	std::uint64_t endPosition;
 	std::string showDistanceAs;
+	std::uint32_t numThreads;
 	};
 
 #endif // cmd_bf_distance_H
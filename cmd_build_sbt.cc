@@ -59,6 +59,16 @@ void BuildSBTCommand::usage
 	s << "                       (this is the default)" << endl;
 	s << "  --rrr                create the nodes as rrr-compressed bit vector(s)" << endl;
 	s << "  --roar               create the nodes as roar-compressed bit vector(s)" << endl;
+	s << "  --threads=<N>        number of threads to use; independent subtrees are" << endl;
+	s << "                       constructed concurrently, and the files written are" << endl;
+	s << "                       the same as with a single thread" << endl;
+	s << "                       (default is 1)" << endl;
+	s << "  --memory=<bytes>     (for allsome and determined trees) keep up to this many" << endl;
+	s << "                       bytes of unfinished nodes in memory until their parent" << endl;
+	s << "                       finishes them, so that each node is only written once" << endl;
+	s << "                       (e.g. --memory=16G); nodes that don't fit are written" << endl;
+	s << "                       to disk and read back" << endl;
+	s << "                       (by default every unfinished node is written to disk)" << endl;
 	}
 
 void BuildSBTCommand::debug_help
@@ -89,6 +99,8 @@ void BuildSBTCommand::parse
 
 	bfKind     = bfkind_simple;
 	compressor = bvcomp_uncompressed;
+	numThreads = 1;
+	holdBudget = 0;
 	BloomTree::inhibitBvSimplify = false;
 
 	// skip command name
@@ -210,6 +222,23 @@ void BuildSBTCommand::parse
 		 || (arg == "--roaring"))
 			{ compressor = bvcomp_roar;  continue; }
 
+		// --threads=<N>
+
+		if ((is_prefix_of (arg, "--threads="))
+		 ||	(is_prefix_of (arg, "T="))
+		 ||	(is_prefix_of (arg, "--T=")))
+			{
+			numThreads = string_to_u32(argVal);
+			if (numThreads == 0)
+				chastise ("(in \"" + arg + "\") number of threads cannot be zero");
+			continue;
+			}
+
+		// --memory=<bytes>
+
+		if (is_prefix_of (arg, "--memory="))
+			{ holdBudget = string_to_unitized_u64(argVal,1024);  continue; }
+
 		// (unadvertised) --tree=<filename>, --topology=<filename>
 
 		if ((is_prefix_of (arg, "--tree="))
@@ -304,6 +333,9 @@ int BuildSBTCommand::execute()
 		BitVector::reportCreation = true;
 
 	BloomTree* root = BloomTree::read_topology(inTreeFilename);
+	if (not root->packFilename.empty())
+		fatal ("error: \"" + inTreeFilename + "\" is a packed tree file"
+		       " (a tree can't be built from it)");
 
 	if (contains(debug,"topology"))
 		root->print_topology(cerr,/*level*/0,/*format*/topofmt_nodeNames);
@@ -333,27 +365,14 @@ int BuildSBTCommand::execute()
 	if (hasOnlyChildren)
 		fatal ("error: tree contains at least one only child");
 
-	switch (bfKind)
-		{
-		case bfkind_simple:
-			root->construct_union_nodes (compressor);
-			break;
-		case bfkind_allsome:
-			root->construct_allsome_nodes (compressor);
-			break;
-		case bfkind_determined:
-			root->construct_determined_nodes (compressor);
-			break;
-		case bfkind_determined_brief:
-			root->construct_determined_brief_nodes (compressor);
-			break;
-		case bfkind_intersection:   // to assist in debugging
-			root->construct_intersection_nodes (compressor);
-			break;
-		default:
-			fatal ("error: in BuildSBTCommand::execute():"
-			       " bad filter code: \"" + std::to_string(bfKind) + "\"");
-		}
+	BloomTree::idleWorkers = (int) numThreads - 1;
+	BloomTree::holdBudget  = holdBudget;
+
+	root->construct_nodes (bfKind, compressor);
+
+	if (holdBudget != 0)
+		cerr << BloomTree::numHolds << " unfinished nodes were held in memory"
+		     << ", " << BloomTree::numSpills << " were written to disk" << endl;
 
 	if (not outTreeFilename.empty())
 		{
@@ -23,6 +23,8 @@ public:
 	std::string outTreeFilename;
 	std::uint32_t bfKind;
 	std::uint32_t compressor;
+	std::uint32_t numThreads;
+	std::uint64_t holdBudget;
 	};
 
 #endif // cmd_build_sbt_H
@@ -5,7 +5,10 @@
 #include <cstdint>
 #include <limits>
 #include <iostream>
+#include <vector>
 #include <queue>
+#include <random>
+#include <algorithm>
 
 #include "utilities.h"
 #include "bit_utilities.h"
@@ -70,6 +73,21 @@ void ClusterCommand::usage
 	s << "  --nobuild         perform the clustering but don't build the tree's nodes" << endl;
 	s << "                    (this is the default)" << endl;
 	s << "  --build           perform clustering, then build the uncompressed nodes" << endl;
+	s << "  --candidates=<K>  only compute distances between pairs of nodes that are" << endl;
+	s << "                    likely to be close (found by locality sensitive hashing)," << endl;
+	s << "                    with up to <K> candidates per node; this scales to many" << endl;
+	s << "                    more leaves, but the tree is an approximation of the one" << endl;
+	s << "                    we'd get without this option (e.g. --candidates=" << defaultCandidatesPerNode << ")" << endl;
+	s << "                    (by default we compute distances between all pairs)" << endl;
+	s << "  --threads=<N>     number of threads to use for computing distances" << endl;
+	s << "                    (default is 1)" << endl;
+	s << "  --memory=<bytes>  cluster on compact sketches of the bit intervals, keeping" << endl;
+	s << "                    memory use within roughly <bytes> (e.g. 4G); the full" << endl;
+	s << "                    intervals are read from disk once to make the sketches," << endl;
+	s << "                    and again only to evaluate the merged nodes for culling" << endl;
+	s << "                    (by default all the intervals are held in memory)" << endl;
+	s << "  --sketch=<N>      number of bits sampled from each interval for its sketch" << endl;
+	s << "                    (by default this is derived from --memory)" << endl;
 	}
 
 void ClusterCommand::debug_help
@@ -84,6 +102,8 @@ void ClusterCommand::debug_help
 	s << "  bits" << endl;
 	s << "  distances" << endl;
 	s << "  queue" << endl;
+	s << "  candidates" << endl;
+	s << "  sketch" << endl;
 	s << "  mergings" << endl;
 	s << "  numbers" << endl;
 	s << "  cull" << endl;
@@ -108,6 +128,13 @@ void ClusterCommand::parse
 	cullingThreshold       = std::numeric_limits<double>::quiet_NaN();
 	renumberNodes          = true;
 	inhibitBuild           = true;
+	candidatesPerNode      = 0;
+	numThreads             = 1;
+	memoryBudget           = 0;
+	sketchBits             = 0;
+	useSketches            = false;
+	lshBands               = defaultLshBands;
+	lshBandBits            = defaultLshBandBits;
 
 	// skip command name
 
@@ -293,6 +320,73 @@ void ClusterCommand::parse
 		if (arg == "--build")
 			{ inhibitBuild = false;  continue; }
 
+		// --candidates=<K>, --candidates
+
+		if (arg == "--candidates")
+			{ candidatesPerNode = defaultCandidatesPerNode;  continue; }
+
+		if (is_prefix_of (arg, "--candidates="))
+			{
+			candidatesPerNode = string_to_u32(argVal);
+			if (candidatesPerNode == 0)
+				chastise ("--candidates must be at least 1 (\"" + arg + "\")");
+			continue;
+			}
+
+		// --threads=<N>
+
+		if ((is_prefix_of (arg, "--threads="))
+		 ||	(is_prefix_of (arg, "T="))
+		 ||	(is_prefix_of (arg, "--T=")))
+			{
+			numThreads = string_to_u32(argVal);
+			if (numThreads == 0)
+				chastise ("(in \"" + arg + "\") number of threads cannot be zero");
+			continue;
+			}
+
+		// --memory=<bytes>
+
+		if ((is_prefix_of (arg, "--memory="))
+		 ||	(is_prefix_of (arg, "--mem=")))
+			{
+			memoryBudget = string_to_unitized_u64(argVal,/*unitScale*/ 1024);
+			if (memoryBudget == 0)
+				chastise ("--memory cannot be zero (\"" + arg + "\")");
+			useSketches = true;
+			continue;
+			}
+
+		// --sketch=<N>
+
+		if ((is_prefix_of (arg, "--sketch="))
+		 ||	(is_prefix_of (arg, "--sketchbits=")))
+			{
+			sketchBits = string_to_unitized_u64(argVal);
+			if (sketchBits == 0)
+				chastise ("--sketch cannot be zero (\"" + arg + "\")");
+			useSketches = true;
+			continue;
+			}
+
+		// (unadvertised) --lshbands=<L>, --lshbits=<N>
+
+		if (is_prefix_of (arg, "--lshbands="))
+			{
+			lshBands = string_to_u32(argVal);
+			if (lshBands == 0)
+				chastise ("--lshbands must be at least 1 (\"" + arg + "\")");
+			continue;
+			}
+
+		if (is_prefix_of (arg, "--lshbits="))
+			{
+			lshBandBits = string_to_u32(argVal);
+			if ((lshBandBits == 0) || (lshBandBits > 64))
+				chastise ("--lshbits must be in the range 1..64 (\"" + arg + "\")");
+			continue;
+			}
+
 		// (unadvertised) debug options
 
 		if (arg == "--debug")
@@ -396,9 +490,14 @@ int ClusterCommand::execute()
 			cerr << "bit vector " << bv->filename << " " << bv->offset << endl;
 		}
 
+	plan_sketches ();
+
 	// create a binary tree
 
-	cluster_greedily();
+	if (candidatesPerNode > 0)
+		cluster_by_candidates();
+	else
+		cluster_greedily();
 
 	// remove fruitless nodes
 
@@ -554,14 +653,8 @@ void ClusterCommand::find_leaf_vectors()
 // 
 //----------
 
-struct MergeCandidate
-	{
-public:
-	u64 d;		// distance between u and v
-	u32 height;	// height of a subtree containing the u-v merger as its root
-	u32 u;		// one node (index into node)
-	u32 v;		// other node (index into node)
-	};
+#define minWordsPerThread (1024*1024)  // (fewer, and starting a thread costs
+                                      //  .. more than it saves)
 
 bool operator>(const MergeCandidate& lhs, const MergeCandidate& rhs)
 	{
@@ -573,8 +666,7 @@ bool operator>(const MergeCandidate& lhs, const MergeCandidate& rhs)
 
 void ClusterCommand::cluster_greedily()
 	{
-	u64 numBits = endPosition - startPosition;
-	u64 numBytes = (numBits + 7) / 8;
+	u64 numBits = numClusterBits;
 	u32 numLeaves = leafVectors.size();
 
 	if (numLeaves == 0)
@@ -588,39 +680,54 @@ void ClusterCommand::cluster_greedily()
 
 	// load the bit arrays for the leaves
 
-	for (u32 u=0 ; u<numLeaves ; u++)
-		{
-		BitVector* bv = leafVectors[u];
-		bv->load();
-		node[u] = new BinaryTree(u,bv->bits->data());
-		if (node[u] == nullptr)
-			fatal ("error: failed to create BinaryTree for node[" + std::to_string(u) + "]");
-		if (trackMemory)
-			cerr << "@+" << node[u] << " creating BinaryTree for node[" << u << "] (" << bv->filename << ")" << endl;
-		node[u]->trackMemory = trackMemory;
+	load_leaf_nodes (node);
 
-		if (contains(debug,"bits"))
-			{ cerr << u << ": ";  dump_bits (cerr, node[u]->bits);  cerr << endl; }
-		}
+	// compute all-vs-all distances among the leaves; this is done by tiles
+	// (see for_each_tile_pair), possibly in several threads, with each pair's
+	// candidate written directly into its own slot of the array that becomes
+	// the queue's container
+	//
+	// nota bene: the queue's ordering is total, so the order of the
+	//            candidates in the container doesn't affect the result
 
-	// fill the priority queue with all-vs-all distances among the leaves
+	BinaryTree** nodeArray = node;	// (lambdas can't capture a variable-length
+									//  .. array)
+	u32 tileSize = bitwise_tile_size(numBits);
 
-	std::priority_queue<MergeCandidate, vector<MergeCandidate>, std::greater<MergeCandidate>> q;
+	u64 numLeafPairs = ((u64) numLeaves) * (numLeaves-1) / 2;
+	vector<MergeCandidate> leafCandidates(numLeafPairs);
+	for_each_tile_pair (numLeaves, numLeaves, tileSize, numThreads, /*upperTriangle*/ true,
+		[&](u32 threadNum, u32 uStart, u32 uEnd, u32 vStart, u32 vEnd)
+			{
+			for (u32 u=uStart ; u<uEnd ; u++)
+				{
+				// slot of pair (u,u+1); pairs are in row-major order
+				u64 rowBase = ((u64) u) * numLeaves - ((u64) u) * (u+1) / 2;
+				for (u32 v=std::max(vStart,u+1) ; v<vEnd ; v++)
+					{
+					u64 d = hamming_distance (nodeArray[u]->bits, nodeArray[v]->bits, numBits);
+					MergeCandidate c = { d,2,u,v };
+					leafCandidates[rowBase + (v-u-1)] = c;
+					}
+				}
+			});
+
+	// fill the priority queue with those distances
 
-	for (u32 u=0 ; u<numLeaves-1 ; u++)
+	if ((contains(debug,"distances")) || (contains(debug,"queue")))
 		{
-		for (u32 v=u+1 ; v<numLeaves ; v++)
+		for (const auto& c : leafCandidates)
 			{
-			u64 d = hamming_distance (node[u]->bits, node[v]->bits, numBits);
 			if (contains(debug,"distances"))
-				cerr << "node " << u << " vs " << "node " << v << " d=" << d << " h=" << 2 << endl;
+				cerr << "node " << c.u << " vs " << "node " << c.v << " d=" << c.d << " h=" << 2 << endl;
 			if (contains(debug,"queue"))
-				cerr << "pushing (" << d << "," << 2 << "," << u << "," << v << ")" << endl;
-			MergeCandidate c = { d,2,u,v };
-			q.push (c);
+				cerr << "pushing (" << c.d << "," << 2 << "," << c.u << "," << c.v << ")" << endl;
 			}
 		}
 
+	std::priority_queue<MergeCandidate, vector<MergeCandidate>, std::greater<MergeCandidate>>
+	  q(std::greater<MergeCandidate>(), std::move(leafCandidates));
+
 	// for each new node,
 	//	- pop the closest active pair (u,v) from the queue
 	//	- create a new node w = union of (u,v)
@@ -659,100 +766,665 @@ void ClusterCommand::cluster_greedily()
 			cerr << "merge " << u << " and " << v << " to make " << w
 			     << " (hamming distance " << d << ")" << endl;
 
-		// create a new node w = union of (u,v)
+		// create a new node w = union of (u,v), and deactivate u and v
 
-		u64* wBits = (u64*) new char[numBytes];
-		if (wBits == nullptr)
-			fatal ("error: failed to allocate " + std::to_string(numBytes) + " bytes"
-			     + " for node " + std::to_string(w) + "'s bit array");
-		if (trackMemory)
-			cerr << "@+" << wBits << " allocating bits for node[" << w << "]"
-			     << " (merges node[" << u << "] and node[" << v << "])" << endl;
+		merge_nodes (node, u, v, w);
+		u64* wBits = node[w]->bits;
 
-		bitwise_or (node[u]->bits, node[v]->bits, /*dst*/ wBits, numBits);
+		// add the distance to w from each active node; the distances are
+		// computed in chunks of nodes, possibly in several threads; we only
+		// use as many threads as there is enough work for, since the threads
+		// are started anew for each merger
 
-		node[w] = new BinaryTree(w,wBits,node[u],node[v]);
-		if (node[w] == nullptr)
-			fatal ("error: failed to create BinaryTree for node[" + std::to_string(w) + "]");
-		if (trackMemory)
-			cerr << "@+" << node[w] << " creating BinaryTree for node[" << w << "]" << endl;
-		node[w]->trackMemory = trackMemory;
+		u64 rowWords = ((u64) w) * ((numBits + 63) / 64);
+		u32 wThreads = (u32) std::min ((u64) numThreads, std::max ((u64) 1, rowWords / minWordsPerThread));
 
-		if (contains(debug,"bits"))
-			{ cerr << w << ": ";  dump_bits (cerr, wBits);  cerr << endl; }
+		vector<u64> wDistances(w);
+		u32 chunkSize = std::max (tileSize, (w + 4*wThreads-1) / (4*wThreads));
+		for_each_tile_pair (1, w, chunkSize, wThreads, /*upperTriangle*/ false,
+			[&](u32 threadNum, u32 rowStart, u32 rowEnd, u32 xStart, u32 xEnd)
+				{
+				for (u32 x=xStart ; x<xEnd ; x++)
+					{
+					if (nodeArray[x]->bits == nullptr) continue; // x isn't active
+					wDistances[x] = hamming_distance (nodeArray[x]->bits, wBits, numBits);
+					}
+				});
+
+		for (u32 x=0 ; x<w ; x++)
+			{
+			if (node[x]->bits == nullptr) continue; // x isn't active
+			u64 d = wDistances[x];
+			u32 h = 1 + std::max (height,node[x]->height);
+			if (contains(debug,"distances"))
+				cerr << "node " << x << " vs " << "node " << w << " d=" << d << " h=" << h << endl;
+			if (contains(debug,"queue"))
+				cerr << "pushing (" << d << "," << h << "," << x << "," << w << ")" << endl;
+			MergeCandidate c = { d,h,x,w };
+			q.push (c);
+			}
+		}
+
+	// get rid of the root, and make sure it's the only node left
+
+	finish_root (node);
+	}
+
+//----------
+//
+// cluster_by_candidates--
+//	Determine a binary tree structure by greedy clustering, considering only
+//	promising pairs of nodes.
+//
+// This is a scalable alternative to cluster_greedily(). Rather than computing
+// the distance between every pair of leaves, we find candidate pairs by
+// locality sensitive hashing, and only compute distances for those. As in
+// cluster_greedily(), we repeatedly merge the closest pair; but the distances
+// from a new node are computed only to the (active) candidates of the two
+// nodes it replaces.
+//
+//----------
+//
+// Implementation notes:
+//	(1)	The memory used (queue entries and candidate lists) and the number of
+//		distance computations are both roughly proportional to the number of
+//		leaves times candidatesPerNode (and lshBands), rather than to the
+//		square of the number of leaves. Stale queue entries are skipped lazily
+//		as in cluster_greedily(); there are only O(1) of them per merger.
+//	(2)	The result is an approximation of cluster_greedily()'s tree. A pair
+//		that is closest overall will usually, but not always, be among the
+//		candidates.
+//	(3)	If the queue runs dry before we're down to one node, the candidate
+//		graph has come apart. We then look for more candidates among the
+//		remaining active nodes, with fewer bits per band so that collisions
+//		are more likely. With zero bits per band every node lands in the same
+//		bucket, which guarantees that the new candidates connect all of them.
+//		Since a new node keeps only some of its children's candidates, the
+//		graph can come apart again later; each time it does, we repeat the
+//		search (with zero bits per band, from then on).
+//
+//----------
+
+void ClusterCommand::cluster_by_candidates()
+	{
+	u64 numBits = numClusterBits;
+	u32 numLeaves = leafVectors.size();
+
+	if (numLeaves == 0)
+		fatal ("internal error: cluster_by_candidates() asked to cluster an empty nodelist");
+
+	if (numLeaves == 1)  // (this test is because we will assume the root is not a leaf)
+		fatal ("internal error: cluster_by_candidates() asked to cluster a single node");
+
+	u32 numNodes = 2*numLeaves - 1;  // nodes in tree, including leaves
+	vector<BinaryTree*> node(numNodes,nullptr);
+
+	// load the bit arrays for the leaves
+
+	load_leaf_nodes (node.data());
+
+	// find candidate pairs among the leaves, and fill the priority queue with
+	// their distances
+
+	std::priority_queue<MergeCandidate, vector<MergeCandidate>, std::greater<MergeCandidate>> q;
+	vector<vector<u32>> neighbors(numNodes);
+
+	vector<u32> activeNodes(numLeaves);
+	for (u32 u=0 ; u<numLeaves ; u++) activeNodes[u] = u;
+
+	u32 bandBits = lshBandBits;
+	find_candidate_pairs (node.data(), activeNodes, bandBits, neighbors, q);
+
+	// for each new node,
+	//	- pop the closest active pair (u,v) from the queue
+	//	- create a new node w = union of (u,v)
+	//	- deactivate u and v by removing their bit arrays
+	//	- add the distance to w from the closest active candidates of u and v
 
-		// deactivate u and v by removing their bit arrays; if either was a
-		// leaf tell the corresonding bit vector it can get rid of its bits;
-		//
-		// note that if we're going to be culling, we move (or copy) the bit
-		// arrays to bCup rather than get rid of them
+	for (u32 w=numLeaves ; w<numNodes ; w++)
+		{
+		// pop the closest active pair (u,v) from the queue
 
-		if (cullNodes)
+		u64 d;
+		u32 height, u, v;
+
+		while (true)
 			{
-			if (u < numLeaves)
+			if (q.empty())
 				{
-				node[u]->bCup = (u64*) new char[numBytes];
-				if (node[u]->bCup == nullptr)
-					fatal ("error: failed to allocate " + std::to_string(numBytes) + " bytes"
-					     + " for node " + std::to_string(u) + "'s bCup array");
-				if (trackMemory)
-					cerr << "@+" << node[u]->bCup << " allocating bCup for node[" << u << "]" << endl;
-				std::memcpy (/*to*/ node[u]->bCup, /*from*/ node[u]->bits, /*how much*/ numBytes);
+				activeNodes.clear();
+				for (u32 x=0 ; x<w ; x++)
+					{ if (node[x]->bits != nullptr) activeNodes.emplace_back(x); }
+				if (activeNodes.size() < 2)
+					fatal ("internal error: cluster_by_candidates() queue is empty");
+				bandBits /= 2;
+				if (contains(debug,"candidates"))
+					cerr << "candidate queue is empty with " << activeNodes.size() << " active nodes"
+					     << "; looking for more candidates with " << bandBits << " bits per band" << endl;
+				find_candidate_pairs (node.data(), activeNodes, bandBits, neighbors, q);
+				continue;
 				}
-			else
-				{ node[u]->bCup = node[u]->bits; }
 
-			if (v < numLeaves)
+			MergeCandidate cand = q.top();
+			q.pop();
+			if (contains(debug,"queue"))
+				cerr << "popping (" << cand.d << "," << cand.height << "," << cand.u << "," << cand.v << ")"
+				     << " q.size()=" << q.size() << endl;
+			if (node[cand.u]->bits == nullptr) continue; // u isn't active
+			if (node[cand.v]->bits == nullptr) continue; // v isn't active
+			d      = cand.d;
+			height = cand.height;
+			u      = cand.u;
+			v      = cand.v;
+			break;
+			}
+
+		if (contains(debug,"mergings"))
+			cerr << "merge " << u << " and " << v << " to make " << w
+			     << " (hamming distance " << d << ")" << endl;
+
+		// create a new node w = union of (u,v), and deactivate u and v
+
+		merge_nodes (node.data(), u, v, w);
+		u64* wBits = node[w]->bits;
+
+		// w's candidates are the active candidates of u and v; we keep the
+		// closest of those
+
+		vector<u32> wCandidates;
+		for (const u32 x : neighbors[u])
+			{ if (node[x]->bits != nullptr) wCandidates.emplace_back(x); }
+		for (const u32 x : neighbors[v])
+			{ if (node[x]->bits != nullptr) wCandidates.emplace_back(x); }
+		vector<u32>().swap(neighbors[u]);
+		vector<u32>().swap(neighbors[v]);
+
+		std::sort (wCandidates.begin(), wCandidates.end());
+		auto candEnd = std::unique (wCandidates.begin(), wCandidates.end());
+		wCandidates.erase (candEnd, wCandidates.end());
+
+		vector<std::pair<u64,u32>> scored;
+		scored.reserve (wCandidates.size());
+		for (const u32 x : wCandidates)
+			scored.emplace_back (hamming_distance (node[x]->bits, wBits, numBits), x);
+
+		u32 numToKeep = std::min ((u32) scored.size(), candidatesPerNode);
+		std::partial_sort (scored.begin(), scored.begin()+numToKeep, scored.end());
+
+		for (u32 ix=0 ; ix<numToKeep ; ix++)
+			{
+			u64 d = scored[ix].first;
+			u32 x = scored[ix].second;
+			u32 h = 1 + std::max (height,node[x]->height);
+			if (contains(debug,"distances"))
+				cerr << "node " << x << " vs " << "node " << w << " d=" << d << " h=" << h << endl;
+			if (contains(debug,"queue"))
+				cerr << "pushing (" << d << "," << h << "," << x << "," << w << ")" << endl;
+			MergeCandidate c = { d,h,x,w };
+			q.push (c);
+			neighbors[w].emplace_back(x);
+			neighbors[x].emplace_back(w);
+			}
+		}
+
+	// get rid of the root, and make sure it's the only node left
+
+	finish_root (node.data());
+	}
+
+//----------
+//
+// find_candidate_pairs--
+//	Find pairs of nodes that are likely to be close to each other, by
+//	locality sensitive hashing.
+//
+//----------
+//
+// Arguments:
+//	BinaryTree**	node:			The node array; the nodes listed in
+//									.. activeNodes must have bit arrays.
+//	vector<u32>&	activeNodes:	The nodes to find candidates among.
+//	u32				bandBits:		The number of bits sampled for each band
+//									.. (at most 64).
+//	vector<vector<u32>>& neighbors:	Each node's list of candidates, which we
+//									.. add to.
+//	priority_queue	q:				The queue to push each candidate pair to.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	We use bit sampling, the standard LSH family for Hamming distance.
+//		For each of lshBands bands we choose bandBits random positions in the
+//		bit interval; nodes that agree at all those positions fall into the
+//		same bucket. Two nodes at distance d agree at a random position with
+//		probability 1-d/numBits, so close nodes are likely to share at least
+//		one bucket.
+//	(2)	A bucket may be very large (e.g. many nearly-empty filters). To keep
+//		the number of pairs linear, each node in a bucket is paired only with
+//		the next candidatesPerNode nodes in it.
+//	(3)	The positions are chosen by a PRNG with a fixed seed, so the result
+//		doesn't change from run to run.
+//
+//----------
+
+void ClusterCommand::find_candidate_pairs
+   (BinaryTree**			node,
+	const vector<u32>&		activeNodes,
+	u32						bandBits,
+	vector<vector<u32>>&	neighbors,
+	std::priority_queue<MergeCandidate, vector<MergeCandidate>, std::greater<MergeCandidate>>& q)
+	{
+	u64 numBits   = numClusterBits;
+	u32 numActive = activeNodes.size();
+
+	std::mt19937 prng(lshSeed + bandBits);
+	std::uniform_int_distribution<u64> spinner(0,numBits-1);
+
+	vector<u64> samplePositions(bandBits);
+	vector<std::pair<u64,u32>> buckets(numActive);
+	vector<std::pair<u32,u32>> pairs;
+
+	u32 numBands = (bandBits == 0)? 1 : lshBands;
+	for (u32 band=0 ; band<numBands ; band++)
+		{
+		for (u32 bitIx=0 ; bitIx<bandBits ; bitIx++)
+			samplePositions[bitIx] = spinner(prng);
+
+		for (u32 ix=0 ; ix<numActive ; ix++)
+			{
+			const u64* bits = node[activeNodes[ix]]->bits;
+			u64 key = 0;
+			for (const u64 pos : samplePositions)
+				key = (key << 1) | ((bits[pos/64] >> (pos%64)) & 1);
+			buckets[ix] = std::make_pair(key,activeNodes[ix]);
+			}
+
+		std::sort (buckets.begin(), buckets.end());
+
+		u32 bucketStart = 0;
+		while (bucketStart < numActive)
+			{
+			u32 bucketEnd = bucketStart + 1;
+			while ((bucketEnd < numActive) && (buckets[bucketEnd].first == buckets[bucketStart].first))
+				bucketEnd++;
+
+			for (u32 ix=bucketStart ; ix<bucketEnd ; ix++)
 				{
-				node[v]->bCup = (u64*) new char[numBytes];
-				if (node[v]->bCup == nullptr)
-					fatal ("error: failed to allocate " + std::to_string(numBytes) + " bytes"
-					     + " for node " + std::to_string(v) + "'s bCup array");
-				if (trackMemory)
-					cerr << "@+" << node[v]->bCup << " allocating bits for node[" << v << "]" << endl;
-				std::memcpy (/*to*/ node[v]->bCup, /*from*/ node[v]->bits, /*how much*/ numBytes);
+				u32 pairEnd = std::min (bucketEnd, ix+1+candidatesPerNode);
+				for (u32 iy=ix+1 ; iy<pairEnd ; iy++)
+					pairs.emplace_back (buckets[ix].second, buckets[iy].second);
 				}
+
+			bucketStart = bucketEnd;
+			}
+		}
+
+	// nota bene: within a bucket, nodes are in increasing order, so for each
+	//            pair the first node is the lower-numbered one
+
+	std::sort (pairs.begin(), pairs.end());
+	auto pairsEnd = std::unique (pairs.begin(), pairs.end());
+	pairs.erase (pairsEnd, pairs.end());
+
+	if (contains(debug,"candidates"))
+		cerr << pairs.size() << " candidate pairs among " << numActive << " nodes"
+		     << " (" << numBands << " bands of " << bandBits << " bits)" << endl;
+
+	// compute the pairs' distances, in chunks, possibly in several threads
+
+	u32 numPairs = pairs.size();
+	vector<u64> pairDistances(numPairs);
+	u32 chunkSize = std::max (bitwise_tile_size(numBits), (numPairs + 4*numThreads-1) / (4*numThreads));
+	for_each_tile_pair (1, numPairs, chunkSize, numThreads, /*upperTriangle*/ false,
+		[&](u32 threadNum, u32 rowStart, u32 rowEnd, u32 pairStart, u32 pairEnd)
+			{
+			for (u32 pairIx=pairStart ; pairIx<pairEnd ; pairIx++)
+				pairDistances[pairIx] = hamming_distance (node[pairs[pairIx].first]->bits,
+				                                          node[pairs[pairIx].second]->bits,
+				                                          numBits);
+			});
+
+	for (u32 pairIx=0 ; pairIx<numPairs ; pairIx++)
+		{
+		u32 u = pairs[pairIx].first;
+		u32 v = pairs[pairIx].second;
+		u64 d = pairDistances[pairIx];
+		u32 h = 1 + std::max (node[u]->height,node[v]->height);
+		if (contains(debug,"distances"))
+			cerr << "node " << u << " vs " << "node " << v << " d=" << d << " h=" << h << endl;
+		if (contains(debug,"queue"))
+			cerr << "pushing (" << d << "," << h << "," << u << "," << v << ")" << endl;
+		MergeCandidate c = { d,h,u,v };
+		q.push (c);
+		neighbors[u].emplace_back(v);
+		neighbors[v].emplace_back(u);
+		}
+	}
+
+//----------
+//
+// plan_sketches--
+//	Decide how many bits to sample from each leaf's interval for its sketch,
+//	and which ones.
+//
+//----------
+//
+// Notes:
+//	(1)	A sketch is the leaf's bits at a fixed random sample of the interval's
+//		positions. The Hamming distance between two sketches is proportional
+//		(in expectation) to the distance between the full intervals, and the
+//		sketch of a union is the union of the sketches. So the clustering
+//		itself needs nothing but the sketches, and merging nodes doesn't
+//		involve reading anything from disk.
+//	(2)	The memory we account for is
+//		  - the sketches, one per active node (there are never more than one
+//		    per leaf), and the sample positions
+//		  - the queue and candidate lists, which depend only on the number of
+//		    leaves (for all-vs-all distances, the square of it)
+//		  - one full interval, as each leaf is read to make its sketch
+//		  - if we're culling, the full intervals that compute_det_ratio() has
+//		    resident at once; it visits the larger subtree first, so this is
+//		    at most three per level of a balanced tree
+//		Whatever remains of memoryBudget after the latter three goes to the
+//		sketches. Memory for the leaves' BitVector objects, and for the tree
+//		itself, is not counted.
+//	(3)	If the sketch would be as large as the interval, we don't sample; the
+//		"sketch" is then the interval itself.
+//
+//----------
+
+void ClusterCommand::plan_sketches()
+	{
+	u64 numBits       = endPosition - startPosition;
+	u64 intervalBytes = (numBits + 7) / 8;
+	u32 numLeaves     = leafVectors.size();
+
+	numClusterBits = numBits;
+	sketchPositions.clear();
+	if (not useSketches) return;
+
+	// estimate the memory needed by everything but the sketches; if
+	// all-vs-all distances won't fit, switch to candidate pairs
+
+	u64 numAllPairs   = ((u64) numLeaves) * (numLeaves-1) / 2;
+	u64 allPairsBytes = numAllPairs * sizeof(MergeCandidate);
+	if ((candidatesPerNode == 0) && (memoryBudget > 0) && (allPairsBytes > memoryBudget/2))
+		{
+		candidatesPerNode = defaultCandidatesPerNode;
+		cerr << "warning: distances between all pairs of leaves won't fit in --memory"
+		     << "; using --candidates=" << candidatesPerNode << endl;
+		}
+
+	u64 queueBytes;
+	if (candidatesPerNode == 0)
+		queueBytes = allPairsBytes;
+	else
+		queueBytes = ((u64) numLeaves) * lshBands * candidatesPerNode
+		           * (sizeof(MergeCandidate) + sizeof(std::pair<u32,u32>) + sizeof(u64) + 2*sizeof(u32));
+
+	u64 cullBytes = 0;
+	if (cullNodes)
+		{
+		u32 numLevels = 1;
+		while ((((u64) 1) << numLevels) < numLeaves) numLevels++;
+		cullBytes = 3 * (numLevels+2) * intervalBytes;
+		}
+
+	u64 fixedBytes = queueBytes + intervalBytes + cullBytes;
+
+	// each sketch bit costs one bit per leaf (plus one for the node being
+	// merged), and a u64 for its position
+
+	if (sketchBits == 0)
+		{
+		if (memoryBudget <= fixedBytes)
+			fatal ("error: --memory=" + std::to_string(memoryBudget)
+			     + " is too small for " + std::to_string(numLeaves) + " leaves"
+			     + " (we need more than " + std::to_string(fixedBytes) + " bytes"
+			     + " before making room for any sketches)");
+		sketchBits = (8 * (memoryBudget - fixedBytes)) / (numLeaves + 1 + 64);
+		if (sketchBits < numBits)
+			sketchBits = (sketchBits / 64) * 64;  // (whole words)
+		if (sketchBits == 0)
+			fatal ("error: --memory=" + std::to_string(memoryBudget)
+			     + " leaves no room for sketches of " + std::to_string(numLeaves) + " leaves");
+		}
+
+	if (sketchBits < numBits)
+		sketchBits = ((sketchBits + 63) / 64) * 64;  // (whole words)
+
+	if (sketchBits > numBits)
+		sketchBits = numBits;
+
+	u64 sketchBytes = ((numLeaves + 1) * sketchBits + 7) / 8;
+	if (sketchBits < numBits) sketchBytes += sketchBits * sizeof(u64);
+	if ((memoryBudget > 0) && (fixedBytes + sketchBytes > memoryBudget))
+		fatal ("error: " + std::to_string(sketchBits) + "-bit sketches"
+		     + " of " + std::to_string(numLeaves) + " leaves won't fit"
+		     + " in --memory=" + std::to_string(memoryBudget));
+
+	if (sketchBits < numBits)
+		{
+		// choose the sample positions by selection sampling, which produces
+		// them in increasing order
+
+		std::mt19937 prng(sketchSeed);
+		sketchPositions.reserve(sketchBits);
+		u64 numNeeded = sketchBits;
+		for (u64 pos=0 ; (pos<numBits) && (numNeeded>0) ; pos++)
+			{
+			std::uniform_int_distribution<u64> spinner(0,numBits-pos-1);
+			if (spinner(prng) >= numNeeded) continue;
+			sketchPositions.emplace_back(pos);
+			numNeeded--;
+			}
+		}
+
+	numClusterBits = sketchBits;
+
+	if (contains(debug,"sketch"))
+		cerr << "clustering on " << sketchBits << "-bit sketches"
+		     << " of the " << numBits << "-bit interval"
+		     << " (" << fixedBytes << " bytes for other data)" << endl;
+	}
+
+//----------
+//
+// load_leaf_nodes--
+//	Load the bit arrays for the leaves, and create a BinaryTree node for each.
+//
+//----------
+//
+// Notes:
+//	(1)	If we're clustering on sketches (see plan_sketches), the node's bit
+//		array is the sketch rather than the loaded interval. Leaves are then
+//		read one at a time, and each interval is discarded as soon as its
+//		sketch is made.
+//
+//----------
+
+void ClusterCommand::load_leaf_nodes
+   (BinaryTree** node)
+	{
+	u32 numLeaves = leafVectors.size();
+	u64 numSketchWords = (numClusterBits + 63) / 64;
+
+	for (u32 u=0 ; u<numLeaves ; u++)
+		{
+		BitVector* bv = leafVectors[u];
+		bv->load();
+
+		u64* bits = bv->bits->data();
+		if (useSketches)
+			{
+			const u64* intervalBits = bits;
+			bits = new u64[numSketchWords];
+			if (bits == nullptr)
+				fatal ("error: failed to allocate " + std::to_string(numSketchWords) + " words"
+				     + " for node " + std::to_string(u) + "'s sketch");
+			if (trackMemory)
+				cerr << "@+" << bits << " allocating sketch for node[" << u << "]" << endl;
+
+			if (sketchPositions.empty())
+				std::memcpy (/*to*/ bits, /*from*/ intervalBits, /*how much*/ numSketchWords*sizeof(u64));
 			else
-				{ node[v]->bCup = node[v]->bits; }
+				{
+				std::memset (bits, 0, numSketchWords*sizeof(u64));
+				for (u64 ix=0 ; ix<numClusterBits ; ix++)
+					{
+					u64 pos = sketchPositions[ix];
+					if (((intervalBits[pos/64] >> (pos%64)) & 1) == 1)
+						bits[ix/64] |= ((u64) 1) << (ix%64);
+					}
+				}
+			bv->discard_bits();
 			}
 
+		node[u] = new BinaryTree(u,bits);
+		if (node[u] == nullptr)
+			fatal ("error: failed to create BinaryTree for node[" + std::to_string(u) + "]");
+		if (trackMemory)
+			cerr << "@+" << node[u] << " creating BinaryTree for node[" << u << "] (" << bv->filename << ")" << endl;
+		node[u]->trackMemory = trackMemory;
+
+		if (contains(debug,"bits"))
+			{ cerr << u << ": ";  dump_bits (cerr, node[u]->bits);  cerr << endl; }
+		}
+	}
+
+//----------
+//
+// merge_nodes--
+//	Create a new node that is the union of two active nodes, and deactivate
+//	those two nodes.
+//
+//----------
+//
+// Arguments:
+//	BinaryTree**	node:	The node array.
+//	u32				u, v:	The nodes to merge.
+//	u32				w:		The new node's number; node[w] is set to the new
+//							.. node.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+
+void ClusterCommand::merge_nodes
+   (BinaryTree**	node,
+	u32				u,
+	u32				v,
+	u32				w)
+	{
+	u64 numBits = numClusterBits;
+	u64 numBytes = (numBits + 7) / 8;
+	u64 numWords = (numBits + 63) / 64;
+	u32 numLeaves = leafVectors.size();
+	bool keepBits = (cullNodes) && (not useSketches);
+
+	// create a new node w = union of (u,v)
+	//
+	// nota bene: the bit array is allocated in whole (zero-padded) words, as
+	//            for the leaves' vectors, since find_candidate_pairs() reads
+	//            it a word at a time
+
+	u64* wBits = new u64[numWords];
+	if (wBits == nullptr)
+		fatal ("error: failed to allocate " + std::to_string(numWords) + " words"
+		     + " for node " + std::to_string(w) + "'s bit array");
+	if (trackMemory)
+		cerr << "@+" << wBits << " allocating bits for node[" << w << "]"
+		     << " (merges node[" << u << "] and node[" << v << "])" << endl;
+
+	wBits[numWords-1] = 0;
+	bitwise_or (node[u]->bits, node[v]->bits, /*dst*/ wBits, numBits);
+
+	node[w] = new BinaryTree(w,wBits,node[u],node[v]);
+	if (node[w] == nullptr)
+		fatal ("error: failed to create BinaryTree for node[" + std::to_string(w) + "]");
+	if (trackMemory)
+		cerr << "@+" << node[w] << " creating BinaryTree for node[" << w << "]" << endl;
+	node[w]->trackMemory = trackMemory;
+
+	if (contains(debug,"bits"))
+		{ cerr << w << ": ";  dump_bits (cerr, wBits);  cerr << endl; }
+
+	// deactivate u and v by removing their bit arrays; if either was a
+	// leaf tell the corresonding bit vector it can get rid of its bits;
+	//
+	// note that if we're going to be culling, we move (or copy) the bit
+	// arrays to bCup rather than get rid of them; but sketches are no use for
+	// culling, which instead reads the leaves again (see compute_det_ratio)
+
+	if (keepBits)
+		{
 		if (u < numLeaves)
-			leafVectors[u]->discard_bits();
-		else if (!cullNodes)
 			{
+			node[u]->bCup = (u64*) new char[numBytes];
+			if (node[u]->bCup == nullptr)
+				fatal ("error: failed to allocate " + std::to_string(numBytes) + " bytes"
+				     + " for node " + std::to_string(u) + "'s bCup array");
 			if (trackMemory)
-				cerr << "@-" << node[u]->bits << " discarding bits for node[" << u << "]" << endl;
-			delete[] node[u]->bits;
+				cerr << "@+" << node[u]->bCup << " allocating bCup for node[" << u << "]" << endl;
+			std::memcpy (/*to*/ node[u]->bCup, /*from*/ node[u]->bits, /*how much*/ numBytes);
 			}
+		else
+			{ node[u]->bCup = node[u]->bits; }
 
 		if (v < numLeaves)
-			leafVectors[v]->discard_bits();
-		else if (!cullNodes)
 			{
+			node[v]->bCup = (u64*) new char[numBytes];
+			if (node[v]->bCup == nullptr)
+				fatal ("error: failed to allocate " + std::to_string(numBytes) + " bytes"
+				     + " for node " + std::to_string(v) + "'s bCup array");
 			if (trackMemory)
-				cerr << "@-" << node[v]->bits << " discarding bits for node[" << v << "]" << endl;
-			delete[] node[v]->bits;
+				cerr << "@+" << node[v]->bCup << " allocating bits for node[" << v << "]" << endl;
+			std::memcpy (/*to*/ node[v]->bCup, /*from*/ node[v]->bits, /*how much*/ numBytes);
 			}
+		else
+			{ node[v]->bCup = node[v]->bits; }
+		}
 
-		node[u]->bits = nullptr;
-		node[v]->bits = nullptr;
-
-		// add the distance to w from each active node
+	if ((u < numLeaves) && (not useSketches))
+		leafVectors[u]->discard_bits();
+	else if (!keepBits)
+		{
+		if (trackMemory)
+			cerr << "@-" << node[u]->bits << " discarding bits for node[" << u << "]" << endl;
+		delete[] node[u]->bits;
+		}
 
-		for (u32 x=0 ; x<w ; x++)
-			{
-			if (node[x]->bits == nullptr) continue; // x isn't active
-			u64 d = hamming_distance (node[x]->bits, wBits, numBits);
-			u32 h = 1 + std::max (height,node[x]->height);
-			if (contains(debug,"distances"))
-				cerr << "node " << x << " vs " << "node " << w << " d=" << d << " h=" << h << endl;
-			if (contains(debug,"queue"))
-				cerr << "pushing (" << d << "," << h << "," << x << "," << w << ")" << endl;
-			MergeCandidate c = { d,h,x,w };
-			q.push (c);
-			}
+	if ((v < numLeaves) && (not useSketches))
+		leafVectors[v]->discard_bits();
+	else if (!keepBits)
+		{
+		if (trackMemory)
+			cerr << "@-" << node[v]->bits << " discarding bits for node[" << v << "]" << endl;
+		delete[] node[v]->bits;
 		}
 
+	node[u]->bits = nullptr;
+	node[v]->bits = nullptr;
+	}
+
+//----------
+//
+// finish_root--
+//	Get rid of the root's bit array, make sure no other nodes were left
+//	unmerged, and install the root as treeRoot.
+//
+//----------
+
+void ClusterCommand::finish_root
+   (BinaryTree** node)
+	{
+	u32 numLeaves = leafVectors.size();
+	u32 numNodes  = 2*numLeaves - 1;
+
 	// get rid of the root
 	//
 	// note that if we're going to be culling, we move (or copy) the bit
@@ -760,7 +1432,7 @@ void ClusterCommand::cluster_greedily()
 
 	u32 root = numNodes-1;
 
-	if (cullNodes)
+	if ((cullNodes) && (not useSketches))
 		{  // (note that we assume the root cannot be a leaf)
 		node[root]->bCup = node[root]->bits;
 		}
@@ -784,7 +1456,7 @@ void ClusterCommand::cluster_greedily()
 		}
 
 	if (failure)
-		fatal ("internal error: cluster_greedily() sanity check failed");
+		fatal ("internal error: clustering sanity check failed");
 
 	treeRoot = node[root];
 	}
@@ -802,6 +1474,12 @@ void ClusterCommand::cluster_greedily()
 //		DeterminedFilter.  But the implementation here shares no code with
 //		that, instead making use of the simpler formula
 //		  bDet = bCap union complement of bCup
+//	(2)	If we clustered on sketches, the nodes have no bCup yet. We read each
+//		leaf's interval from disk when we reach it, and compute each other
+//		node's bCup as the union of its children's. The larger subtree is
+//		visited first, so that the number of subtrees whose results are
+//		resident while we visit a sibling is at most log2 of the number of
+//		leaves.
 // 
 //----------
 
@@ -816,6 +1494,42 @@ void ClusterCommand::compute_det_ratio
 	if ((node->children[0] == nullptr) != (node->children[1] == nullptr))
 		fatal ("internal error: node[" + std::to_string(node->nodeNum) + "] has only one child");
 
+	// if this is a non-leaf node, first process the descendents
+
+	if (not isLeaf)
+		{
+		BinaryTree* firstChild  = node->children[0];
+		BinaryTree* secondChild = node->children[1];
+		if ((useSketches) && (secondChild->numLeaves > firstChild->numLeaves))
+			std::swap (firstChild, secondChild);
+
+		compute_det_ratio(firstChild);
+		compute_det_ratio(secondChild);
+		}
+
+	// if we clustered on sketches, get bCup from the leaf's file, or from
+	// the children
+
+	if ((node->bCup == nullptr) && (useSketches))
+		{
+		node->bCup = (u64*) new char[numBytes];
+		if (node->bCup == nullptr)
+			fatal ("error: failed to allocate " + std::to_string(numBytes) + " bytes"
+			     + " for node " + std::to_string(node->nodeNum) + "'s bCup array");
+		if (trackMemory)
+			cerr << "@+" << node->bCup << " allocating bCup for node[" << node->nodeNum << "]" << endl;
+
+		if (isLeaf)
+			{
+			BitVector* bv = leafVectors[node->nodeNum];
+			bv->load();
+			std::memcpy (/*to*/ node->bCup, /*from*/ bv->bits->data(), /*how much*/ numBytes);
+			bv->discard_bits();
+			}
+		else
+			bitwise_or (node->children[0]->bCup, node->children[1]->bCup, /*dst*/ node->bCup, numBits);
+		}
+
 	if (node->bCup == nullptr)
 		fatal ("internal error: leaf node[" + std::to_string(node->nodeNum) + "] has no bCup");
 
@@ -848,11 +1562,6 @@ void ClusterCommand::compute_det_ratio
 		return;
 		}
 
-	// otherwise, this is a non-leaf node;  first, process the descendents
-
-	compute_det_ratio(node->children[0]);
-	compute_det_ratio(node->children[1]);
-
 	// compute bCap from the children
 	//
 	// for this node n with children c1 and c2,
@@ -1256,7 +1965,7 @@ void ClusterCommand::dump_bits
    (std::ostream&	out,
 	const u64*		bits)
 	{
-	u64		numBits = endPosition - startPosition;
+	u64		numBits = numClusterBits;
 	string	bitsString(numBits,'-');
 	u64*	scan = (u64*) bits;
 
@@ -5,6 +5,9 @@
 #include <cstdlib>
 #include <cstdint>
 #include <iostream>
+#include <vector>
+#include <queue>
+#include <functional>
 
 #include "bit_vector.h"
 #include "commands.h"
@@ -27,6 +30,9 @@ public:
 		height = 1;
 		if (child0 != nullptr) height = 1 + child0->height;
 		if (child1 != nullptr) height = std::max(height,1+child1->height);
+		numLeaves = ((child0 == nullptr) && (child1 == nullptr))? 1 : 0;
+		if (child0 != nullptr) numLeaves += child0->numLeaves;
+		if (child1 != nullptr) numLeaves += child1->numLeaves;
 		}
 
 	virtual ~BinaryTree()
@@ -46,7 +52,7 @@ public:
 				std::cerr << "@-" << bDet << " discarding bDet for node[" << nodeNum << "]" << std::endl;
 			}
 
-		if (bits != nullptr) delete bits;
+		if (bits != nullptr) delete[] bits;
 		if (bCup != nullptr) delete bCup;
 		if (bCap != nullptr) delete bCap;
 		if (bDet != nullptr) delete bDet;
@@ -59,6 +65,7 @@ public:
 	std::uint32_t nodeId;
 	bool fruitful;
 	std::uint32_t height;
+	std::uint32_t numLeaves;	// number of leaves in the subtree
 	std::uint64_t* bits;
 	std::uint64_t* bCup;		// union of all leaves in the subtree
 	std::uint64_t* bCap;		// inersection of all leaves in the subtree
@@ -72,12 +79,30 @@ public:
 	};
 
 
+struct MergeCandidate
+	{
+public:
+	std::uint64_t d;		// distance between u and v
+	std::uint32_t height;	// height of a subtree containing the u-v merger as
+							// .. its root
+	std::uint32_t u;		// one node (index into node)
+	std::uint32_t v;		// other node (index into node)
+	};
+
+bool operator>(const MergeCandidate& lhs, const MergeCandidate& rhs);
+
+
 class ClusterCommand: public Command
 	{
 public:
 	static const std::uint64_t defaultEndPosition = 100*1000;
 	static constexpr double defaultCullingThresholdSD = 2.0;  // (two standard deviations below the mean)
 	//static constexpr double defaultCullingThreshold = 0.2;  // (no longer used)
+	static const std::uint32_t defaultCandidatesPerNode = 10;
+	static const std::uint32_t defaultLshBands = 16;
+	static const std::uint32_t defaultLshBandBits = 12;
+	static const std::uint32_t lshSeed = 0x5EED1E55;
+	static const std::uint32_t sketchSeed = 0x5EED5CE7;
 
 public:
 	ClusterCommand(const std::string& name): Command(name),treeRoot(nullptr) {}
@@ -88,7 +113,17 @@ public:
 	virtual void parse (int _argc, char** _argv);
 	virtual int execute (void);
 	virtual void find_leaf_vectors (void);
+	virtual void plan_sketches (void);
 	virtual void cluster_greedily (void);
+	virtual void cluster_by_candidates (void);
+	virtual void find_candidate_pairs (BinaryTree** node,
+	                                   const std::vector<std::uint32_t>& activeNodes,
+	                                   std::uint32_t bandBits,
+	                                   std::vector<std::vector<std::uint32_t>>& neighbors,
+	                                   std::priority_queue<MergeCandidate, std::vector<MergeCandidate>, std::greater<MergeCandidate>>& q);
+	virtual void load_leaf_nodes (BinaryTree** node);
+	virtual void merge_nodes (BinaryTree** node, std::uint32_t u, std::uint32_t v, std::uint32_t w);
+	virtual void finish_root (BinaryTree** node);
 	virtual void compute_det_ratio (BinaryTree* node,bool isRoot=false);
 	virtual void determine_culling_threshold (BinaryTree* node,bool isRoot=false);
 	virtual void cull_nodes (BinaryTree* node,bool isRoot=false);
@@ -108,6 +143,13 @@ public:
 	double cullingThreshold;
 	bool renumberNodes;
 	bool inhibitBuild;
+	std::uint32_t candidatesPerNode; // zero => compute all-vs-all distances
+	std::uint32_t lshBands;
+	std::uint32_t lshBandBits;
+	std::uint32_t numThreads;
+	std::uint64_t memoryBudget;		// zero => no limit
+	std::uint64_t sketchBits;		// zero => derive from memoryBudget
+	bool useSketches;
 	bool trackMemory;
 
 	double detRatioSum;
@@ -115,6 +157,9 @@ public:
 	std::uint32_t detRatioDenom;
 
 	std::vector<BitVector*> leafVectors;
+	std::uint64_t numClusterBits;	// number of bits in the arrays we cluster on
+	std::vector<std::uint64_t> sketchPositions;	// interval positions sampled for
+									// .. each sketch; empty => all of them
 	BinaryTree* treeRoot;
 	std::vector<std::uint32_t> depthToNodeCount;
 	std::vector<std::uint32_t> depthToNodeId;
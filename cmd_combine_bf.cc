@@ -484,14 +484,17 @@ string CombineBFCommand::combine_bloom_filters ()
 		totalBitVectors += bf->numBitVectors;
 		}
 
-	// allocate the header, with enough room for a bfvectorinfo record for all
-	// of the component's bit vectors, and for the components' names
+	// allocate the header, with enough room for a bfvectorinfo record and a
+	// checksum for all of the component's bit vectors, and for the components'
+	// names
 	//
 	// nota bene: correctness of the file is sensitive to the order in which
 	//   .. we write the bit vectors and the names we give them; at read time,
 	//   .. these are interpreted by BloomFilter::identify_content()
 
 	u64 headerBytesNeeded = bffileheader_size(totalBitVectors);
+	u32 crcOffset = (u32) headerBytesNeeded;
+	headerBytesNeeded += bffileheader_crcs_size(totalBitVectors);
 	u32 namesStart = (u32) headerBytesNeeded;
 	u32 bfIx = 0;
 	for (const auto& bf : componentBfs)
@@ -518,17 +521,20 @@ string CombineBFCommand::combine_bloom_filters ()
 
 	// write a fake header to the file; after we write the rest of the file
 	// we'll rewind and write the real header; we do this because we don't know
-	// the component offsets and sizes until after we've written them
+	// the component offsets and sizes until after we've written them; as in
+	// BloomFilter::save(), we write to a temporary file and then replace the
+	// real file
 
 	memset (header, 0, headerSize);
 	header->magic      = bffileheaderMagicUn;
 	header->headerSize = (u32) sizeof(bffileprefix);
 
-	std::ofstream out (dstFilename, std::ios::binary | std::ios::trunc | std::ios::out);
+	string tempFilename = temp_filename (dstFilename);
+	std::ofstream out (tempFilename, std::ios::binary | std::ios::trunc | std::ios::out);
 	out.write ((char*)header, headerSize);
 	size_t bytesWritten = headerSize; // (based on assumption of success)
 	if (not out)
-		fatal ("error: failed to open \"" + dstFilename + "\"");
+		fatal ("error: failed to open \"" + tempFilename + "\"");
 
 	// start the real header
 
@@ -536,7 +542,7 @@ string CombineBFCommand::combine_bloom_filters ()
 	header->headerSize   = headerSize;
 	header->version      = bffileheaderVersion;
 	header->bfKind       = modelBf->kind();
-	header->padding1     = 0;
+	header->crcOffset    = crcOffset;
 	header->kmerSize     = modelBf->kmerSize;
 	header->numHashes    = modelBf->numHashes;
 	header->hashSeed1    = modelBf->hashSeed1;
@@ -550,6 +556,7 @@ string CombineBFCommand::combine_bloom_filters ()
 
 	// write the component(s)
 
+	u32* crcs = (u32*) (((char*) header) + crcOffset);
 	size_t nameOffset = (u64) namesStart;
 
 	u32 bvIx = 0;
@@ -564,16 +571,22 @@ string CombineBFCommand::combine_bloom_filters ()
 			header->info[bvIx].compressor = bv->compressor();
 			if ((header->info[bvIx].compressor == bvcomp_rrr)
 			 || (header->info[bvIx].compressor == bvcomp_unc_rrr))
-				header->info[bvIx].compressor |= (RRR_BLOCK_SIZE << 8);
+				{
+				RrrBitVector* rrrBv = (RrrBitVector*) bv;
+				header->info[bvIx].compressor |= (rrrBv->rrrBlockSize  << 8);
+				header->info[bvIx].compressor |= (rrrBv->rrrRankPeriod << 16);
+				}
 			header->info[bvIx].offset = bytesWritten;
 
 			// $$$ we *could* just copy the bytes, instead of loading the bv and
 			// $$$ .. then re-serializing it
-			size_t numBytes = bv->serialized_out (out);
+			u32 crc;
+			size_t numBytes = bv->checksummed_out (out, crc);
 			bytesWritten += numBytes;
 
 			header->info[bvIx].numBytes   = numBytes;
 			header->info[bvIx].filterInfo = bv->filterInfo;
+			crcs[bvIx] = crc;
 
 			header->info[bvIx].name = nameOffset;
 			string name = componentNames[bfIx];
@@ -589,8 +602,12 @@ string CombineBFCommand::combine_bloom_filters ()
 
 	out.seekp(std::ios::beg);
 	out.write ((char*)header, headerSize);
+	if (not out)
+		fatal ("error: problem writing \"" + tempFilename + "\"");
 	out.close();
 
+	commit_temp_file (tempFilename, dstFilename);
+
 	// clean up
 
 	for (const auto& bf : componentBfs)
@@ -64,6 +64,12 @@ void CompressBFCommand::usage
 	s << "  --roar               copy the filter(s) to roar-compressed bit vector(s)" << endl;
 	s << "  --uncompressed       copy the filter(s) to uncompressed bit vector(s)" << endl;
 	s << "                       (this may be very slow)" << endl;
+	s << "  --rrr-block=<N>      rrr block size; this is one of 63, 127 or 255" << endl;
+	s << "                       (default is " << RRR_BLOCK_SIZE << ")" << endl;
+	s << "  --rrr-period=<N>     rrr rank period, the number of blocks per rank sample;" << endl;
+	s << "                       this is one of 8, 16, 32 or 64; smaller periods give" << endl;
+	s << "                       faster rank/select at the cost of larger files" << endl;
+	s << "                       (default is " << RRR_RANK_PERIOD << ")" << endl;
 	}
 
 void CompressBFCommand::debug_help
@@ -85,6 +91,8 @@ void CompressBFCommand::parse
 
 	listFilename        = "";
 	dstCompressor       = bvcomp_rrr;
+	rrrBlockSize        = RRR_BLOCK_SIZE;
+	rrrRankPeriod       = RRR_RANK_PERIOD;
 	inhibitBvSimplify   = false;
 
 	bool inhibitOutTree = false;
@@ -171,6 +179,20 @@ void CompressBFCommand::parse
 		 || (arg == "--roaring"))
 			{ dstCompressor = bvcomp_roar;  continue; }
 
+		// --rrr-block=<N>, --rrr-period=<N>
+
+		if ((is_prefix_of (arg, "--rrr-block="))
+		 ||	(is_prefix_of (arg, "--rrrblock="))
+		 ||	(is_prefix_of (arg, "--rrr-blocksize="))
+		 ||	(is_prefix_of (arg, "--rrrblocksize=")))
+			{ rrrBlockSize = string_to_u32(argVal);  continue; }
+
+		if ((is_prefix_of (arg, "--rrr-period="))
+		 ||	(is_prefix_of (arg, "--rrrperiod="))
+		 ||	(is_prefix_of (arg, "--rrr-rankperiod="))
+		 ||	(is_prefix_of (arg, "--rrrrankperiod=")))
+			{ rrrRankPeriod = string_to_u32(argVal);  continue; }
+
 		// (unadvertised) special compressor types
 
 		if (arg == "--uncrrr")
@@ -224,6 +246,16 @@ void CompressBFCommand::parse
 			chastise ("cannot use both --list and --tree");
 		}
 
+	if (not RrrBits::valid_parameters(rrrBlockSize,rrrRankPeriod))
+		chastise ("rrr block size " + std::to_string(rrrBlockSize)
+		        + " with rank period " + std::to_string(rrrRankPeriod)
+		        + " is not supported");
+
+	if (((rrrBlockSize != RRR_BLOCK_SIZE) || (rrrRankPeriod != RRR_RANK_PERIOD))
+	 && (dstCompressor != bvcomp_rrr)
+	 && (dstCompressor != bvcomp_unc_rrr))
+		chastise ("--rrr-block and --rrr-period can only be used with --rrr");
+
 	if ((not outTreeFilename.empty()) and (inTreeFilename.empty()))
 		chastise ("cannot use --outtree unless you provide the input tree");
 
@@ -253,6 +285,13 @@ int CompressBFCommand::execute()
 	if (contains(debug,"bfsimplify"))
 		BloomFilter::reportSimplify = true;
 
+	// nota bene: any rrr vector we create gets the default block size and
+	//            rank period; an rrr source compressed differently is
+	//            decompressed when it is copied
+
+	RrrBitVector::defaultBlockSize  = rrrBlockSize;
+	RrrBitVector::defaultRankPeriod = rrrRankPeriod;
+
 	if (not bfFilenames.empty())
 		{
 		for (const auto& bfFilename : bfFilenames)
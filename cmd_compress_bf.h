@@ -26,6 +26,8 @@ public:
 	std::string outTreeFilename;
 	std::string dstFilenameTemplate;
 	std::uint32_t dstCompressor;
+	std::uint32_t rrrBlockSize;
+	std::uint32_t rrrRankPeriod;
 	bool inhibitBvSimplify;
 	bool trackMemory;
 	};
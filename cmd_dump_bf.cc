@@ -570,17 +570,17 @@ void DumpBFCommand::dump_one_bloom_filter
 				rankSupported = true;
 
 				RrrBitVector* rrrBv = (RrrBitVector*) bv;
-				rrrrank0   bvRanker0(rrrBv->rrrBits);
-				rrrrank1   bvRanker1(rrrBv->rrrBits);
-				rrrselect0 bvSelector0(rrrBv->rrrBits);
-				rrrselect1 bvSelector1(rrrBv->rrrBits);
+				RrrRankSupport*   bvRanker0   = rrrBv->rrrBits->new_rank0();
+				RrrRankSupport*   bvRanker1   = rrrBv->rrrBits->new_rank1();
+				RrrSelectSupport* bvSelector0 = rrrBv->rrrBits->new_select0();
+				RrrSelectSupport* bvSelector1 = rrrBv->rrrBits->new_select1();
 
-				size_t numZeros = bvRanker0(rrrBv->numBits);
-				size_t numOnes  = bvRanker1(rrrBv->numBits);
+				size_t numZeros = bvRanker0->rank(rrrBv->numBits);
+				size_t numOnes  = bvRanker1->rank(rrrBv->numBits);
 
 				for (u64 pos=startPos ; pos<bvEndPos ; pos++)
 					{
-					u64 posRank = bvRanker0.rank(pos);
+					u64 posRank = bvRanker0->rank(pos);
 					rank0Ss << " " << std::setfill(' ') << std::setw(onesCountWidth) << std::to_string(posRank);
 					}
 
@@ -590,14 +590,14 @@ void DumpBFCommand::dump_one_bloom_filter
 						select0Ss << " " << std::setfill(' ') << std::setw(onesCountWidth) << "*";
 					else
 						{
-						u64 posSelect = bvSelector0.select(pos);
+						u64 posSelect = bvSelector0->select(pos);
 						select0Ss << " " << std::setfill(' ') << std::setw(onesCountWidth) << std::to_string(posSelect);
 						}
 					}
 
 				for (u64 pos=startPos ; pos<bvEndPos ; pos++)
 					{
-					u64 posRank = bvRanker1.rank(pos);
+					u64 posRank = bvRanker1->rank(pos);
 					rank1Ss << " " << std::setfill(' ') << std::setw(onesCountWidth) << std::to_string(posRank);
 					}
 
@@ -607,10 +607,15 @@ void DumpBFCommand::dump_one_bloom_filter
 						select1Ss << " " << std::setfill(' ') << std::setw(onesCountWidth) << "*";
 					else
 						{
-						u64 posSelect = bvSelector1.select(pos);
+						u64 posSelect = bvSelector1->select(pos);
 						select1Ss << " " << std::setfill(' ') << std::setw(onesCountWidth) << std::to_string(posSelect);
 						}
 					}
+
+				delete bvRanker0;
+				delete bvRanker1;
+				delete bvSelector0;
+				delete bvSelector1;
 				}
 
 			if (rankSupported)
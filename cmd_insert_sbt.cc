@@ -0,0 +1,743 @@
+// cmd_insert_sbt.cc-- insert new leaves into a sequence bloom tree, rebuilding
+//                     only the nodes on their paths to the root
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "utilities.h"
+#include "bit_utilities.h"
+#include "bloom_tree.h"
+#include "file_manager.h"
+
+#include "support.h"
+#include "commands.h"
+#include "cmd_insert_sbt.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+#define u8  std::uint8_t
+#define u32 std::uint32_t
+#define u64 std::uint64_t
+
+
+void InsertSBTCommand::short_description
+   (std::ostream& s)
+	{
+	s << commandName << "-- add leaves to a tree, rebuilding only their paths to the root" << endl;
+	}
+
+void InsertSBTCommand::usage
+   (std::ostream& s,
+	const string& message)
+	{
+	if (!message.empty())
+		{
+		s << message << endl;
+		s << endl;
+		}
+
+	short_description(s);
+	s << "usage: " << commandName << " <topology> <filename> [<filename>..] [options]" << endl;
+	//    123456789-123456789-123456789-123456789-123456789-123456789-123456789-123456789
+	s << "  <topology>           name of the topology file for a tree that has been built" << endl;
+	s << "  <filename>           a bloom filter to add to the tree as a leaf; only filters" << endl;
+	s << "                       with uncompressed bit vectors are allowed" << endl;
+	s << "  --list=<filename>    file containing a list of bloom filters to add" << endl;
+	s << "  --out=<filename>     name for the resulting tree toplogy file" << endl;
+	s << "                       (by default the input topology file is replaced)" << endl;
+	s << "  --nodename=<template> filename template for new internal tree nodes" << endl;
+	s << "                       this must contain the substring {number}" << endl;
+	s << "                       (by default this is derived from the topology filename)" << endl;
+	s << "  <start>..<end>       interval of bits to use from each filter, to decide where" << endl;
+	s << "                       in the tree a leaf belongs; this should be the same as" << endl;
+	s << "                       was used for the cluster command" << endl;
+	s << "                       (by default we use the first " << defaultEndPosition << " bits)" << endl;
+	s << "  --bits=<N>           number of bits to use from each filter; same as 0..<N>" << endl;
+	s << "  --memory=<bytes>     bound on the memory used for the existing nodes beside" << endl;
+	s << "                       the new leaves' paths (e.g. 8G); when this is reached the" << endl;
+	s << "                       leaves placed so far are built, and the remaining leaves" << endl;
+	s << "                       are inserted into the result" << endl;
+	s << "                       (default is " << (defaultMemoryBudget/(1024*1024*1024)) << "G)" << endl;
+	s << endl;
+	s << "Each new leaf is placed by descending from the root toward the child that is" << endl;
+	s << "closest to it (by Hamming distance over the bit interval), until we reach a" << endl;
+	s << "leaf; a new node then replaces that leaf, with that leaf and the new leaf as" << endl;
+	s << "its children. Only the nodes on the new leaves' paths to the root are computed" << endl;
+	s << "anew, and their other children are rewritten; no other files are modified." << endl;
+	s << "The tree keeps the node type and compression it was built with." << endl;
+	}
+
+void InsertSBTCommand::debug_help
+   (std::ostream& s)
+	{
+	s << "--debug= options" << endl;
+	s << "  trackmemory" << endl;
+	s << "  topology" << endl;
+	s << "  placement" << endl;
+	s << "  traversal" << endl;
+	}
+
+void InsertSBTCommand::parse
+   (int		_argc,
+	char**	_argv)
+	{
+	int		argc;
+	char**	argv;
+
+	// defaults
+
+	startPosition = 0;
+	endPosition   = defaultEndPosition;
+	memoryBudget  = defaultMemoryBudget;
+
+	// skip command name
+
+	argv = _argv+1;  argc = _argc - 1;
+	if (argc <= 0) chastise ();
+
+	//////////
+	// scan arguments
+	//////////
+
+	for (int argIx=0 ; argIx<argc ; argIx++)
+		{
+		string arg = argv[argIx];
+		string argVal;
+		if (arg.empty()) continue;
+
+		string::size_type argValIx = arg.find('=');
+		if (argValIx == string::npos) argVal = "";
+		                         else argVal = arg.substr(argValIx+1);
+
+		// --help, etc.
+
+		if ((arg == "--help")
+		 || (arg == "-help")
+		 || (arg == "--h")
+		 || (arg == "-h")
+		 || (arg == "?")
+		 || (arg == "-?")
+		 || (arg == "--?"))
+			{ usage (cerr);  std::exit (EXIT_SUCCESS); }
+
+		if ((arg == "--help=debug")
+		 || (arg == "--help:debug")
+		 || (arg == "?debug"))
+			{ debug_help(cerr);  std::exit (EXIT_SUCCESS); }
+
+		// --list=<filename>
+
+		if (is_prefix_of (arg, "--list="))
+			{
+			if (not listFilename.empty())
+				chastise ("unrecognized option: \"" + arg + "\""
+				          "\nbloom filters list file was already given as \"" + listFilename + "\"");
+			listFilename = argVal;
+			continue;
+			}
+
+		// --out=<filename>, etc.
+
+		if ((is_prefix_of (arg, "--out="))
+		 || (is_prefix_of (arg, "--output="))
+		 || (is_prefix_of (arg, "--outtree=")))
+			{ outTreeFilename = argVal;  continue; }
+
+		// --nodename=<template>
+
+		if ((is_prefix_of (arg, "--nodename="))
+		 || (is_prefix_of (arg, "--nodenames="))
+		 || (is_prefix_of (arg, "--node=")))
+			{
+			nodeTemplate = argVal;
+			if (nodeTemplate.find ("{number}") == string::npos)
+				chastise ("--nodename is required to contain the substring \"{number}\"");
+			if (not is_suffix_of(nodeTemplate,".bf"))
+				nodeTemplate = nodeTemplate + ".bf";
+			continue;
+			}
+
+		// --bits=<N>
+
+		if ((is_prefix_of (arg, "--bits="))
+		 || (is_prefix_of (arg, "B="))
+		 || (is_prefix_of (arg, "--B=")))
+			{
+			startPosition = 0;
+			endPosition   = string_to_unitized_u64(argVal);
+			continue;
+			}
+
+		// --memory=<bytes>
+
+		if ((is_prefix_of (arg, "--memory="))
+		 ||	(is_prefix_of (arg, "--mem=")))
+			{
+			memoryBudget = string_to_unitized_u64(argVal,/*unitScale*/ 1024);
+			if (memoryBudget == 0)
+				chastise ("--memory cannot be zero (\"" + arg + "\")");
+			continue;
+			}
+
+		// (unadvertised) --tree=<filename>, --topology=<filename>
+
+		if ((is_prefix_of (arg, "--tree="))
+		 ||	(is_prefix_of (arg, "--intree="))
+		 ||	(is_prefix_of (arg, "--topology=")))
+			{
+			if (not inTreeFilename.empty())
+				chastise ("unrecognized option: \"" + arg + "\""
+				          "\ntree topology file was already given as \"" + inTreeFilename + "\"");
+			inTreeFilename = argVal;
+			continue;
+			}
+
+		// (unadvertised) debug options
+
+		if (arg == "--debug")
+			{ debug.insert ("debug");  continue; }
+
+		if (is_prefix_of (arg, "--debug="))
+			{
+		    for (const auto& field : parse_comma_list(argVal))
+				debug.insert(to_lower(field));
+			continue;
+			}
+
+		// unrecognized --option
+
+		if (is_prefix_of (arg, "--"))
+			chastise ("unrecognized option: \"" + arg + "\"");
+
+		// <start>..<end>
+
+		std::size_t separatorIx = arg.find ("..");
+		if (separatorIx != string::npos)
+			{
+			startPosition = string_to_unitized_u64(arg.substr (0, separatorIx));
+			endPosition   = string_to_unitized_u64(arg.substr (separatorIx+2));
+			if (endPosition <= startPosition)
+				chastise ("bad interval: " + arg + " (end <= start)");
+			continue;
+			}
+
+		// <topology>, <filename>
+
+		if (inTreeFilename.empty())
+			inTreeFilename = arg;
+		else
+			leafFilenames.emplace_back(strip_blank_ends(arg));
+		}
+
+	// sanity checks
+
+	if (startPosition % 8 != 0)
+		chastise ("the bit interval's start (" + std::to_string(startPosition)
+		        + ") has to be a multiple of 8");
+
+	if (inTreeFilename.empty())
+		chastise ("you have to provide a tree topology file");
+
+	if ((leafFilenames.empty()) and (listFilename.empty()))
+		chastise ("you have to provide at least one bloom filter to add to the tree");
+
+	if (outTreeFilename.empty())
+		outTreeFilename = inTreeFilename;
+
+	if (nodeTemplate.empty())
+		{
+		string treeName = strip_file_path(inTreeFilename);
+		if (is_suffix_of(treeName,".sbt"))
+			treeName = strip_suffix(treeName,".sbt");
+		nodeTemplate = BloomFilter::strip_filter_suffix(treeName) + "{number}.bf";
+		}
+
+	return;
+	}
+
+InsertSBTCommand::~InsertSBTCommand()
+	{
+	if (modelBf != nullptr) delete modelBf;
+	for (const auto& item : unfinished)
+		delete item.second;
+	}
+
+
+int InsertSBTCommand::execute()
+	{
+	trackMemory = false;
+	if (contains(debug,"trackmemory"))
+		{
+		trackMemory              = true;
+		FileManager::trackMemory = true;
+		BloomTree::trackMemory   = true;
+		BloomFilter::trackMemory = true;
+		BitVector::trackMemory   = true;
+		}
+
+	// collect the names of the filters to add
+
+	if (not listFilename.empty())
+		{
+		std::ifstream in (listFilename);
+		if (not in)
+			fatal ("error: failed to open \"" + listFilename + "\"");
+
+		string line;
+		while (std::getline (in, line))
+			{
+			string bfFilename = strip_blank_ends(line);
+			if (bfFilename.empty()) continue;
+			leafFilenames.emplace_back(bfFilename);
+			}
+		in.close();
+		}
+
+	if (leafFilenames.empty())
+		fatal ("error: \"" + listFilename + "\" contains no bloom filters");
+
+	// insert the leaves, in batches; each batch is built, and its topology
+	// written, before the next one begins, so the next one starts from that
+	// tree (see insert_batch)
+
+	numBatches   = 0;
+	numComputed  = 0;
+	numRewritten = 0;
+	string treeFilename = inTreeFilename;
+	size_t leafIx = 0;
+	while (leafIx < leafFilenames.size())
+		{
+		leafIx = insert_batch(treeFilename,leafIx);
+		treeFilename = outTreeFilename;
+		}
+
+	cerr << "inserted " << leafFilenames.size() << " leaves"
+	     << ((numBatches > 1)? " in " + std::to_string(numBatches) + " batches" : string(""))
+	     << ", " << numComputed << " nodes were computed anew"
+	     << " and " << numRewritten << " others were rewritten" << endl;
+
+	return EXIT_SUCCESS;
+	}
+
+//----------
+//
+// insert_batch--
+//	Insert as many of the remaining leaves into the tree as memory allows,
+//	build the affected nodes, and write the resulting topology.
+//
+//----------
+//
+// Arguments:
+//	const string&	treeFilename:	The topology file of the tree to insert
+//									.. into.
+//	size_t			leafIx:			Index (into leafFilenames) of the first
+//									.. leaf to insert.
+//
+// Returns:
+//	The index of the first leaf that was not inserted; this is the number of
+//	leaves if all have been inserted.
+//
+//----------
+//
+// Notes:
+//	(1)	We hold the unfinished form of every existing node beside the new
+//		leaves' paths, until those nodes are rewritten at the end of the batch.
+//		That is one filter for each such node, so we end the batch once those
+//		would exceed memoryBudget. At least one leaf is inserted in each batch,
+//		so a single leaf's path may exceed the budget.
+//	(2)	The unfinished forms of nodes *on* the paths are only needed until
+//		their children have been reconstructed, so insert_leaf discards them
+//		as it descends.
+//
+//----------
+
+size_t InsertSBTCommand::insert_batch
+   (const string&	treeFilename,
+	size_t			leafIx)
+	{
+	// read the tree; if this is the first batch, figure out how it was built
+
+	BloomTree* root = BloomTree::read_topology(treeFilename);
+	if (not root->packFilename.empty())
+		fatal ("error: \"" + treeFilename + "\" is a packed tree file"
+		       " (leaves can't be inserted into it)");
+	if (root->nodesShareFiles)
+		fatal ("error: nodes in \"" + treeFilename + "\" share files"
+		       " (leaves can't be inserted into such a tree)");
+
+	vector<BloomTree*> order;
+	if (numBatches == 0)
+		{
+		if (contains(debug,"topology"))
+			root->print_topology(cerr,/*level*/0,/*format*/topofmt_nodeNames);
+
+		identify_tree(root);
+
+		root->pre_order(order);
+		for (const auto& node : order)
+			nodeNames.insert(node->name);
+		nodeNumber = 0;
+		}
+	numBatches++;
+
+	// place each new leaf in the tree; as we descend we reconstruct the
+	// unfinished forms of the existing nodes we encounter (see
+	// BloomTree::unfinished_filter), starting with the root
+
+	if (not root->is_dummy())
+		{
+		BloomFilter* rootBf = root->unfinished_filter(/*parentBf*/ nullptr);
+		unfinished[root] = rootBf;
+		interval_union_bits(rootBf,unionBits[root]);
+		}
+
+	u64 unfinishedBytes = ((bfKind == bfkind_simple)? 1 : 2)
+	                    * ((modelBf->numBits + 7) / 8);
+	while (leafIx < leafFilenames.size())
+		{
+		root = insert_leaf(root,leafFilenames[leafIx++]);
+		if (unfinished.size() * unfinishedBytes > memoryBudget) break;
+		}
+
+	if (leafIx < leafFilenames.size())
+		cerr << "building the tree after " << leafIx << " leaves"
+		     << " (" << unfinished.size() << " unfinished filters reached --memory)" << endl;
+
+	// the nodes we passed through will be computed anew, so we no longer need
+	// their unfinished forms; every other node we reconstructed is a child of
+	// one of those, and its parent will need to finish it again
+
+	for (const auto& item : unfinished)
+		{
+		BloomTree*   node         = item.first;
+		BloomFilter* unfinishedBf = item.second;
+		if (rebuild.count(node) > 0)
+			{
+			if (trackMemory)
+				cerr << "@-" << unfinishedBf << " discarding unfinished filter for " << node->bfFilename << endl;
+			delete unfinishedBf;
+			}
+		else
+			{
+			node->adopt_unfinished(unfinishedBf,compressor);
+			if (bfKind != bfkind_simple) numRewritten++;
+			}
+		}
+	unfinished.clear();
+	unionBits.clear();
+
+	// build the nodes that need it
+
+	order.clear();
+	root->post_order(order);
+	for (const auto& node : order)
+		{
+		node->reportSave   = true;
+		node->dbgTraversal = (contains(debug,"traversal"));
+		}
+
+	root->construct_nodes (bfKind, compressor);
+	numComputed += rebuild.size();
+	rebuild.clear();
+
+	// write the new topology
+
+	string tempFilename = temp_filename (outTreeFilename);
+	std::ofstream out (tempFilename);
+	if (not out)
+		fatal ("error: failed to open \"" + tempFilename + "\"");
+	root->print_topology(out);
+	out.close();
+	if (out.fail())
+		fatal ("error: problem writing \"" + tempFilename + "\"");
+	commit_temp_file (tempFilename, outTreeFilename);
+
+	FileManager::close_file();	// make sure the last bloom filter file we
+								// .. opened for read gets closed
+
+	delete root;
+	return leafIx;
+	}
+
+//----------
+//
+// identify_tree--
+//	Determine the kind of tree, and the compressor it was built with, and
+//	capture the properties new leaves must be consistent with.
+//
+//----------
+
+void InsertSBTCommand::identify_tree
+   (BloomTree* root)
+	{
+	root->identify_build(bfKind,compressor);
+
+	vector<BloomTree*> order;
+	root->pre_order(order);
+	BloomFilter* bf = BloomFilter::bloom_filter(order.front()->bfFilename);
+	bf->preload();
+	modelBf = new BloomFilter(bf);
+	delete bf;
+
+	if (endPosition > modelBf->numBits)
+		{
+		if (modelBf->numBits <= startPosition)
+			fatal ("error: the tree's filters have only " + std::to_string(modelBf->numBits) + " bits"
+			     + ", so the bit interval "
+			     + std::to_string(startPosition) + ".."  + std::to_string(endPosition)
+			     + " would be empty");
+		endPosition = modelBf->numBits;
+		cerr << "warning: reducing bit interval to " << startPosition << ".." << endPosition << endl;
+		}
+
+	if (contains(debug,"placement"))
+		cerr << "tree is " << BloomFilter::filter_kind_to_string(bfKind,false)
+		     << ", " << BitVector::compressor_to_string(compressor) << endl;
+	}
+
+//----------
+//
+// insert_leaf--
+//	Add a leaf to the tree, placing it near the leaves that are most like it.
+//
+//----------
+//
+// Arguments:
+//	BloomTree*		root:			The tree's root.
+//	const string&	leafFilename:	The file containing the new leaf's filter.
+//
+// Returns:
+//	The tree's root; this is different than the incoming root only if the tree
+//	was a single leaf.
+//
+//----------
+//
+// Notes:
+//	(1)	The new leaf isn't built here; we mark it, and the nodes on its path to
+//		the root, as needing to be computed anew. The union bits of the nodes
+//		on the path are updated, so that later leaves are placed as if this
+//		leaf had been in the tree all along.
+//
+//----------
+
+BloomTree* InsertSBTCommand::insert_leaf
+   (BloomTree*		root,
+	const string&	leafFilename)
+	{
+	u64 numIntervalBits = endPosition - startPosition;
+
+	// read the filter's header and verify filter consistency and vector
+	// type; note that this does *not* load the bit vector
+
+	BloomFilter* leafBf = new BloomFilter (leafFilename);
+	leafBf->preload();
+	if (leafBf->numBitVectors != 1)
+		fatal ("error: \"" + leafFilename + "\" contains more than one bit vector");
+	BitVector* bv = leafBf->get_bit_vector(0);
+	if (bv->compressor() != bvcomp_uncompressed)
+		fatal ("error: bit vectors in \"" + leafFilename + "\" are not uncompressed");
+	modelBf->is_consistent_with (leafBf, /*beFatal*/ true);
+
+	string leafName = BloomFilter::strip_filter_suffix(strip_file_path(leafFilename));
+	if (nodeNames.count(leafName) > 0)
+		fatal ("error: the tree already contains a node named \"" + leafName + "\""
+		       " (for \"" + leafFilename + "\")");
+	nodeNames.insert(leafName);
+
+	// read the leaf's bit interval, as a "raw" bit vector
+
+	size_t startOffset = bv->offset + sdslbitvectorHeaderBytes + startPosition/8;
+	string rawFilename = bv->filename
+	                   + ":raw"
+	                   + ":" + std::to_string(startOffset)
+	                   + ":" + std::to_string(numIntervalBits);
+	delete leafBf;
+
+	BitVector* rawBv = BitVector::bit_vector(rawFilename);
+	rawBv->load();
+
+	BloomTree* leaf = new BloomTree(leafName,leafFilename);
+	vector<u64>& leafBits = unionBits[leaf];
+	leafBits.assign((numIntervalBits+63)/64,0);
+	std::memcpy (leafBits.data(), rawBv->bits->data(), (numIntervalBits+7)/8);
+	if (numIntervalBits % 64 != 0)
+		leafBits.back() &= (((u64) 1) << (numIntervalBits % 64)) - 1;
+	delete rawBv;
+	rebuild.insert(leaf);
+
+	// descend to the closest leaf
+
+	BloomTree* node = root;
+	while (not node->is_leaf())
+		{
+		find_child_union_bits(node);
+		if (not node->is_dummy())
+			{
+			// (every child has been reconstructed, and this node will be
+			// computed anew, so its unfinished form is no longer needed)
+			auto iter = unfinished.find(node);
+			if (iter != unfinished.end())
+				{
+				if (trackMemory)
+					cerr << "@-" << iter->second << " discarding unfinished filter for " << node->bfFilename << endl;
+				delete iter->second;
+				unfinished.erase(iter);
+				}
+			}
+
+		BloomTree* closest = nullptr;
+		u64 closestDistance = 0;
+		for (const auto& child : node->children)
+			{
+			u64 d = hamming_distance(unionBits[child].data(), leafBits.data(), numIntervalBits);
+			if ((closest == nullptr) or (d < closestDistance))
+				{ closest = child;  closestDistance = d; }
+			}
+
+		if (not node->is_dummy())
+			{
+			rebuild.insert(node);
+			bitwise_or (/*dst*/ unionBits[node].data(), leafBits.data(), numIntervalBits);
+			}
+
+		if (contains(debug,"placement"))
+			cerr << leafName << ": "
+			     << ((node->is_dummy())? "(dummy node)" : node->name)
+			     << " -> " << closest->name << " (d=" << closestDistance << ")" << endl;
+
+		node = closest;
+		}
+
+	// replace that leaf with a new node, having the old and new leaves as its
+	// children
+
+	string nodeFilename = next_node_filename();
+	string nodeName = BloomFilter::strip_filter_suffix(strip_file_path(nodeFilename));
+	BloomTree* newNode = new BloomTree(nodeName,nodeFilename);
+
+	if (node->parent == nullptr)
+		root = newNode;
+	else
+		node->parent->replace_child(node,newNode);
+	newNode->add_child(node);
+	newNode->add_child(leaf);
+
+	vector<u64>& nodeBits = unionBits[newNode];
+	nodeBits = unionBits[node];
+	bitwise_or (/*dst*/ nodeBits.data(), leafBits.data(), numIntervalBits);
+	rebuild.insert(newNode);
+
+	if (contains(debug,"placement"))
+		cerr << leafName << ": placed as sibling of " << node->name
+		     << ", under new node " << nodeName << endl;
+
+	return root;
+	}
+
+//----------
+//
+// find_child_union_bits--
+//	Make sure we know the union bits, over the bit interval, for each of a
+//	node's children.
+//
+//----------
+//
+// Notes:
+//	(1)	A child we haven't seen before is an existing node, and its parent is
+//		too (new nodes are only created with children we've already seen). So
+//		we have the parent's unfinished form, and can reconstruct the child's.
+//
+//----------
+
+void InsertSBTCommand::find_child_union_bits
+   (BloomTree* node)
+	{
+	const BloomFilter* parentBf = nullptr;
+	if (not node->is_dummy())
+		{
+		auto iter = unfinished.find(node);
+		if (iter != unfinished.end()) parentBf = iter->second;
+		}
+
+	for (const auto& child : node->children)
+		{
+		if (unionBits.count(child) > 0) continue;
+
+		if ((not node->is_dummy()) and (parentBf == nullptr))
+			fatal ("internal error: in find_child_union_bits(\"" + node->name + "\")"
+			     + ", the node's unfinished form is not known");
+
+		BloomFilter* childBf = child->unfinished_filter(parentBf);
+		unfinished[child] = childBf;
+		interval_union_bits(childBf,unionBits[child]);
+		}
+	}
+
+//----------
+//
+// interval_union_bits--
+//	Extract, from a node's unfinished filter, the union of the leaves below
+//	the node, over the bit interval.
+//
+//----------
+//
+// Notes:
+//	(1)	In the unfinished form (see the comments in the construct_*_nodes()
+//		functions),
+//		  union:       Bcup = B(x)
+//		  allsome:     Bcup = all(x) union some(x)
+//		  determined:  Bcup = how(x) union complement of det(x)
+//
+//----------
+
+void InsertSBTCommand::interval_union_bits
+   (const BloomFilter*	unfinishedBf,
+	vector<u64>&		bits)
+	{
+	u64 numIntervalBits  = endPosition - startPosition;
+	u64 numIntervalWords = (numIntervalBits+63)/64;
+	u64 numIntervalBytes = (numIntervalBits+7)/8;
+
+	bits.assign(numIntervalWords,0);
+	const u8* src0 = ((const u8*) unfinishedBf->get_bit_vector(0)->bits->data()) + startPosition/8;
+	std::memcpy (bits.data(), src0, numIntervalBytes);
+
+	if (unfinishedBf->numBitVectors > 1)
+		{
+		vector<u64> bits1(numIntervalWords,0);
+		const u8* src1 = ((const u8*) unfinishedBf->get_bit_vector(1)->bits->data()) + startPosition/8;
+		std::memcpy (bits1.data(), src1, numIntervalBytes);
+
+		if (unfinishedBf->kind() != bfkind_allsome)
+			bitwise_complement (/*dst*/ bits.data(), numIntervalBits);
+		bitwise_or (/*dst*/ bits.data(), bits1.data(), numIntervalBits);
+		}
+
+	if (numIntervalBits % 64 != 0)
+		bits.back() &= (((u64) 1) << (numIntervalBits % 64)) - 1;
+	}
+
+std::string InsertSBTCommand::next_node_filename()
+	{
+	while (true)
+		{
+		string nodeFilename = nodeTemplate;
+		std::size_t fieldIx = nodeFilename.find ("{number}");
+		nodeFilename.replace (fieldIx, std::strlen("{number}"), std::to_string(++nodeNumber));
+
+		string nodeName = BloomFilter::strip_filter_suffix(strip_file_path(nodeFilename));
+		if (nodeNames.count(nodeName) > 0) continue;
+		nodeNames.insert(nodeName);
+		return nodeFilename;
+		}
+	}
@@ -0,0 +1,65 @@
+#ifndef cmd_insert_sbt_H
+#define cmd_insert_sbt_H
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "bloom_tree.h"
+#include "commands.h"
+
+class InsertSBTCommand: public Command
+	{
+public:
+	static const std::uint64_t defaultEndPosition = 100*1000;  // (same as for cluster)
+	static const std::uint64_t defaultMemoryBudget = ((std::uint64_t) 4)*1024*1024*1024;
+
+public:
+	InsertSBTCommand(const std::string& name): Command(name),modelBf(nullptr) {}
+	virtual ~InsertSBTCommand();
+	virtual void short_description (std::ostream& s);
+	virtual void usage (std::ostream& s, const std::string& message="");
+	virtual void debug_help (std::ostream& s);
+	virtual void parse (int _argc, char** _argv);
+	virtual int execute (void);
+	virtual void identify_tree (BloomTree* root);
+	virtual std::size_t insert_batch (const std::string& treeFilename, std::size_t leafIx);
+	virtual BloomTree* insert_leaf (BloomTree* root, const std::string& leafFilename);
+	virtual void find_child_union_bits (BloomTree* node);
+	virtual void interval_union_bits (const BloomFilter* unfinishedBf, std::vector<std::uint64_t>& bits);
+	virtual std::string next_node_filename (void);
+
+	std::string inTreeFilename;
+	std::string outTreeFilename;
+	std::string listFilename;
+	std::vector<std::string> leafFilenames;
+	std::string nodeTemplate;
+	std::uint64_t startPosition;	// origin-zero, half-open
+	std::uint64_t endPosition;
+	std::uint64_t memoryBudget;		// bound on the bytes of unfinished filters
+									// .. we hold at once
+	bool trackMemory;
+
+	std::uint32_t bfKind;			// the kind of tree, and the compressor it
+	std::uint32_t compressor;		// .. was built with
+	BloomFilter* modelBf;			// (simple) filter with the tree's properties,
+									// .. for checking new leaves against
+	std::unordered_set<std::string> nodeNames;
+	std::uint32_t nodeNumber;
+	std::unordered_map<BloomTree*,BloomFilter*> unfinished;	// reconstructed
+									// .. unfinished forms of existing nodes
+	std::unordered_map<BloomTree*,std::vector<std::uint64_t>> unionBits;
+									// union of the leaves below each node, over
+									// .. the bit interval
+	std::unordered_set<BloomTree*> rebuild;	// nodes that have to be computed
+									// .. anew
+	std::uint64_t numBatches;
+	std::uint64_t numComputed;
+	std::uint64_t numRewritten;
+	};
+
+#endif // cmd_insert_sbt_H
@@ -47,6 +47,9 @@ void LoadTestCommand::usage
 	s << "  --lookup=<N>     perform N bit-lookups on each vector; note that the" << endl;
 	s << "                   positions read are not necessarily distinct" << endl;
 	s << "                   (default is " << defaultNumLookups << ")" << endl;
+	s << "  --ranks=<N>      perform N rank1 and N select0 operations on each vector;" << endl;
+	s << "                   this allows the rank/select performance of .rrr and .roar" << endl;
+	s << "                   vectors to be compared (default is no rank/select)" << endl;
 	s << "  --report:count   report the number of 0s and 1s read" << endl;
 	s << "  --seed=<string>  random number generator seed" << endl;
 	}
@@ -71,6 +74,7 @@ void LoadTestCommand::parse
 
 	prngSeed    = "";
 	numVectors  = 1;
+	numRanks    = 0;
 	reportCount = false;
 
 	// skip command name
@@ -126,6 +130,15 @@ void LoadTestCommand::parse
 		 ||	(is_prefix_of (arg, "--L=")))
 			{ numLookups = string_to_unitized_u64(argVal);  continue; }
 
+		// --ranks=<N>
+
+		if ((is_prefix_of (arg, "--ranks="))
+		 ||	(is_prefix_of (arg, "--rank="))
+		 ||	(is_prefix_of (arg, "--rankselect="))
+		 ||	(is_prefix_of (arg, "R="))
+		 ||	(is_prefix_of (arg, "--R=")))
+			{ numRanks = string_to_unitized_u64(argVal);  continue; }
+
 		// --report:count
 
 		if (arg == "--report:count")
@@ -196,7 +209,7 @@ int LoadTestCommand::execute()
 	u64 positionsSize = std::max((u64)1,numLookups);
 	u64 positions[positionsSize];
 
-	if (numLookups > 0)
+	if ((numLookups > 0) || (numRanks > 0))
 		prng = seeded_prng(prngSeed);
 
 	if (contains(debug,"lookups"))
@@ -237,6 +250,53 @@ int LoadTestCommand::execute()
 				     << onesSeen              << " ones" << endl;
 			}
 
+		// rank/select test; we time the construction of the rank/select
+		// support separately from the operations themselves, since the former
+		// is a one-time cost for each vector
+
+		if (numRanks > 0)
+			{
+			auto startTime = get_wall_time();
+			bv->prepare_rank_select();
+			auto elapsedTime = elapsed_wall_time(startTime);
+			cerr << "[BitVector rank/select setup] " << elapsedTime << " secs " << bvFilename << endl;
+
+			vector<u64> rankPositions(numRanks);
+			std::uniform_int_distribution<u64> spinner(0,numBits-1);
+			for (u64 ix=0 ; ix<numRanks ; ix++)
+				rankPositions[ix] = spinner(*prng);
+
+			u64 onesSum = 0;
+			startTime = get_wall_time();
+			for (u64 ix=0 ; ix<numRanks ; ix++)
+				onesSum += bv->rank1(rankPositions[ix]);
+			elapsedTime = elapsed_wall_time(startTime);
+			cerr << "[BitVector rank1] " << elapsedTime << " secs " << bvFilename << endl;
+
+			u64 numZeros = numBits - bv->rank1(numBits);
+			if (numZeros == 0)
+				cerr << "[BitVector select0] (no zeros) " << bvFilename << endl;
+			else
+				{
+				std::uniform_int_distribution<u64> zeroSpinner(0,numZeros-1);
+				for (u64 ix=0 ; ix<numRanks ; ix++)
+					rankPositions[ix] = zeroSpinner(*prng);
+
+				u64 positionSum = 0;
+				startTime = get_wall_time();
+				for (u64 ix=0 ; ix<numRanks ; ix++)
+					positionSum += bv->select0(rankPositions[ix]);
+				elapsedTime = elapsed_wall_time(startTime);
+				cerr << "[BitVector select0] " << elapsedTime << " secs " << bvFilename << endl;
+
+				if (reportCount)
+					cout << bvFilename  << ": "
+					     << numRanks    << " ranks "
+					     << onesSum     << " rank sum "
+					     << positionSum << " select sum" << endl;
+				}
+			}
+
 		delete bv;
 		}
 
@@ -26,6 +26,7 @@ public:
 	std::vector<std::string> bvFilenames;
 	int numVectors;
 	std::uint64_t numLookups;
+	std::uint64_t numRanks;
 	bool reportCount;
 	};
 
@@ -338,8 +338,9 @@ int NodeStatsCommand::execute()
 				else if (compressor == bvcomp_rrr)
 					{
 					RrrBitVector* rrrBv = (RrrBitVector*) bv;
-					rrrrank1 bvRanker1(rrrBv->rrrBits);
-					numOnes = bvRanker1(rrrBv->numBits);
+					RrrRankSupport* bvRanker1 = rrrBv->rrrBits->new_rank1();
+					numOnes = bvRanker1->rank(rrrBv->numBits);
+					delete bvRanker1;
 					}
 				else
 					{
@@ -0,0 +1,373 @@
+// cmd_pack_tree.cc-- copy a tree's topology and all its bloom filter files
+//                    into a single packed tree file
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+
+#include "utilities.h"
+#include "bloom_filter_file.h"
+#include "packed_tree_file.h"
+#include "bloom_tree.h"
+#include "file_manager.h"
+
+#include "support.h"
+#include "commands.h"
+#include "cmd_pack_tree.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+#define u32 std::uint32_t
+#define u64 std::uint64_t
+
+#define copyBufferBytes (1024*1024)
+
+void PackTreeCommand::short_description
+   (std::ostream& s)
+	{
+	s << commandName << "-- copy a tree and all its bloom filters into a single file" << endl;
+	}
+
+void PackTreeCommand::usage
+   (std::ostream& s,
+	const string& message)
+	{
+	if (!message.empty())
+		{
+		s << message << endl;
+		s << endl;
+		}
+
+	short_description(s);
+	s << "usage: " << commandName << " <filename> [options]" << endl;
+	//    123456789-123456789-123456789-123456789-123456789-123456789-123456789-123456789
+	s << "  <filename>            name of the topology file for the tree" << endl;
+	s << "  --out=<filename>      name for the packed tree file" << endl;
+	s << "                        (by default this is derived from the topology filename)" << endl;
+	s << "  --pagesize=<bytes>    alignment of each bloom filter file within the packed" << endl;
+	s << "                        file; this should be a multiple of the system's page" << endl;
+	s << "                        size, so that bit vectors can be memory mapped" << endl;
+	s << "                        (default is " << packedtree_default_page_size << ")" << endl;
+	s << "  --quiet               don't report what files we're packing" << endl;
+	s << endl;
+	s << "The packed tree file can be used in place of the topology file, e.g. with the" << endl;
+	s << "query command. Its directory is read once, at startup, instead of reading the" << endl;
+	s << "header of each bloom filter file separately." << endl;
+	}
+
+void PackTreeCommand::debug_help
+   (std::ostream& s)
+	{
+	s << "--debug= options" << endl;
+	s << "  topology" << endl;
+	s << "  trackmemory" << endl;
+	}
+
+void PackTreeCommand::parse
+   (int		_argc,
+	char**	_argv)
+	{
+	int		argc;
+	char**	argv;
+
+	// defaults
+
+	inTreeFilename = "";
+	packFilename   = "";
+	pageSize       = packedtree_default_page_size;
+	beQuiet        = false;
+
+	// skip command name
+
+	argv = _argv+1;  argc = _argc - 1;
+	if (argc <= 0) chastise ();
+
+	//////////
+	// scan arguments
+	//////////
+
+	for (int argIx=0 ; argIx<argc ; argIx++)
+		{
+		string arg = argv[argIx];
+		string argVal;
+		if (arg.empty()) continue;
+
+		string::size_type argValIx = arg.find('=');
+		if (argValIx == string::npos) argVal = "";
+		                         else argVal = arg.substr(argValIx+1);
+
+		// --help, etc.
+
+		if ((arg == "--help")
+		 || (arg == "-help")
+		 || (arg == "--h")
+		 || (arg == "-h")
+		 || (arg == "?")
+		 || (arg == "-?")
+		 || (arg == "--?"))
+			{ usage (cerr);  std::exit (EXIT_SUCCESS); }
+
+		if ((arg == "--help=debug")
+		 || (arg == "--help:debug")
+		 || (arg == "?debug"))
+			{ debug_help(cerr);  std::exit (EXIT_SUCCESS); }
+
+		// --tree=<filename>, etc.
+
+		if ((is_prefix_of (arg, "--tree="))
+		 ||	(is_prefix_of (arg, "--intree="))
+		 ||	(is_prefix_of (arg, "--topology=")))
+			{ inTreeFilename = argVal;  continue; }
+
+		// --out=<filename>
+
+		if ((is_prefix_of (arg, "--out="))
+		 ||	(is_prefix_of (arg, "--output=")))
+			{ packFilename = argVal;  continue; }
+
+		// --pagesize=<bytes>
+
+		if ((is_prefix_of (arg, "--pagesize="))
+		 ||	(is_prefix_of (arg, "--page=")))
+			{
+			u64 val = string_to_unitized_u64(argVal,/*unitScale*/ 1024);
+			if ((val < sizeof(packedtreeheader)) or ((val & (val-1)) != 0)
+			 or (val > 0x80000000))
+				chastise ("--pagesize must be a power of two, at least "
+				        + std::to_string(sizeof(packedtreeheader))
+				        + " (\"" + arg + "\")");
+			pageSize = (u32) val;
+			continue;
+			}
+
+		// --quiet
+
+		if (arg == "--quiet")
+			{ beQuiet = true;  continue; }
+
+		// (unadvertised) debug options
+
+		if (arg == "--debug")
+			{ debug.insert ("debug");  continue; }
+
+		if (is_prefix_of (arg, "--debug="))
+			{
+		    for (const auto& field : parse_comma_list(argVal))
+				debug.insert(to_lower(field));
+			continue;
+			}
+
+		// unrecognized --option
+
+		if (is_prefix_of (arg, "--"))
+			chastise ("unrecognized option: \"" + arg + "\"");
+
+		// <filename>
+
+		if (inTreeFilename.empty())
+			inTreeFilename = arg;
+		else
+			chastise ("unrecognized option: \"" + arg + "\""
+			          "\nthe tree was already given as \"" + inTreeFilename + "\"");
+		}
+
+	// sanity checks
+
+	if (inTreeFilename.empty())
+		chastise ("you have to provide a tree topology file");
+
+	if (packFilename.empty())
+		{
+		packFilename = strip_file_path(inTreeFilename);
+		if (is_suffix_of(packFilename,".sbt"))
+			packFilename = strip_suffix(packFilename,".sbt");
+		packFilename += ".packed.sbt";
+		}
+
+	if (packFilename == inTreeFilename)
+		chastise ("the packed tree file can't be the same as the topology file"
+		          " (\"" + inTreeFilename + "\")");
+
+	return;
+	}
+
+
+int PackTreeCommand::execute()
+	{
+	if (contains(debug,"trackmemory"))
+		{
+		FileManager::trackMemory = true;
+		BloomFilter::trackMemory = true;
+		BitVector::trackMemory   = true;
+		}
+
+	BloomTree* root = BloomTree::read_topology(inTreeFilename);
+	if (not root->packFilename.empty())
+		fatal ("error: \"" + inTreeFilename + "\" is already a packed tree file");
+
+	if (contains(debug,"topology"))
+		root->print_topology(cerr,/*level*/0,/*format*/topofmt_containers);
+
+	// collect the distinct bloom filter files, in the order in which they are
+	// first used; note that nodes may share files
+
+	vector<BloomTree*> order;
+	root->pre_order(order);
+
+	vector<string> bfFilenames;
+	std::unordered_map<string,bool> filenameSeen;
+	u64 numNodes = 0;
+	for (const auto& node : order)
+		{
+		if (node->is_dummy()) continue;
+		numNodes++;
+		if (filenameSeen.count(node->bfFilename) > 0) continue;
+		filenameSeen[node->bfFilename] = true;
+		bfFilenames.emplace_back(node->bfFilename);
+		}
+
+	// write a preliminary header; this is marked as unfinished, and we'll
+	// replace it when we're done
+
+	std::ofstream out (packFilename, std::ios::binary|std::ios::out|std::ios::trunc);
+	if (not out)
+		fatal ("error: failed to open \"" + packFilename + "\"");
+
+	packedtreeheader header;
+	std::memset (&header, 0, sizeof(header));
+	header.magic      = packedtreeheaderMagicUn;
+	header.headerSize = sizeof(header);
+	header.version    = packedtreeheaderVersion;
+	header.pageSize   = pageSize;
+	header.numFiles   = (u32) bfFilenames.size();
+	out.write ((char*) &header, sizeof(header));
+	u64 filePos = sizeof(header);
+
+	// copy each bloom filter file, page-aligned; for each file we add an
+	// entry to the directory, which includes a copy of the file's header
+
+	char* buffer = new char[copyBufferBytes];
+	if (contains(debug,"trackmemory"))
+		cerr << "@+" << (void*) buffer << " allocating copy buffer" << endl;
+
+	string directory;
+	const string zeros(pageSize,'\0');
+
+	for (const auto& bfFilename : bfFilenames)
+		{
+		u64 alignedPos = ((filePos + pageSize-1) / pageSize) * pageSize;
+		out.write (zeros.data(), alignedPos-filePos);
+		filePos = alignedPos;
+
+		if (not beQuiet)
+			cerr << "packing " << bfFilename << endl;
+
+		std::ifstream in (bfFilename, std::ios::binary|std::ios::in);
+		if (not in)
+			fatal ("error: failed to open \"" + bfFilename + "\"");
+
+		bffileprefix prefix;
+		in.read ((char*) &prefix, sizeof(prefix));
+		if ((size_t) in.gcount() != sizeof(prefix))
+			fatal ("error: problem reading header from \"" + bfFilename + "\"");
+		if (prefix.magic != bffileheaderMagic)
+			fatal ("error: \"" + bfFilename + "\" doesn't look like a bloom filter file"
+			       " (incorrect magic number)");
+		if ((prefix.headerSize <= sizeof(prefix)) or (prefix.headerSize > max_bffileheader_size))
+			fatal ("error: \"" + bfFilename + "\" has a bad header size"
+			       " (" + std::to_string(prefix.headerSize) + " bytes)");
+
+		string bfHeader(round_up_16(prefix.headerSize),'\0');
+		in.seekg (0, in.beg);
+		in.read (&bfHeader[0], prefix.headerSize);
+		if ((size_t) in.gcount() != prefix.headerSize)
+			fatal ("error: problem reading header from \"" + bfFilename + "\"");
+
+		in.seekg (0, in.beg);
+		u64 numBytes = 0;
+		while (in)
+			{
+			in.read (buffer, copyBufferBytes);
+			u64 bytesRead = in.gcount();
+			if (bytesRead == 0) break;
+			out.write (buffer, bytesRead);
+			numBytes += bytesRead;
+			}
+		if (not in.eof())
+			fatal ("error: problem reading \"" + bfFilename + "\"");
+		in.close();
+
+		string name(bfFilename);
+		name.resize(round_up_16(bfFilename.length()+1),'\0');
+
+		packedtreeentry entry;
+		entry.offset      = filePos;
+		entry.numBytes    = numBytes;
+		entry.nameBytes   = (u32) name.length();
+		entry.headerBytes = (u32) bfHeader.length();
+		directory.append ((char*) &entry, sizeof(entry));
+		directory.append (name);
+		directory.append (bfHeader);
+
+		filePos += numBytes;
+		}
+
+	if (contains(debug,"trackmemory"))
+		cerr << "@-" << (void*) buffer << " discarding copy buffer" << endl;
+	delete[] buffer;
+
+	// write the topology; nodes are matched to filters by name, so the
+	// bracketed filenames are only informational
+
+	for (const auto& node : order)
+		{
+		if (node->is_dummy()) continue;
+		node->bfFilename = strip_file_path(node->bfFilename);
+		}
+
+	std::ostringstream topology;
+	root->print_topology(topology,/*level*/0,/*format*/topofmt_containers);
+	string topologyText = topology.str();
+
+	header.topologyOffset = filePos;
+	header.topologyBytes  = topologyText.length();
+	out.write (topologyText.data(), topologyText.length());
+	filePos += topologyText.length();
+
+	// write the directory
+
+	u64 alignedPos = round_up_16(filePos);
+	out.write (zeros.data(), alignedPos-filePos);
+	filePos = alignedPos;
+
+	header.directoryOffset = filePos;
+	header.directoryBytes  = directory.length();
+	out.write (directory.data(), directory.length());
+	filePos += directory.length();
+
+	// replace the header, now marked as finished
+
+	header.magic = packedtreeheaderMagic;
+	out.seekp (0, out.beg);
+	out.write ((char*) &header, sizeof(header));
+
+	if (not out)
+		fatal ("error: problem writing \"" + packFilename + "\"");
+	out.close();
+
+	if (not beQuiet)
+		cerr << "packed " << bfFilenames.size() << " files"
+		     << " (" << numNodes << " nodes) into \"" << packFilename << "\"" << endl;
+
+	delete root;
+	return EXIT_SUCCESS;
+	}
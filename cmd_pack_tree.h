@@ -0,0 +1,28 @@
+#ifndef cmd_pack_tree_H
+#define cmd_pack_tree_H
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+
+#include "commands.h"
+
+class PackTreeCommand: public Command
+	{
+public:
+	PackTreeCommand(const std::string& name): Command(name) {}
+	virtual ~PackTreeCommand() {}
+	virtual void short_description (std::ostream& s);
+	virtual void usage (std::ostream& s, const std::string& message="");
+	virtual void debug_help (std::ostream& s);
+	virtual void parse (int _argc, char** _argv);
+	virtual int execute (void);
+
+	std::string inTreeFilename;
+	std::string packFilename;
+	std::uint32_t pageSize;
+	bool beQuiet;
+	};
+
+#endif // cmd_pack_tree_H
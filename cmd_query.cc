@@ -8,6 +8,7 @@
 #include <iomanip>
 #include <vector>
 #include <tuple>
+#include <thread>
 
 #include "utilities.h"
 #include "bit_vector.h"
@@ -78,14 +79,44 @@ void QueryCommand::usage
 	s << "                       at the leaves" << endl;
 	s << "  --distinctkmers      perform the query counting each distinct kmer only once" << endl;
 	s << "                       (by default we count a query kmer each time it occurs)" << endl;
-	s << "  --consistencycheck   before searching, check that bloom filter properties are" << endl;
-	s << "                       consistent across the tree" << endl;
+	s << "  --consistencycheck   check that bloom filter properties are consistent across" << endl;
+	s << "                       the tree, as each node is reached" << endl;
 	s << "                       (not needed with --usemanager)" << endl;
+	s << "  --verifychecksums    verify each bit vector's checksum as it is loaded (this" << endl;
+	s << "                       re-reads the data, so it slows loading)" << endl;
 	s << "  --justcountkmers     just report the number of kmers in each query, and quit" << endl;
 	s << "  --countallkmerhits   report the number of kmers that 'hit', for each" << endl;
 	s << "                       query/leaf" << endl;
 	s << "  --stat:nodesexamined report the count of nodes examined for each query (as a" << endl;
 	s << "                       comment in the output" << endl;
+	s << "  --threads=<N>        number of threads to use; independent subtrees are" << endl;
+	s << "                       searched concurrently" << endl;
+	s << "                       (default is 1)" << endl;
+	s << "  --shardqueries       (requires --threads) split the queries among the" << endl;
+	s << "                       threads, each thread searching the whole tree for its" << endl;
+	s << "                       share of the queries; this is usually better than" << endl;
+	s << "                       subtree parallelism when there are many short queries" << endl;
+	s << "  --levelorder         search the tree one level at a time (breadth-first)," << endl;
+	s << "                       rather than depth-first; the nodes at each level are" << endl;
+	s << "                       loaded in file order, which is faster when seeks are" << endl;
+	s << "                       expensive, but uses more memory" << endl;
+	s << "  --mmap               access uncompressed bloom filter files by mapping them" << endl;
+	s << "                       into memory rather than reading them; concurrent" << endl;
+	s << "                       query processes then share one copy of the filters" << endl;
+	s << "  --cache=<bytes>      keep up to this many bytes of bloom filters resident" << endl;
+	s << "                       after the search has moved past them, so that later" << endl;
+	s << "                       searches can reuse them (e.g. --cache=8G); filters" << endl;
+	s << "                       nearest the root are kept in preference to others;" << endl;
+	s << "                       with --time, cache hits and misses are reported" << endl;
+	s << "                       (by default filters are unloaded immediately)" << endl;
+	s << "  --prefetch           load bloom filters in a background thread, ahead of" << endl;
+	s << "                       the search; file reads then overlap with lookups in" << endl;
+	s << "                       other nodes; this can keep one extra filter resident" << endl;
+	s << "                       for each level of the tree" << endl;
+	s << "  --mergelookups       at each node, look up the kmers of all the queries" << endl;
+	s << "                       together, in sorted order and once per distinct kmer;" << endl;
+	s << "                       this is faster for large batches of queries that" << endl;
+	s << "                       share many kmers" << endl;
 	s << "  --time               report wall time and node i/o time" << endl;
 	s << "  --out=<filename>     file for query results; if this is not provided, results" << endl;
 	s << "                       are written to stdout" << endl;
@@ -139,12 +170,20 @@ void QueryCommand::parse
 	onlyLeaves              = false;
 	distinctKmers           = false;
 	checkConsistency        = false;
+	verifyChecksums         = false;
 	justReportKmerCounts    = false;
 	countAllKmerHits        = false;
 	reportNodesExamined     = false;
 	collectNodeStats        = false;
 	reportTime              = false;
 	backwardCompatibleStyle = false;
+	numThreads              = 1;
+	shardQueries            = false;
+	levelOrder              = false;
+	useMemoryMap            = false;
+	nodeCacheBytes          = 0;
+	prefetchFilters         = false;
+	mergeLookups            = false;
 
 	// skip command name
 
@@ -262,6 +301,13 @@ void QueryCommand::parse
 		 || (arg == "--noconsistencycheck"))
 			{ checkConsistency = false;  continue; }
 
+		// --verifychecksums
+
+		if ((arg == "--verifychecksums")
+		 || (arg == "--verifychecksum")
+		 || (arg == "--checksums"))
+			{ verifyChecksums = true;  continue; }
+
 		// --justcountkmers
 
 		if (arg == "--justcountkmers")
@@ -292,6 +338,60 @@ void QueryCommand::parse
 		if (arg == "--backwardcompatible")
 			{ backwardCompatibleStyle = true;  continue; }
 
+		// --threads=<N>
+
+		if ((is_prefix_of (arg, "--threads="))
+		 ||	(is_prefix_of (arg, "T="))
+		 ||	(is_prefix_of (arg, "--T=")))
+			{
+			numThreads = string_to_u32(argVal);
+			if (numThreads == 0)
+				chastise ("(in \"" + arg + "\") number of threads cannot be zero");
+			continue;
+			}
+
+		// --shardqueries
+
+		if ((arg == "--shardqueries")
+		 || (arg == "--shard-queries")
+		 || (arg == "--shard"))
+			{ shardQueries = true;  continue; }
+
+		// --levelorder
+
+		if ((arg == "--levelorder")
+		 || (arg == "--level-order")
+		 || (arg == "--breadthfirst")
+		 || (arg == "--breadth-first"))
+			{ levelOrder = true;  continue; }
+
+		// --mmap
+
+		if ((arg == "--mmap")
+		 || (arg == "--memorymap")
+		 || (arg == "--memory-map"))
+			{ useMemoryMap = true;  continue; }
+
+		// --cache=<bytes>
+
+		if ((is_prefix_of (arg, "--cache="))
+		 ||	(is_prefix_of (arg, "--nodecache=")))
+			{ nodeCacheBytes = string_to_unitized_u64(argVal,1024);  continue; }
+
+		// --prefetch
+
+		if ((arg == "--prefetch")
+		 || (arg == "--prefetchfilters"))
+			{ prefetchFilters = true;  continue; }
+
+		// --mergelookups
+
+		if ((arg == "--mergelookups")
+		 || (arg == "--merge-lookups")
+		 || (arg == "--sortedlookups")
+		 || (arg == "--sorted-lookups"))
+			{ mergeLookups = true;  continue; }
+
 		// --time
 
 		if ((arg == "--time")
@@ -372,6 +472,18 @@ void QueryCommand::parse
 	if ((backwardCompatibleStyle) and (not adjustKmerCounts) and (not sortByKmerCounts))
 		chastise ("--backwardcompatible cannot be used without one of --adjust or --sort");
 
+	if ((shardQueries) and (numThreads < 2))
+		chastise ("--shardqueries requires --threads=<N>, with N at least 2");
+
+	if ((levelOrder) and (numThreads > 1) and (not shardQueries))
+		chastise ("--levelorder can only be used with --threads=<N> if --shardqueries is also used");
+
+	if ((shardQueries) and ((justReportKmerCounts) or (countAllKmerHits)))
+		chastise ("--shardqueries cannot be used with --justcountkmers or --countallkmerhits");
+
+	if ((levelOrder) and ((justReportKmerCounts) or (countAllKmerHits)))
+		chastise ("--levelorder cannot be used with --justcountkmers or --countallkmerhits");
+
 	completeKmerCounts = (adjustKmerCounts) or (sortByKmerCounts);
 
 	// assign threshold to any unassigned queries
@@ -426,6 +538,16 @@ int QueryCommand::execute()
 	if (contains(debug,"bvcreation"))
 		BitVector::reportCreation = true;
 
+	if (useMemoryMap)
+		BitVector::useMemoryMap = true;
+
+	if (verifyChecksums)
+		BitVector::verifyChecksums = true;
+
+	BloomTree::cacheBudget = nodeCacheBytes;
+	BloomTree::prefetchFilters = prefetchFilters;
+	BloomTree::mergeLookups    = mergeLookups;
+
 	// read the tree
 
 	BloomTree* root = BloomTree::read_topology(treeFilename,onlyLeaves);
@@ -495,25 +617,11 @@ int QueryCommand::execute()
 		}
 
 	// if we're not using a file manager, we may still want to do a consistency
-	// check before we start the search (we'd rather not run for a long time
-	// and *then* report the problem)
+	// check; this is done as each node is first reached, so nodes the search
+	// never reaches are never read (the file manager does likewise)
 
 	else if (checkConsistency)
-		{
-		BloomFilter* modelBf = nullptr;
-
-		if (order.size() == 0)
-			root->post_order(order);
-		for (const auto& node : order)
-			{
-			node->preload();
-
-			if (modelBf == nullptr)
-				modelBf = node->bf;
-			else
-				node->bf->is_consistent_with (modelBf, /*beFatal*/ true);
-			}
-		}
+		BloomTree::checkConsistency = true;
 
 	// read the queries
 
@@ -640,7 +748,7 @@ int QueryCommand::execute()
 		{
 		// perform the query
 
-		root->batch_query(queries,onlyLeaves,distinctKmers,completeKmerCounts,adjustKmerCounts);
+		search (root);
 
 		// report results
 
@@ -739,6 +847,17 @@ int QueryCommand::execute()
 		cerr << "totalLoadTime: " << totalLoadTime << std::setprecision(6) << std::fixed << " secs" << endl;
 		}
 
+	if ((reportTime) && (nodeCacheBytes != 0))
+		{
+		cerr << "nodeCache: " << BloomTree::cacheHits << " hits"
+		     << ", " << BloomTree::cacheMisses << " misses"
+		     << ", " << BloomTree::cacheEvictions << " evictions"
+		     << ", " << BloomTree::cacheBytes << " bytes resident" << endl;
+		}
+
+	if ((reportTime) && (prefetchFilters))
+		cerr << "prefetchLoads: " << BloomTree::prefetchLoads << endl;
+
 	return EXIT_SUCCESS;
 	}
 
@@ -776,6 +895,45 @@ void QueryCommand::read_queries()
 
 	}
 
+//----------
+//
+// search--
+//	Search the tree for the queries in the queries list.
+//
+//----------
+
+void QueryCommand::search
+   (BloomTree* root)
+	{
+	if ((shardQueries) and (numThreads > 1))
+		{
+		// split the queries round-robin into one shard per thread; all
+		// threads search the same tree, sharing whatever filters are
+		// resident
+
+		vector<vector<Query*>> shards(numThreads);
+		for (size_t qIx=0 ; qIx<queries.size() ; qIx++)
+			shards[qIx%numThreads].emplace_back(queries[qIx]);
+
+		vector<std::thread> workers;
+		for (const auto& shard : shards)
+			{
+			if (shard.empty()) continue;
+			workers.emplace_back([this,root,&shard]()
+				{
+				root->batch_query(shard,onlyLeaves,distinctKmers,completeKmerCounts,adjustKmerCounts,
+				                  /*numThreads*/ 1,levelOrder);
+				});
+			}
+
+		for (auto& worker : workers)
+			worker.join();
+		}
+	else
+		root->batch_query(queries,onlyLeaves,distinctKmers,completeKmerCounts,adjustKmerCounts,
+		                  numThreads,levelOrder);
+	}
+
 //----------
 //
 // sort_matches_by_kmer_counts--
@@ -9,6 +9,8 @@
 #include "query.h"
 #include "commands.h"
 
+class BloomTree;
+
 class QueryCommand: public Command
 	{
 public:
@@ -23,6 +25,7 @@ public:
 	virtual void parse (int _argc, char** _argv);
 	virtual int execute (void);
 	virtual void read_queries (void);
+	virtual void search (BloomTree* root);
 	virtual void sort_matches_by_kmer_counts (void);
 	virtual void print_matches(std::ostream& out) const;
 	virtual void print_matches_with_kmer_counts(std::ostream& out) const;
@@ -39,6 +42,7 @@ public:
 	bool distinctKmers;
 	bool useFileManager;
 	bool checkConsistency;			// only meaningful if useFileManager is false
+	bool verifyChecksums;
 	bool justReportKmerCounts;
 	bool countAllKmerHits;
 	bool reportNodesExamined;
@@ -46,6 +50,13 @@ public:
 	bool reportTime;
 	bool backwardCompatibleStyle;
 	bool completeKmerCounts;
+	std::uint32_t numThreads;
+	bool shardQueries;
+	bool levelOrder;
+	bool useMemoryMap;
+	std::uint64_t nodeCacheBytes;
+	bool prefetchFilters;
+	bool mergeLookups;
 
 	std::vector<Query*> queries;
 	};
@@ -0,0 +1,515 @@
+// cmd_remove_sbt.cc-- remove leaves from a sequence bloom tree, rebuilding
+//                     only the nodes on their paths to the root
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "utilities.h"
+#include "bloom_tree.h"
+#include "file_manager.h"
+
+#include "support.h"
+#include "commands.h"
+#include "cmd_remove_sbt.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+#define u32 std::uint32_t
+#define u64 std::uint64_t
+
+
+void RemoveSBTCommand::short_description
+   (std::ostream& s)
+	{
+	s << commandName << "-- remove leaves from a tree, rebuilding only their paths to the root" << endl;
+	}
+
+void RemoveSBTCommand::usage
+   (std::ostream& s,
+	const string& message)
+	{
+	if (!message.empty())
+		{
+		s << message << endl;
+		s << endl;
+		}
+
+	short_description(s);
+	s << "usage: " << commandName << " <topology> <leaf> [<leaf>..] [options]" << endl;
+	//    123456789-123456789-123456789-123456789-123456789-123456789-123456789-123456789
+	s << "  <topology>           name of the topology file for a tree that has been built" << endl;
+	s << "  <leaf>               name of a leaf to remove from the tree; this can be the" << endl;
+	s << "                       node's name or the name of its bloom filter file" << endl;
+	s << "  --list=<filename>    file containing a list of leaves to remove" << endl;
+	s << "  --out=<filename>     name for the resulting tree toplogy file" << endl;
+	s << "                       (by default the input topology file is replaced)" << endl;
+	s << endl;
+	s << "When a removed leaf leaves its parent with only one child, the parent is" << endl;
+	s << "collapsed, and that child takes the parent's place. Only the nodes remaining" << endl;
+	s << "on the removed leaves' paths to the root are computed anew, and their other" << endl;
+	s << "children are rewritten. The files of removed leaves and collapsed nodes are" << endl;
+	s << "left in place. The tree keeps the node type and compression it was built with." << endl;
+	}
+
+void RemoveSBTCommand::debug_help
+   (std::ostream& s)
+	{
+	s << "--debug= options" << endl;
+	s << "  trackmemory" << endl;
+	s << "  topology" << endl;
+	s << "  removal" << endl;
+	s << "  traversal" << endl;
+	}
+
+void RemoveSBTCommand::parse
+   (int		_argc,
+	char**	_argv)
+	{
+	int		argc;
+	char**	argv;
+
+	// skip command name
+
+	argv = _argv+1;  argc = _argc - 1;
+	if (argc <= 0) chastise ();
+
+	//////////
+	// scan arguments
+	//////////
+
+	for (int argIx=0 ; argIx<argc ; argIx++)
+		{
+		string arg = argv[argIx];
+		string argVal;
+		if (arg.empty()) continue;
+
+		string::size_type argValIx = arg.find('=');
+		if (argValIx == string::npos) argVal = "";
+		                         else argVal = arg.substr(argValIx+1);
+
+		// --help, etc.
+
+		if ((arg == "--help")
+		 || (arg == "-help")
+		 || (arg == "--h")
+		 || (arg == "-h")
+		 || (arg == "?")
+		 || (arg == "-?")
+		 || (arg == "--?"))
+			{ usage (cerr);  std::exit (EXIT_SUCCESS); }
+
+		if ((arg == "--help=debug")
+		 || (arg == "--help:debug")
+		 || (arg == "?debug"))
+			{ debug_help(cerr);  std::exit (EXIT_SUCCESS); }
+
+		// --list=<filename>
+
+		if (is_prefix_of (arg, "--list="))
+			{
+			if (not listFilename.empty())
+				chastise ("unrecognized option: \"" + arg + "\""
+				          "\nleaves list file was already given as \"" + listFilename + "\"");
+			listFilename = argVal;
+			continue;
+			}
+
+		// --out=<filename>, etc.
+
+		if ((is_prefix_of (arg, "--out="))
+		 || (is_prefix_of (arg, "--output="))
+		 || (is_prefix_of (arg, "--outtree=")))
+			{ outTreeFilename = argVal;  continue; }
+
+		// (unadvertised) --tree=<filename>, --topology=<filename>
+
+		if ((is_prefix_of (arg, "--tree="))
+		 ||	(is_prefix_of (arg, "--intree="))
+		 ||	(is_prefix_of (arg, "--topology=")))
+			{
+			if (not inTreeFilename.empty())
+				chastise ("unrecognized option: \"" + arg + "\""
+				          "\ntree topology file was already given as \"" + inTreeFilename + "\"");
+			inTreeFilename = argVal;
+			continue;
+			}
+
+		// (unadvertised) debug options
+
+		if (arg == "--debug")
+			{ debug.insert ("debug");  continue; }
+
+		if (is_prefix_of (arg, "--debug="))
+			{
+		    for (const auto& field : parse_comma_list(argVal))
+				debug.insert(to_lower(field));
+			continue;
+			}
+
+		// unrecognized --option
+
+		if (is_prefix_of (arg, "--"))
+			chastise ("unrecognized option: \"" + arg + "\"");
+
+		// <topology>, <leaf>
+
+		if (inTreeFilename.empty())
+			inTreeFilename = arg;
+		else
+			leafNames.emplace_back(strip_blank_ends(arg));
+		}
+
+	// sanity checks
+
+	if (inTreeFilename.empty())
+		chastise ("you have to provide a tree topology file");
+
+	if ((leafNames.empty()) and (listFilename.empty()))
+		chastise ("you have to provide at least one leaf to remove from the tree");
+
+	if (outTreeFilename.empty())
+		outTreeFilename = inTreeFilename;
+
+	return;
+	}
+
+RemoveSBTCommand::~RemoveSBTCommand()
+	{
+	for (const auto& item : unfinished)
+		delete item.second;
+	}
+
+
+int RemoveSBTCommand::execute()
+	{
+	trackMemory = false;
+	if (contains(debug,"trackmemory"))
+		{
+		trackMemory              = true;
+		FileManager::trackMemory = true;
+		BloomTree::trackMemory   = true;
+		BloomFilter::trackMemory = true;
+		BitVector::trackMemory   = true;
+		}
+
+	// collect the names of the leaves to remove
+
+	if (not listFilename.empty())
+		{
+		std::ifstream in (listFilename);
+		if (not in)
+			fatal ("error: failed to open \"" + listFilename + "\"");
+
+		string line;
+		while (std::getline (in, line))
+			{
+			string leafName = strip_blank_ends(line);
+			if (leafName.empty()) continue;
+			leafNames.emplace_back(leafName);
+			}
+		in.close();
+		}
+
+	if (leafNames.empty())
+		fatal ("error: \"" + listFilename + "\" contains no leaves");
+
+	// read the tree, and figure out how it was built
+
+	BloomTree* root = BloomTree::read_topology(inTreeFilename);
+	if (not root->packFilename.empty())
+		fatal ("error: \"" + inTreeFilename + "\" is a packed tree file"
+		       " (leaves can't be removed from it)");
+	if (root->nodesShareFiles)
+		fatal ("error: nodes in \"" + inTreeFilename + "\" share files"
+		       " (leaves can't be removed from such a tree)");
+
+	if (contains(debug,"topology"))
+		root->print_topology(cerr,/*level*/0,/*format*/topofmt_nodeNames);
+
+	root->identify_build(bfKind,compressor);
+
+	if (contains(debug,"removal"))
+		cerr << "tree is " << BloomFilter::filter_kind_to_string(bfKind,false)
+		     << ", " << BitVector::compressor_to_string(compressor) << endl;
+
+	// locate the leaves; each is given either by its node name or by the name
+	// of one of its bloom filter files, which reduce to the same thing
+
+	std::unordered_map<string,BloomTree*> nameToNode;
+	vector<BloomTree*> order;
+	root->pre_order(order);
+	u64 numLeaves = 0;
+	for (const auto& node : order)
+		{
+		nameToNode[node->name] = node;
+		if (node->is_leaf()) numLeaves++;
+		}
+
+	vector<BloomTree*> removalOrder;
+	for (const auto& leafName : leafNames)
+		{
+		string name = BloomFilter::strip_filter_suffix(strip_file_path(leafName));
+		auto iter = nameToNode.find(name);
+		if (iter == nameToNode.end())
+			fatal ("error: the tree contains no node named \"" + name + "\""
+			       " (for \"" + leafName + "\")");
+		BloomTree* leaf = iter->second;
+		if (not leaf->is_leaf())
+			fatal ("error: \"" + name + "\" is not a leaf of the tree"
+			       " (only leaves can be removed)");
+		if (removed.count(leaf) > 0) continue;
+		removed.insert(leaf);
+		removalOrder.emplace_back(leaf);
+		}
+
+	if (removed.size() >= numLeaves)
+		fatal ("error: that would remove every leaf of the tree");
+
+	// every node above a removed leaf will either be collapsed or computed
+	// anew
+
+	for (const auto& leaf : removalOrder)
+		{
+		for (BloomTree* node=leaf->parent ; node!=nullptr ; node=node->parent)
+			{
+			if (node->is_dummy()) break;
+			if (rebuild.count(node) > 0) break;
+			rebuild.insert(node);
+			}
+		}
+
+	// reconstruct the unfinished forms of the nodes we'll need, top-down
+	// along the removed leaves' paths (see BloomTree::unfinished_filter);
+	// this must be done before we modify the tree, since a node's saved
+	// filter was finished by its parent in the *original* tree
+
+	if (root->is_dummy())
+		reconstruct_children(root,/*nodeBf*/ nullptr);
+	else
+		{
+		BloomFilter* rootBf = root->unfinished_filter(/*parentBf*/ nullptr);
+		reconstruct_children(root,rootBf);
+		if (trackMemory)
+			cerr << "@-" << rootBf << " discarding unfinished filter for " << root->bfFilename << endl;
+		delete rootBf;
+		}
+
+	// remove the leaves, collapsing any node left with only one child
+
+	numCollapsed = 0;
+	for (const auto& leaf : removalOrder)
+		root = remove_node(root,leaf);
+
+	if (contains(debug,"topology"))
+		{
+		cerr << "topology after removal:" << endl;
+		root->print_topology(cerr,/*level*/0,/*format*/topofmt_nodeNames);
+		}
+
+	// every node we reconstructed is a child of a node that will be computed
+	// anew, and that parent will need to finish it again; the exception is a
+	// node that has been promoted to be a root, which we finish ourselves
+
+	u64 numRewritten = 0;
+	for (const auto& item : unfinished)
+		{
+		item.first->adopt_unfinished(item.second,compressor);
+		if (bfKind != bfkind_simple) numRewritten++;
+		}
+	unfinished.clear();
+
+	order.clear();
+	root->post_order(order);
+	for (const auto& node : order)
+		{
+		node->reportSave   = true;
+		node->dbgTraversal = (contains(debug,"traversal"));
+		}
+
+	for (const auto& node : promoted)
+		{
+		if (rebuild.count(node) > 0) continue;
+		if ((node->parent != nullptr) and (not node->parent->is_dummy())) continue;
+		if (contains(debug,"removal"))
+			cerr << node->name << " is now a root; finishing it" << endl;
+		node->finish_parentless();
+		}
+
+	// build the nodes that need it
+
+	root->construct_nodes (bfKind, compressor);
+
+	cerr << "removed " << removalOrder.size() << " leaves"
+	     << ", " << numCollapsed << " nodes were collapsed"
+	     << ", " << rebuild.size() << " nodes were computed anew"
+	     << " and " << numRewritten << " others were rewritten" << endl;
+
+	// write the new topology
+
+	string tempFilename = temp_filename (outTreeFilename);
+	std::ofstream out (tempFilename);
+	if (not out)
+		fatal ("error: failed to open \"" + tempFilename + "\"");
+	root->print_topology(out);
+	out.close();
+	if (out.fail())
+		fatal ("error: problem writing \"" + tempFilename + "\"");
+	commit_temp_file (tempFilename, outTreeFilename);
+
+	FileManager::close_file();	// make sure the last bloom filter file we
+								// .. opened for read gets closed
+
+	delete root;
+	return EXIT_SUCCESS;
+	}
+
+//----------
+//
+// reconstruct_children--
+//	Reconstruct the unfinished forms of a node's children, descending into
+//	those that will be computed anew.
+//
+//----------
+//
+// Arguments:
+//	BloomTree*			node:	The node whose children are to be
+//								.. reconstructed.
+//	const BloomFilter*	nodeBf:	The unfinished form of the node's filter; this
+//								.. is null if the node is a dummy.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	Only children that will survive, and won't be computed anew, are kept
+//		(in unfinished). The unfinished forms of nodes that will be computed
+//		anew are needed only until their own children are reconstructed, so at
+//		most one root-to-leaf path of those is resident at any time.
+//	(2)	A dummy's children that aren't above a removed leaf are unaffected, so
+//		we don't reconstruct them. But we do install their saved filters, so
+//		that construct_*_nodes() treats them as already built; otherwise it
+//		would try to compute them from their children's files.
+//
+//----------
+
+void RemoveSBTCommand::reconstruct_children
+   (BloomTree*			node,
+	const BloomFilter*	nodeBf)
+	{
+	for (const auto& child : node->children)
+		{
+		if (removed.count(child) > 0) continue;
+
+		bool isOnPath = (rebuild.count(child) > 0);
+		if ((node->is_dummy()) and (not isOnPath))
+			{ child->preload();  continue; }
+
+		BloomFilter* childBf = child->unfinished_filter(nodeBf);
+		if (not isOnPath)
+			{ unfinished[child] = childBf;  continue; }
+
+		reconstruct_children(child,childBf);
+		if (trackMemory)
+			cerr << "@-" << childBf << " discarding unfinished filter for " << child->bfFilename << endl;
+		delete childBf;
+		}
+	}
+
+//----------
+//
+// remove_node--
+//	Remove a node from the tree, and collapse (or remove) its parent if
+//	necessary.
+//
+//----------
+//
+// Arguments:
+//	BloomTree*	root:	The tree's root.
+//	BloomTree*	node:	The node to remove. This is deleted.
+//
+// Returns:
+//	The tree's root; this is different than the incoming root if the root
+//	was collapsed.
+//
+//----------
+//
+// Notes:
+//	(1)	A parent left with only one child is replaced by that child; build
+//		doesn't allow a node to be an only child, and such a parent would be
+//		identical to the child anyway. A parent left with no children (all
+//		its leaves were removed) is itself removed.
+//	(2)	The caller has made sure that not every leaf is removed, so the root
+//		always keeps at least one child.
+//
+//----------
+
+BloomTree* RemoveSBTCommand::remove_node
+   (BloomTree*	root,
+	BloomTree*	node)
+	{
+	BloomTree* parent = node->parent;
+	if (parent == nullptr)
+		fatal ("internal error: in remove_node(\"" + node->name + "\")"
+		     + ", the node has no parent");
+
+	if (contains(debug,"removal"))
+		cerr << "removing " << node->name << " from "
+		     << ((parent->is_dummy())? "(dummy node)" : parent->name) << endl;
+
+	parent->remove_child(node);
+	rebuild.erase(node);
+	promoted.erase(node);
+	delete node;
+
+	if (parent->num_children() == 0)
+		return remove_node(root,parent);
+
+	if (parent->num_children() > 1)
+		return root;
+
+	// collapse the parent, promoting its remaining child into its place
+
+	BloomTree* onlyChild   = parent->child(0);
+	BloomTree* grandparent = parent->parent;
+
+	if (contains(debug,"removal"))
+		cerr << "collapsing "
+		     << ((parent->is_dummy())? "(dummy node)" : parent->name)
+		     << " into " << onlyChild->name << endl;
+
+	if (grandparent == nullptr)
+		{
+		parent->remove_child(onlyChild);
+		root = onlyChild;
+		}
+	else
+		{
+		parent->disown_children();
+		grandparent->replace_child(parent,onlyChild);
+		}
+
+	// nota bene: a dummy's child was already finished as a parentless node,
+	//            so promoting it into the dummy's place doesn't change it
+
+	if (not parent->is_dummy())
+		{
+		promoted.insert(onlyChild);
+		numCollapsed++;
+		}
+	rebuild.erase(parent);
+	promoted.erase(parent);
+	delete parent;
+
+	return root;
+	}
@@ -0,0 +1,46 @@
+#ifndef cmd_remove_sbt_H
+#define cmd_remove_sbt_H
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "bloom_tree.h"
+#include "commands.h"
+
+class RemoveSBTCommand: public Command
+	{
+public:
+	RemoveSBTCommand(const std::string& name): Command(name) {}
+	virtual ~RemoveSBTCommand();
+	virtual void short_description (std::ostream& s);
+	virtual void usage (std::ostream& s, const std::string& message="");
+	virtual void debug_help (std::ostream& s);
+	virtual void parse (int _argc, char** _argv);
+	virtual int execute (void);
+	virtual void reconstruct_children (BloomTree* node, const BloomFilter* nodeBf);
+	virtual BloomTree* remove_node (BloomTree* root, BloomTree* node);
+
+	std::string inTreeFilename;
+	std::string outTreeFilename;
+	std::string listFilename;
+	std::vector<std::string> leafNames;
+	bool trackMemory;
+
+	std::uint32_t bfKind;			// the kind of tree, and the compressor it
+	std::uint32_t compressor;		// .. was built with
+	std::unordered_set<BloomTree*> removed;	// leaves to remove
+	std::unordered_set<BloomTree*> rebuild;	// nodes that have to be computed
+									// .. anew
+	std::unordered_map<BloomTree*,BloomFilter*> unfinished;	// reconstructed
+									// .. unfinished forms of existing nodes
+	std::unordered_set<BloomTree*> promoted;	// nodes that took the place
+									// .. of a collapsed parent
+	std::uint64_t numCollapsed;
+	};
+
+#endif // cmd_remove_sbt_H
@@ -0,0 +1,595 @@
+// cmd_serve.cc-- answer queries of a sequence bloom tree, over a socket
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "utilities.h"
+#include "bit_vector.h"
+#include "bloom_filter.h"
+#include "bloom_tree.h"
+#include "file_manager.h"
+#include "query.h"
+
+#include "support.h"
+#include "commands.h"
+#include "cmd_serve.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+#define u32 std::uint32_t
+#define u64 std::uint64_t
+
+#define defaultMaxRequestBytes (64*1024*1024)
+#define defaultRequestTimeout  30
+
+
+void ServeCommand::short_description
+   (std::ostream& s)
+	{
+	s << commandName << "-- answer queries of a sequence bloom tree, over a socket" << endl;
+	}
+
+void ServeCommand::usage
+   (std::ostream& s,
+	const string& message)
+	{
+	if (!message.empty())
+		{
+		s << message << endl;
+		s << endl;
+		}
+
+	short_description(s);
+	s << "usage: " << commandName << " --tree=<filename> --socket=<filename> [options]" << endl;
+	//    123456789-123456789-123456789-123456789-123456789-123456789-123456789-123456789
+	s << "  --tree=<filename>    name of the topology file" << endl;
+	s << "  --socket=<filename>  name of the unix domain socket to listen on; any" << endl;
+	s << "                       existing file by this name is replaced" << endl;
+	s << "  --threshold=<F>      fraction of query kmers that must be present in a leaf" << endl;
+	s << "                       to be considered a match; this must be between 0 and 1" << endl;
+	s << "                       (default is " << defaultQueryThreshold << ")" << endl;
+	s << "  --adjust             adjust reported number of kmers present, compensating" << endl;
+	s << "                       for bloom filter false positives" << endl;
+	s << "  --sort               sort matched leaves by the number of query kmers present," << endl;
+	s << "                       and report the number of kmers present" << endl;
+	s << "  --distinctkmers      perform the query counting each distinct kmer only once" << endl;
+	s << "  --threads=<N>        number of threads to use for each batch of queries" << endl;
+	s << "                       (default is 1)" << endl;
+	s << "  --shardqueries       (requires --threads) split each batch of queries among" << endl;
+	s << "                       the threads" << endl;
+	s << "  --levelorder         search the tree one level at a time (breadth-first)" << endl;
+	s << "  --cache=<bytes>      keep up to this many bytes of bloom filters resident" << endl;
+	s << "                       between batches (e.g. --cache=8G)" << endl;
+	s << "                       (by default filters are unloaded after each batch)" << endl;
+	s << "  --mmap               access uncompressed bloom filter files by mapping them" << endl;
+	s << "                       into memory rather than reading them" << endl;
+	s << "  --verifychecksums    verify each bit vector's checksum as it is loaded" << endl;
+	s << "  --prefetch           load bloom filters in a background thread, ahead of" << endl;
+	s << "                       the search; this can keep one extra filter resident" << endl;
+	s << "                       for each level of the tree" << endl;
+	s << "  --mergelookups       at each node, look up the kmers of all the queries" << endl;
+	s << "                       together, in sorted order and once per distinct kmer" << endl;
+	s << "  --maxrequest=<bytes> largest request to accept; a larger request is answered" << endl;
+	s << "                       with an error (default is " << (defaultMaxRequestBytes/(1024*1024)) << "M)" << endl;
+	s << "  --timeout=<seconds>  how long a client may stall while sending its request;" << endl;
+	s << "                       0 means no limit (default is " << defaultRequestTimeout << ")" << endl;
+	s << endl;
+	s << "Each connection to the socket is one batch of queries. The client writes the" << endl;
+	s << "queries, in the same form as query files for the query command, then shuts" << endl;
+	s << "down its side of the connection for writing. The results are written back in" << endl;
+	s << "the same form as the query command's output, and the connection is closed." << endl;
+	s << "Connections are handled one at a time, in the order they arrive; a client" << endl;
+	s << "waits while earlier batches are searched." << endl;
+	s << "For example:" << endl;
+	s << "  nc -N -U <socketfilename> < queries.fa" << endl;
+	}
+
+void ServeCommand::debug_help
+   (std::ostream& s)
+	{
+	s << "--debug= options" << endl;
+	s << "  trackmemory" << endl;
+	s << "  btunload" << endl;
+	s << "  load" << endl;
+	s << "  requests" << endl;
+	}
+
+void ServeCommand::parse
+   (int		_argc,
+	char**	_argv)
+	{
+	int		argc;
+	char**	argv;
+
+	// defaults
+
+	generalQueryThreshold   = -1.0;		// (unassigned threshold)
+	adjustKmerCounts        = false;
+	sortByKmerCounts        = false;
+	onlyLeaves              = false;
+	distinctKmers           = false;
+	checkConsistency        = false;
+	verifyChecksums         = false;
+	justReportKmerCounts    = false;
+	countAllKmerHits        = false;
+	reportNodesExamined     = false;
+	collectNodeStats        = false;
+	reportTime              = false;
+	backwardCompatibleStyle = false;
+	numThreads              = 1;
+	shardQueries            = false;
+	levelOrder              = false;
+	useMemoryMap            = false;
+	nodeCacheBytes          = 0;
+	prefetchFilters         = false;
+	mergeLookups            = false;
+	maxRequestBytes         = defaultMaxRequestBytes;
+	requestTimeout          = defaultRequestTimeout;
+
+	// skip command name
+
+	argv = _argv+1;  argc = _argc - 1;
+	if (argc <= 0) chastise ();
+
+	//////////
+	// scan arguments
+	//////////
+
+	for (int argIx=0 ; argIx<argc ; argIx++)
+		{
+		string arg = argv[argIx];
+		string argVal;
+		if (arg.empty()) continue;
+
+		string::size_type argValIx = arg.find('=');
+		if (argValIx == string::npos) argVal = "";
+		                         else argVal = arg.substr(argValIx+1);
+
+		// --help, etc.
+
+		if ((arg == "--help")
+		 || (arg == "-help")
+		 || (arg == "--h")
+		 || (arg == "-h")
+		 || (arg == "?")
+		 || (arg == "-?")
+		 || (arg == "--?"))
+			{ usage (cerr);  std::exit (EXIT_SUCCESS); }
+
+		if ((arg == "--help=debug")
+		 || (arg == "--help:debug")
+		 || (arg == "?debug"))
+			{ debug_help(cerr);  std::exit (EXIT_SUCCESS); }
+
+		// --tree=<filename>, etc.
+
+		if ((is_prefix_of (arg, "--tree="))
+		 ||	(is_prefix_of (arg, "--intree="))
+		 ||	(is_prefix_of (arg, "--topology=")))
+			{ treeFilename = argVal;  continue; }
+
+		// --socket=<filename>
+
+		if ((is_prefix_of (arg, "--socket="))
+		 ||	(is_prefix_of (arg, "--listen=")))
+			{ socketFilename = argVal;  continue; }
+
+		// --threshold=<F>
+
+		if ((is_prefix_of (arg, "--threshold="))
+		 ||	(is_prefix_of (arg, "--query-threshold="))
+		 ||	(is_prefix_of (arg, "--theta="))
+		 ||	(is_prefix_of (arg, "--specificity=")))
+			{ generalQueryThreshold = string_to_probability(argVal);  continue; }
+
+		// --adjust
+
+		if (arg == "--adjust")
+			{ adjustKmerCounts = true;  continue; }
+
+		// --sort
+
+		if (arg == "--sort")
+			{ sortByKmerCounts = true;  continue; }
+
+		// --distinctkmers
+
+		if ((arg == "--distinctkmers")
+		 || (arg == "--distinct-kmers")
+		 || (arg == "--distinct"))
+			{ distinctKmers = true;  continue; }
+
+		// --threads=<N>
+
+		if ((is_prefix_of (arg, "--threads="))
+		 ||	(is_prefix_of (arg, "T="))
+		 ||	(is_prefix_of (arg, "--T=")))
+			{
+			numThreads = string_to_u32(argVal);
+			if (numThreads == 0)
+				chastise ("(in \"" + arg + "\") number of threads cannot be zero");
+			continue;
+			}
+
+		// --shardqueries
+
+		if ((arg == "--shardqueries")
+		 || (arg == "--shard-queries")
+		 || (arg == "--shard"))
+			{ shardQueries = true;  continue; }
+
+		// --levelorder
+
+		if ((arg == "--levelorder")
+		 || (arg == "--level-order")
+		 || (arg == "--breadthfirst")
+		 || (arg == "--breadth-first"))
+			{ levelOrder = true;  continue; }
+
+		// --cache=<bytes>
+
+		if ((is_prefix_of (arg, "--cache="))
+		 ||	(is_prefix_of (arg, "--nodecache=")))
+			{ nodeCacheBytes = string_to_unitized_u64(argVal,1024);  continue; }
+
+		// --mmap
+
+		if ((arg == "--mmap")
+		 || (arg == "--memorymap")
+		 || (arg == "--memory-map"))
+			{ useMemoryMap = true;  continue; }
+
+		// --verifychecksums
+
+		if ((arg == "--verifychecksums")
+		 || (arg == "--verifychecksum")
+		 || (arg == "--checksums"))
+			{ verifyChecksums = true;  continue; }
+
+		// --prefetch
+
+		if ((arg == "--prefetch")
+		 || (arg == "--prefetchfilters"))
+			{ prefetchFilters = true;  continue; }
+
+		// --mergelookups
+
+		if ((arg == "--mergelookups")
+		 || (arg == "--merge-lookups")
+		 || (arg == "--sortedlookups")
+		 || (arg == "--sorted-lookups"))
+			{ mergeLookups = true;  continue; }
+
+		// --maxrequest=<bytes>
+
+		if ((is_prefix_of (arg, "--maxrequest="))
+		 ||	(is_prefix_of (arg, "--max-request=")))
+			{ maxRequestBytes = string_to_unitized_u64(argVal,1024);  continue; }
+
+		// --timeout=<seconds>
+
+		if (is_prefix_of (arg, "--timeout="))
+			{ requestTimeout = string_to_u32(argVal);  continue; }
+
+		// (unadvertised) debug options
+
+		if (arg == "--debug")
+			{ debug.insert ("debug");  continue; }
+
+		if (is_prefix_of (arg, "--debug="))
+			{
+		    for (const auto& field : parse_comma_list(argVal))
+				debug.insert(to_lower(field));
+			continue;
+			}
+
+		// unrecognized --option
+
+		if (is_prefix_of (arg, "--"))
+			chastise ("unrecognized option: \"" + arg + "\"");
+
+		chastise ("unrecognized argument: \"" + arg + "\"");
+		}
+
+	// sanity checks
+
+	if (treeFilename.empty())
+		chastise ("you have to provide a tree topology file");
+
+	if (socketFilename.empty())
+		chastise ("you have to provide a socket filename");
+
+	if (socketFilename.length() >= sizeof(((struct sockaddr_un*) 0)->sun_path))
+		chastise ("the socket filename \"" + socketFilename + "\" is too long"
+		          " (it can have at most "
+		        + std::to_string(sizeof(((struct sockaddr_un*) 0)->sun_path)-1) + " characters)");
+
+	if (maxRequestBytes == 0)
+		chastise ("--maxrequest must be positive");
+
+	if ((shardQueries) and (numThreads < 2))
+		chastise ("--shardqueries requires --threads=<N>, with N at least 2");
+
+	if ((levelOrder) and (numThreads > 1) and (not shardQueries))
+		chastise ("--levelorder can only be used with --threads=<N> if --shardqueries is also used");
+
+	completeKmerCounts = (adjustKmerCounts) or (sortByKmerCounts);
+
+	if (generalQueryThreshold < 0.0)
+		generalQueryThreshold = defaultQueryThreshold;
+
+	return;
+	}
+
+ServeCommand::~ServeCommand()
+	{
+	// (QueryCommand's destructor deletes any queries)
+	}
+
+int ServeCommand::execute()
+	{
+	if (contains(debug,"trackmemory"))
+		{
+		FileManager::trackMemory = true;
+		BloomTree::trackMemory   = true;
+		BloomFilter::trackMemory = true;
+		BitVector::trackMemory   = true;
+		}
+	if (contains(debug,"btunload"))
+		BloomTree::reportUnload = true;
+
+	if (useMemoryMap)
+		BitVector::useMemoryMap = true;
+
+	if (verifyChecksums)
+		BitVector::verifyChecksums = true;
+
+	BloomTree::cacheBudget = nodeCacheBytes;
+	BloomTree::prefetchFilters = prefetchFilters;
+	BloomTree::mergeLookups    = mergeLookups;
+
+	// read the tree, and set up the file manager; these persist for as long
+	// as we're serving requests
+
+	BloomTree* root = BloomTree::read_topology(treeFilename,onlyLeaves);
+	useFileManager = root->nodesShareFiles;
+
+	if (contains(debug,"load"))
+		{
+		vector<BloomTree*> order;
+		root->post_order(order);
+		for (const auto& node : order)
+			node->reportLoad = true;
+		}
+
+	FileManager* manager = nullptr;
+	if (useFileManager)
+		{
+		manager = new FileManager(root,/*validateConsistency*/false);
+		if (contains(debug,"load"))
+			manager->reportLoad = true;
+		}
+
+	// create the socket
+
+	int listenFd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0)
+		fatal ("error: failed to create a socket (" + string(strerror(errno)) + ")");
+
+	// nota bene: a path that doesn't fit in sun_path (with its terminating
+	//            NUL) would be cut short, and we'd bind somewhere else than
+	//            the user asked for; parse() rejects these, but we make sure
+
+	struct sockaddr_un address;
+	std::memset (&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketFilename.length() >= sizeof(address.sun_path))
+		fatal ("error: the socket filename \"" + socketFilename + "\" is too long"
+		       " (it can have at most " + std::to_string(sizeof(address.sun_path)-1) + " characters)");
+	std::memcpy (address.sun_path, socketFilename.c_str(), socketFilename.length()+1);
+
+	unlink (socketFilename.c_str());
+	if (bind (listenFd, (struct sockaddr*) &address, sizeof(address)) != 0)
+		fatal ("error: failed to bind socket to \"" + socketFilename + "\""
+		     + " (" + string(strerror(errno)) + ")");
+	if (listen (listenFd, /*backlog*/ 16) != 0)
+		fatal ("error: failed to listen on \"" + socketFilename + "\""
+		     + " (" + string(strerror(errno)) + ")");
+
+	cerr << "listening on \"" << socketFilename << "\"" << endl;
+
+	// serve requests, one at a time, until we're killed
+
+	// nota bene: a failed accept usually concerns only the connection being
+	//            accepted (e.g. the client gave up), or is a transient lack
+	//            of resources (e.g. EMFILE); neither is a reason to stop
+	//            serving, so we report it and go on; only a problem with the
+	//            listening socket itself is fatal
+
+	while (true)
+		{
+		int fd = accept (listenFd, nullptr, nullptr);
+		if (fd < 0)
+			{
+			if (errno == EINTR) continue;
+			if ((errno == EBADF) or (errno == EINVAL) or (errno == ENOTSOCK)
+			 or (errno == EOPNOTSUPP) or (errno == EFAULT))
+				fatal ("error: failed to accept a connection on \"" + socketFilename + "\""
+				     + " (" + string(strerror(errno)) + ")");
+			cerr << "warning: failed to accept a connection"
+			     << " (" << strerror(errno) << ")" << endl;
+			if ((errno == EMFILE) or (errno == ENFILE)
+			 or (errno == ENOBUFS) or (errno == ENOMEM))
+				sleep (1);	// (give resources a chance to be freed)
+			continue;
+			}
+
+		// nota bene: requests are served serially, so a client that connects
+		//            and then stalls would block everyone behind it; the
+		//            receive timeout bounds how long that can last
+
+		if (requestTimeout > 0)
+			{
+			struct timeval timeout;
+			timeout.tv_sec  = requestTimeout;
+			timeout.tv_usec = 0;
+			if (setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0)
+				cerr << "warning: failed to set a receive timeout"
+				     << " (" << strerror(errno) << ")" << endl;
+			}
+
+		serve_request (fd, root);
+		close (fd);
+		}
+
+	return EXIT_SUCCESS;  // execution never reaches here
+	}
+
+//----------
+//
+// serve_request--
+//	Read a batch of queries from a connection, search the tree for them, and
+//	write the results back to the connection.
+//
+//----------
+//
+// Notes:
+//	(1)	Query::read_query_file() treats a malformed query file as a fatal
+//		error, which would take the server down. So we reject the one form of
+//		malformation it checks for (sequences before the first fasta header)
+//		here, reporting it to the client instead.
+//	(2)	A request larger than maxRequestBytes is answered with an error
+//		rather than read in full, so that one client can't exhaust our memory.
+//		Likewise a client that stalls for longer than the receive timeout is
+//		dropped.
+//
+//----------
+
+void ServeCommand::serve_request
+   (int			fd,
+	BloomTree*	root)
+	{
+	// read the request, until the client shuts down its side of the
+	// connection
+
+	string request;
+	char   buffer[64*1024];
+	bool   tooLarge = false;
+	while (true)
+		{
+		ssize_t bytesRead = recv (fd, buffer, sizeof(buffer), 0);
+		if (bytesRead == 0) break;
+		if (bytesRead < 0)
+			{
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN) or (errno == EWOULDBLOCK))
+				cerr << "warning: timed out reading request" << endl;
+			else
+				cerr << "warning: failed to read request"
+				     << " (" << strerror(errno) << ")" << endl;
+			return;
+			}
+		if (request.length() + bytesRead > maxRequestBytes)
+			{ tooLarge = true;  break; }
+		request.append (buffer, bytesRead);
+		}
+
+	// make sure the request won't fail inside read_query_file (see note 1)
+
+	string response;
+	if (tooLarge)
+		{
+		cerr << "warning: rejected a request larger than "
+		     << maxRequestBytes << " bytes" << endl;
+		response = "error: request is larger than " + std::to_string(maxRequestBytes)
+		         + " bytes\n";
+		}
+	else
+		{
+		bool   sawFastaHeader = false;
+		bool   sawSequence    = false;
+		std::istringstream lines(request);
+		string line;
+		while (std::getline (lines, line))
+			{
+			if (line.empty()) continue;
+			if (line[0] == '>') { sawFastaHeader = true;  continue; }
+			if (sawFastaHeader) continue;
+			sawSequence = true;
+			}
+		if ((sawFastaHeader) and (sawSequence))
+			response = "error: sequences precede first fasta header\n";
+		}
+
+	// parse the queries and perform the search
+
+	if (response.empty())
+		{
+		std::istringstream in(request);
+		Query::read_query_file (in, /*filename*/ "", generalQueryThreshold, queries);
+		if (contains(debug,"requests"))
+			cerr << "request: " << queries.size() << " queries" << endl;
+
+		if (not queries.empty())
+			{
+			search (root);
+			if (sortByKmerCounts)
+				sort_matches_by_kmer_counts();
+
+			std::ostringstream out;
+			if (completeKmerCounts)
+				print_matches_with_kmer_counts (out);
+			else
+				print_matches (out);
+			response = out.str();
+			}
+
+		discard_queries();
+		}
+
+	// write the response
+
+	const char* scan      = response.data();
+	size_t      remaining = response.length();
+	while (remaining > 0)
+		{
+		ssize_t bytesWritten = send (fd, scan, remaining, MSG_NOSIGNAL);
+		if (bytesWritten < 0)
+			{
+			if (errno == EINTR) continue;
+			cerr << "warning: failed to write response"
+			     << " (" << strerror(errno) << ")" << endl;
+			return;
+			}
+		scan      += bytesWritten;
+		remaining -= bytesWritten;
+		}
+	}
+
+//----------
+//
+// discard_queries--
+//	Delete the queries from the most recent request.
+//
+//----------
+
+void ServeCommand::discard_queries()
+	{
+	for (const auto& q : queries)
+		delete q;
+	queries.clear();
+	}
@@ -0,0 +1,34 @@
+#ifndef cmd_serve_H
+#define cmd_serve_H
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+
+#include "bloom_tree.h"
+#include "cmd_query.h"
+
+// ServeCommand is a QueryCommand that reads its queries from a socket rather
+// than from files; it shares QueryCommand's settings and its output methods
+
+class ServeCommand: public QueryCommand
+	{
+public:
+	ServeCommand(const std::string& name): QueryCommand(name) {}
+	virtual ~ServeCommand();
+	virtual void short_description (std::ostream& s);
+	virtual void usage (std::ostream& s, const std::string& message="");
+	virtual void debug_help (std::ostream& s);
+	virtual void parse (int _argc, char** _argv);
+	virtual int execute (void);
+	virtual void serve_request (int fd, BloomTree* root);
+	virtual void discard_queries (void);
+
+	std::string socketFilename;
+	std::uint64_t maxRequestBytes;	// largest request we'll accept
+	std::uint32_t requestTimeout;	// seconds a client may stall while sending
+									// .. its request (0 means no limit)
+	};
+
+#endif // cmd_serve_H
@@ -0,0 +1,357 @@
+// cmd_validate_popcount.cc-- validate the popcount kernels against a
+// bit-by-bit count
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <random>
+
+#include "utilities.h"
+#include "bit_utilities.h"
+#include "prng.h"
+
+#include "support.h"
+#include "commands.h"
+#include "cmd_validate_popcount.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+#define u8  std::uint8_t
+#define u32 std::uint32_t
+#define u64 std::uint64_t
+
+void ValidatePopcountCommand::short_description
+   (std::ostream& s)
+	{
+	s << commandName << "-- validate the popcount kernels used for counting bits" << endl;
+	}
+
+void ValidatePopcountCommand::usage
+   (std::ostream& s,
+	const string& message)
+	{
+	if (!message.empty())
+		{
+		s << message << endl;
+		s << endl;
+		}
+
+	short_description(s);
+	s << "usage: " << commandName << " [options]" << endl;
+	//    123456789-123456789-123456789-123456789-123456789-123456789-123456789-123456789
+	s << "  --trials=<N>    number of random bit arrays to count" << endl;
+	s << "                  (default is " << defaultNumTrials << ")" << endl;
+	s << "  --maxbits=<N>   largest bit array length to try" << endl;
+	s << "                  (default is " << defaultMaxBits << ")" << endl;
+	s << "  --seed=<string> random number generator seed" << endl;
+	s << endl;
+	s << "Each popcount kernel this cpu supports (avx-512, avx2, popcnt, and the lookup" << endl;
+	s << "table) is used in turn to count random bit arrays, with bitwise_count and the" << endl;
+	s << "bitwise_*_count functions; each count is compared to a bit-by-bit count. The" << endl;
+	s << "arrays have random lengths, so most end in a partial word, and begin at random" << endl;
+	s << "byte offsets, so most are not word-aligned." << endl;
+	}
+
+void ValidatePopcountCommand::debug_help
+   (std::ostream& s)
+	{
+	s << "--debug= options" << endl;
+	s << "  trials" << endl;
+	}
+
+void ValidatePopcountCommand::parse
+   (int		_argc,
+	char**	_argv)
+	{
+	int		argc;
+	char**	argv;
+
+	// defaults
+
+	prngSeed  = "";
+	numTrials = defaultNumTrials;
+	maxBits   = defaultMaxBits;
+
+	// skip command name
+
+	argv = _argv+1;  argc = _argc - 1;
+	// if (argc <= 0) chastise ();   for this command, this is not a problem
+
+	//////////
+	// scan arguments
+	//////////
+
+	for (int argIx=0 ; argIx<argc ; argIx++)
+		{
+		string arg = argv[argIx];
+		string argVal;
+		if (arg.empty()) continue;
+
+		string::size_type argValIx = arg.find('=');
+		if (argValIx == string::npos) argVal = "";
+		                         else argVal = arg.substr(argValIx+1);
+
+		// --help, etc.
+
+		if ((arg == "--help")
+		 || (arg == "-help")
+		 || (arg == "--h")
+		 || (arg == "-h")
+		 || (arg == "?")
+		 || (arg == "-?")
+		 || (arg == "--?"))
+			{ usage (cerr);  std::exit (EXIT_SUCCESS); }
+
+		if ((arg == "--help=debug")
+		 || (arg == "--help:debug")
+		 || (arg == "?debug"))
+			{ debug_help(cerr);  std::exit (EXIT_SUCCESS); }
+
+		// --trials=<N>
+
+		if (is_prefix_of (arg, "--trials="))
+			{
+			numTrials = string_to_unitized_u32(argVal);
+			if (numTrials == 0)
+				chastise ("--trials must be at least one (in \"" + arg + "\")");
+			continue;
+			}
+
+		// --maxbits=<N>
+
+		if (is_prefix_of (arg, "--maxbits="))
+			{ maxBits = string_to_unitized_u32(argVal);  continue; }
+
+		// --seed=<string>
+
+		if (is_prefix_of (arg, "--seed="))
+			{ prngSeed = argVal;  continue; }
+
+		// (unadvertised) debug options
+
+		if (arg == "--debug")
+			{ debug.insert ("debug");  continue; }
+
+		if (is_prefix_of (arg, "--debug="))
+			{
+		    for (const auto& field : parse_comma_list(argVal))
+				debug.insert(to_lower(field));
+			continue;
+			}
+
+		// unrecognized --option
+
+		if (is_prefix_of (arg, "--"))
+			chastise ("unrecognized option: \"" + arg + "\"");
+
+		// unrecognized argument
+
+		chastise ("unrecognized argument: \"" + arg + "\"");
+		}
+
+	return;
+	}
+
+//----------
+//
+// execute--
+//
+//----------
+//
+// Notes:
+//	(1)	Each trial fills two arrays with one of four patterns -- random bits,
+//		sparse bits, all zeros, or all ones -- so that the avx2 kernel's
+//		carry-save adders see both their typical and their extreme inputs.
+//	(2)	The bytes past the end of each array are also filled, and so are the
+//		unused bits of a partial final byte. The counting functions must
+//		ignore these, so a function that reads too far gets a wrong count.
+//	(3)	The reference count reads one bit at a time, independent of any
+//		kernel.
+//
+//----------
+
+enum
+	{
+	popop_count  = 0,
+	popop_and    = 1,
+	popop_mask   = 2,
+	popop_or     = 3,
+	popop_or_not = 4,
+	popop_xor    = 5,
+	popop_end
+	};
+
+static const char* popOpName[popop_end] =
+	{ "bitwise_count", "bitwise_and_count", "bitwise_mask_count",
+	  "bitwise_or_count", "bitwise_or_not_count", "bitwise_xor_count" };
+
+static u64 reference_count
+   (int			op,
+	const u8*	bits1,
+	const u8*	bits2,
+	u64			numBits)
+	{
+	u64 numOnes = 0;
+	for (u64 pos=0 ; pos<numBits ; pos++)
+		{
+		int b1 = (bits1[pos/8] >> (pos%8)) & 1;
+		int b2 = (bits2[pos/8] >> (pos%8)) & 1;
+		int b;
+		switch (op)
+			{
+			case popop_count:  b = b1;         break;
+			case popop_and:    b = b1 & b2;    break;
+			case popop_mask:   b = b1 & (!b2); break;
+			case popop_or:     b = b1 | b2;    break;
+			case popop_or_not: b = b1 | (!b2); break;
+			default:           b = b1 ^ b2;    break;
+			}
+		numOnes += b;
+		}
+	return numOnes;
+	}
+
+static u64 kernel_count
+   (int			op,
+	const u8*	bits1,
+	const u8*	bits2,
+	u64			numBits)
+	{
+	switch (op)
+		{
+		case popop_count:  return bitwise_count        (bits1, numBits);
+		case popop_and:    return bitwise_and_count    (bits1, bits2, numBits);
+		case popop_mask:   return bitwise_mask_count   (bits1, bits2, numBits);
+		case popop_or:     return bitwise_or_count     (bits1, bits2, numBits);
+		case popop_or_not: return bitwise_or_not_count (bits1, bits2, numBits);
+		default:           return bitwise_xor_count    (bits1, bits2, numBits);
+		}
+	}
+
+int ValidatePopcountCommand::execute()
+	{
+	std::mt19937* prng = seeded_prng(prngSeed);
+	std::uniform_int_distribution<u32> lengthSpinner(0,maxBits);
+	std::uniform_int_distribution<u32> offsetSpinner(0,7);
+	std::uniform_int_distribution<u32> byteSpinner(0,255);
+	std::uniform_int_distribution<u32> sparseSpinner(0,63);
+
+	// allocate the arrays; each has room for the largest length, a starting
+	// offset of up to 7 bytes, and 8 trailing bytes (see note 2)
+
+	u64 bufferBytes = (maxBits+7)/8 + 7 + 8;
+	vector<u64> buffer1((bufferBytes+7)/8);
+	vector<u64> buffer2((bufferBytes+7)/8);
+	u8* bytes1 = (u8*) buffer1.data();
+	u8* bytes2 = (u8*) buffer2.data();
+
+	// check each supported kernel
+
+	u64 numFailures = 0;
+	for (int kernel=popcntkernel_table ; kernel<=popcntkernel_avx512 ; kernel++)
+		{
+		string kernelName = bitwise_popcount_kernel_name(kernel);
+		if (not bitwise_set_popcount_kernel(kernel))
+			{
+			cout << kernelName << ": not supported" << endl;
+			continue;
+			}
+
+		u64 kernelFailures = 0;
+		for (u32 trial=0 ; trial<numTrials ; trial++)
+			{
+			u32 numBits = lengthSpinner(*prng);
+			u32 offset1 = offsetSpinner(*prng);
+			u32 offset2 = offsetSpinner(*prng);
+
+			// fill the arrays (see notes 1 and 2)
+
+			for (u64 ix=0 ; ix<bufferBytes ; ix++)
+				{
+				u8 byte1, byte2;
+				switch (trial % 4)
+					{
+					case 0:
+						byte1 = byteSpinner(*prng);
+						byte2 = byteSpinner(*prng);
+						break;
+					case 1:
+						byte1 = (sparseSpinner(*prng) == 0)? (1 << offsetSpinner(*prng)) : 0;
+						byte2 = (sparseSpinner(*prng) == 0)? (1 << offsetSpinner(*prng)) : 0;
+						break;
+					case 2:
+						byte1 = byte2 = 0;
+						break;
+					default:
+						byte1 = byte2 = 0xFF;
+						break;
+					}
+				bytes1[ix] = byte1;
+				bytes2[ix] = byte2;
+				}
+
+			u64 bitsBytes = (numBits+7)/8;
+			for (u64 ix=bitsBytes ; ix<bitsBytes+8 ; ix++)
+				{
+				bytes1[offset1+ix] ^= 0xFF;
+				bytes2[offset2+ix] ^= 0xFF;
+				}
+			if (numBits % 8 != 0)
+				{
+				u8 unusedBits = ~((1 << (numBits % 8)) - 1);
+				bytes1[offset1+bitsBytes-1] ^= unusedBits;
+				bytes2[offset2+bitsBytes-1] ^= unusedBits;
+				}
+
+			// compare the counts
+
+			const u8* bits1 = bytes1 + offset1;
+			const u8* bits2 = bytes2 + offset2;
+			for (int op=popop_count ; op<popop_end ; op++)
+				{
+				u64 expected = reference_count (op, bits1, bits2, numBits);
+				u64 counted  = kernel_count    (op, bits1, bits2, numBits);
+				if (contains(debug,"trials"))
+					cerr << kernelName << " trial " << trial
+					     << ": " << popOpName[op] << "(" << numBits << " bits"
+					     << ", offsets " << offset1 << "," << offset2 << ")"
+					     << " = " << counted << " (expected " << expected << ")" << endl;
+				if (counted == expected) continue;
+
+				if (kernelFailures < 10)
+					cout << kernelName << ": " << popOpName[op]
+					     << " counted " << counted << " but expected " << expected
+					     << " (trial " << trial << ", " << numBits << " bits"
+					     << ", offsets " << offset1 << "," << offset2 << ")" << endl;
+				kernelFailures++;
+				}
+			}
+
+		if (kernelFailures == 0)
+			cout << kernelName << ": " << numTrials << " trials, no differences" << endl;
+		else
+			cout << kernelName << ": " << kernelFailures << " differences" << endl;
+		numFailures += kernelFailures;
+		}
+
+	bitwise_set_popcount_kernel(-1);
+	delete prng;
+
+	// tell the user how it went
+
+	if (numFailures == 0)
+		{
+		cout << "TEST SUCCEEDED" << std::endl;
+		return EXIT_SUCCESS;
+		}
+	else
+		{
+		cout << "TEST FAILED" << std::endl;
+		return EXIT_FAILURE;
+		}
+	}
@@ -0,0 +1,31 @@
+#ifndef cmd_validate_popcount_H
+#define cmd_validate_popcount_H
+
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+
+#include "commands.h"
+
+class ValidatePopcountCommand: public Command
+	{
+public:
+	static const std::uint32_t defaultNumTrials = 1000;
+	static const std::uint32_t defaultMaxBits   = 5000;
+
+public:
+	ValidatePopcountCommand(const std::string& name): Command(name) {}
+	virtual ~ValidatePopcountCommand() {}
+	virtual void short_description (std::ostream& s);
+	virtual void usage (std::ostream& s, const std::string& message="");
+	virtual void debug_help (std::ostream& s);
+	virtual void parse (int _argc, char** _argv);
+	virtual int execute (void);
+
+	std::string prngSeed;
+	std::uint32_t numTrials;
+	std::uint32_t maxBits;
+	};
+
+#endif // cmd_validate_popcount_H
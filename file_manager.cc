@@ -10,7 +10,9 @@
 #include <chrono>
 
 #include "utilities.h"
+#include "bloom_filter_file.h"
 #include "bloom_filter.h"
+#include "packed_tree_file.h"
 #include "bloom_tree.h"
 #include "file_manager.h"
 
@@ -20,6 +22,7 @@ using std::pair;
 using std::cerr;
 using std::endl;
 #define u32 std::uint32_t
+#define u64 std::uint64_t
 
 //----------
 //
@@ -43,7 +46,9 @@ std::ifstream* FileManager::openedFile      = nullptr;
 FileManager::FileManager
    (BloomTree*	root,
 	bool		validateConsistency)
-	  :	modelBf(nullptr)
+	  :	modelBf(nullptr),
+		packFilename(root->packFilename),
+		packDirectory(nullptr)
 	{
 	// scan the tree, setting up hashes from (a) node name to a node's filter
 	// filename and from (b) filter filename to names of nodes within; we also
@@ -79,9 +84,29 @@ FileManager::FileManager
 		filenameToNames[node->bfFilename]->emplace_back(node->name);
 		}
 
+	// if the tree came from a packed file, read its directory now; this is
+	// one read, and lets us find any node's header without further reads;
+	// the content of each embedded file is identified only when one of its
+	// nodes is first reached
+
+	if (not packFilename.empty())
+		{
+		read_packed_directory (packFilename);
+		for (const auto& node : order)
+			{
+			if (packNameToEntry.count(node->name) == 0)
+				fatal ("error: \"" + packFilename + "\""
+				     + " doesn't contain the bloom filter \"" + node->name + "\""
+				     + ", in conflict with the tree's topology");
+			}
+		}
+
 	// preload the content headers for every node, file-by-file; this has
 	// two side effects -- (1) the bloom filter properties are checked for
 	// consistency, and (2) we are installed as every bloom filter's manager
+	//
+	// nota bene: without this, content is preloaded on demand, and each
+	//            header is checked against the first one encountered
 
 	if (validateConsistency)
 		{
@@ -102,6 +127,12 @@ FileManager::~FileManager()
 		cerr << "@-" << this << " destructor FileManager" << endl;
 
 	if (modelBf != nullptr) delete modelBf;
+	if (packDirectory != nullptr)
+		{
+		if (trackMemory)
+			cerr << "@-" << (void*) packDirectory << " discarding directory for \"" << packFilename << "\"" << endl;
+		delete[] packDirectory;
+		}
 	for (auto iter : filenameToNames) 
 		{
 		vector<string>* names = iter.second;
@@ -116,7 +147,8 @@ FileManager::~FileManager()
 	}
 
 void FileManager::preload_content
-   (const string&	filename)
+   (const string&	filename,
+	const string&	whichNodeName)
 	{
 	wall_time_ty startTime;
 
@@ -126,6 +158,21 @@ void FileManager::preload_content
 
 	if (alreadyPreloaded[filename]) return;
 
+	// if this is a packed file, we only need to identify the embedded file
+	// containing the node (or all of them if no node is specified)
+
+	if (filename == packFilename)
+		{
+		if (whichNodeName != "")
+			preload_packed_entry (packNameToEntry[whichNodeName]);
+		else
+			{
+			for (u32 entryIx=0 ; entryIx<packEntryPos.size() ; entryIx++)
+				preload_packed_entry (entryIx);
+			}
+		return;
+		}
+
 	// $$$ add trackMemory for in
 	if (BloomFilter::reportLoadTime || BloomFilter::reportTotalLoadTime) startTime = get_wall_time();
 	std::ifstream* in = FileManager::open_file(filename,std::ios::binary|std::ios::in,
@@ -145,6 +192,62 @@ void FileManager::preload_content
 	vector<pair<string,BloomFilter*>> content
 		= BloomFilter::identify_content(*in,filename);
 
+	vector<string>* nodeNames = filenameToNames[filename];
+	if (content.size() != nodeNames->size())
+		fatal ("error: \"" + filename + "\""
+		     + " contains " + std::to_string(content.size()) + " bloom filters"
+		     + ", in conflict with the tree's topology"
+		     + " (expected " + std::to_string(nodeNames->size()) + ")");
+
+	for (const auto& templatePair : content)
+		{
+		string bfName = templatePair.first;
+		if (not contains (*nodeNames, bfName))
+			fatal ("error: \"" + filename + "\""
+			     + " contains the bloom filter \"" + bfName + "\""
+			     + ", in conflict with the tree's topology");
+		}
+
+	install_content (filename, content);
+	alreadyPreloaded[filename] = true;
+
+	// $$$ add trackMemory for in
+	FileManager::close_file(in);
+	}
+
+//----------
+//
+// install_content--
+//	Copy the properties of template bloom filters into the corresponding
+//	nodes' filters, creating those filters if necessary.
+//
+//----------
+//
+// Arguments:
+//	const string&	filename:	The name of the file the content came from.
+//	vector<..>&		content:	The content, as reported by
+//								BloomFilter::identify_content(). The template
+//								filters are consumed.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	Templates whose names aren't in the tree are discarded; the caller is
+//		expected to have validated the content against the topology, if that
+//		is appropriate. (A packed tree file contains a filter for every node,
+//		but the tree may consist of only the leaves.)
+//	(2)	Each filter is checked for consistency against the first one we
+//		encountered.
+//
+//----------
+
+void FileManager::install_content
+   (const string&						filename,
+	vector<pair<string,BloomFilter*>>&	content)
+	{
 	if (dbgContentLoad)
 		{
 		cerr << "FileManager::preload_content, \"" << filename << "\" contains" << endl;
@@ -157,21 +260,12 @@ void FileManager::preload_content
 			}
 		}
 
-	vector<string>* nodeNames = filenameToNames[filename];
-	if (content.size() != nodeNames->size())
-		fatal ("error: \"" + filename + "\""
-		     + " contains " + std::to_string(content.size()) + " bloom filters"
-		     + ", in conflict with the tree's topology"
-		     + " (expected " + std::to_string(nodeNames->size()) + ")");
-
 	for (const auto& templatePair : content)
 		{
 		string       bfName     = templatePair.first;
 		BloomFilter* templateBf = templatePair.second;
-		if (not contains (*nodeNames, bfName))
-			fatal ("error: \"" + filename + "\""
-			     + " contains the bloom filter \"" + bfName + "\""
-			     + ", in conflict with the tree's topology");
+		if (nameToNode.count(bfName) == 0)
+			{ delete templateBf;  continue; }
 
 		BloomTree* node = nameToNode[bfName];
 		if (dbgContentLoad)
@@ -213,11 +307,6 @@ void FileManager::preload_content
 		else
 			node->bf->is_consistent_with(modelBf,/*beFatal*/true);
 		}
-
-	alreadyPreloaded[filename] = true;
-
-	// $$$ add trackMemory for in
-	FileManager::close_file(in);
 	}
 
 void FileManager::load_content
@@ -230,6 +319,19 @@ void FileManager::load_content
 		fatal ("internal error: attempt to load content from"
 		       " unknown file \"" + filename + "\"");
 
+	// for a packed file, we need only the embedded file containing the node
+
+	if ((filename == packFilename) and (_whichNodeName != ""))
+		{
+		preload_content(filename,_whichNodeName);
+		if (dbgContentLoad)
+			cerr << "FileManager::load_content nodeName = \"" << _whichNodeName << "\"" << endl;
+		BloomTree* node = nameToNode[_whichNodeName];
+		node->bf->reportLoad = reportLoad;
+		node->bf->load(/*bypassManager*/ true);
+		return;
+		}
+
 	string whichNodeName = _whichNodeName;
 	if (not alreadyPreloaded[filename])
 		{
@@ -253,6 +355,175 @@ void FileManager::load_content
 
 	}
 
+//----------
+//
+// read_packed_directory--
+//	Read the directory of a packed tree file, and note which embedded bloom
+//	filter file contains each filter.
+//
+//----------
+//
+// Arguments:
+//	const string&	filename:	The name of the packed tree file.
+//
+// Returns:
+//	(nothing); packDirectory, packEntryPos, packEntryPreloaded and
+//	packNameToEntry are filled in.
+//
+//----------
+//
+// Notes:
+//	(1)	No bloom filters are created here; that is deferred until a node is
+//		reached, by preload_packed_entry().
+//
+//----------
+
+void FileManager::read_packed_directory
+   (const string&	filename)
+	{
+	std::ifstream* in = FileManager::open_file(filename,std::ios::binary|std::ios::in,
+	                                           /* positionAtStart*/ true);
+	if (not *in)
+		fatal ("error: FileManager::read_packed_directory()"
+			   " failed to open \"" + filename + "\"");
+
+	// read and validate the header
+
+	packedtreeheader header;
+	in->read ((char*) &header, sizeof(header));
+	if ((size_t) in->gcount() != sizeof(header))
+		fatal ("error: FileManager::read_packed_directory()"
+		       " problem reading header from \"" + filename + "\"");
+
+	if (header.magic == packedtreeheaderMagicUn)
+		fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+		       " looks like an incomplete packed tree file"
+		       " (it seems the file was not completely written)");
+
+	if (header.magic != packedtreeheaderMagic)
+		fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+		       " doesn't look like a packed tree file"
+		       " (incorrect magic number)");
+
+	if (header.version != packedtreeheaderVersion)
+		fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+		       " packed tree file version " + std::to_string(header.version)
+		     + " is not supported by this program");
+
+	if (header.headerSize < sizeof(header))
+		fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+		       " header impossibly small (" + std::to_string(header.headerSize) + " bytes)");
+
+	// read the directory
+
+	packDirectory = new char[header.directoryBytes];
+	if (trackMemory)
+		cerr << "@+" << (void*) packDirectory << " allocating directory for \"" << filename << "\"" << endl;
+
+	in->seekg (header.directoryOffset, in->beg);
+	in->read (packDirectory, header.directoryBytes);
+	if ((u64) in->gcount() != header.directoryBytes)
+		fatal ("error: FileManager::read_packed_directory()"
+		       " problem reading directory from \"" + filename + "\"");
+	if (BloomFilter::reportFileBytes)
+		cerr << "[FileManager read_packed_directory] read " << header.directoryBytes << " bytes " << filename << endl;
+	if (BloomFilter::countFileBytes)
+		{
+		BloomFilter::totalFileReads++;
+		BloomFilter::totalFileBytesRead += sizeof(header) + header.directoryBytes;
+		}
+
+	FileManager::close_file(in);
+
+	// validate each entry, and note the names of the filters in each embedded
+	// file; the names follow the same rules as in
+	// BloomFilter::identify_content()
+
+	u64 dirIx = 0;
+	for (u32 fileIx=0 ; fileIx<header.numFiles ; fileIx++)
+		{
+		if (dirIx + sizeof(packedtreeentry) > header.directoryBytes)
+			fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+			       " directory is truncated at entry " + std::to_string(fileIx));
+
+		packedtreeentry* entry = (packedtreeentry*) (packDirectory + dirIx);
+		u64 recordBytes = sizeof(packedtreeentry) + entry->nameBytes + entry->headerBytes;
+		if ((dirIx + recordBytes > header.directoryBytes)
+		 || (entry->nameBytes == 0)
+		 || (entry->headerBytes < sizeof(bffileheader)))
+			fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+			       " bad directory entry " + std::to_string(fileIx));
+
+		char* name = packDirectory + dirIx + sizeof(packedtreeentry);
+		if (name[entry->nameBytes-1] != 0)
+			fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+			       " unterminated name in directory entry " + std::to_string(fileIx));
+		string bfFilename(name);
+
+		bffileheader* bfHeader = (bffileheader*) (name + entry->nameBytes);
+		if ((bfHeader->headerSize > entry->headerBytes)
+		 || (bfHeader->numVectors < 1)
+		 || (bffileheader_size(bfHeader->numVectors) > bfHeader->headerSize))
+			fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+			       " bad header for \"" + bfFilename + "\"");
+
+		int vectorsPerFilter = BloomFilter::vectors_per_filter(bfHeader->bfKind);
+		u32 numFilters = bfHeader->numVectors / vectorsPerFilter;
+		for (u32 bvIx=0 ; bvIx<bfHeader->numVectors ; bvIx+=vectorsPerFilter)
+			{
+			string bfName;
+			u32 nameOffset = bfHeader->info[bvIx].name;
+			if (nameOffset >= bfHeader->headerSize)
+				fatal ("error: FileManager::read_packed_directory(" + filename + ")"
+				       " bad name offset in header for \"" + bfFilename + "\"");
+			else if (nameOffset != 0)
+				bfName = string(((char*) bfHeader) + nameOffset);
+			else if (numFilters == 1)
+				bfName = BloomFilter::default_filter_name(bfFilename);
+			else
+				bfName = BloomFilter::default_filter_name(bfFilename,bvIx);
+			packNameToEntry[bfName] = fileIx;
+			}
+
+		packEntryPos.emplace_back(dirIx);
+		packEntryPreloaded.emplace_back(false);
+		dirIx += recordBytes;
+		}
+	}
+
+//----------
+//
+// preload_packed_entry--
+//	Identify the content of one of the bloom filter files embedded in a
+//	packed tree file, and install it in the corresponding nodes.
+//
+//----------
+//
+// Arguments:
+//	u32		entryIx:	Index of the embedded file in the directory.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+
+void FileManager::preload_packed_entry
+   (u32		entryIx)
+	{
+	if (packEntryPreloaded[entryIx]) return;
+
+	packedtreeentry* entry = (packedtreeentry*) (packDirectory + packEntryPos[entryIx]);
+	char* name = ((char*) entry) + sizeof(packedtreeentry);
+	string bfFilename(name);
+	bffileheader* bfHeader = (bffileheader*) (name + entry->nameBytes);
+
+	vector<pair<string,BloomFilter*>> content
+		= BloomFilter::identify_content(bfHeader,bfFilename,packFilename,entry->offset);
+	install_content (packFilename, content);
+
+	packEntryPreloaded[entryIx] = true;
+	}
+
 //----------
 //
 // open_file, close_file--
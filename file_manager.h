@@ -30,8 +30,12 @@ public:
 	FileManager(BloomTree* root, bool validateConsistency=false);
 	virtual ~FileManager();
 
-	virtual void preload_content(const std::string& filename);
+	virtual void preload_content(const std::string& filename,const std::string& whichNodeName="");
 	virtual void load_content(const std::string& filename,const std::string& whichNodeName="");
+	virtual void install_content(const std::string& filename,
+	                             std::vector<std::pair<std::string,BloomFilter*>>& content);
+	virtual void read_packed_directory(const std::string& filename);
+	virtual void preload_packed_entry(std::uint32_t entryIx);
 
 public:
 	bool reportLoad = false;
@@ -51,6 +55,18 @@ public:
 									// .. a filename to the to true if the file
 									// .. has already been preloaded, false if
 									// .. not
+	std::string packFilename;		// non-empty => the tree was read from
+									// .. this packed tree file
+	char* packDirectory;			// (only valid if packFilename is
+									// .. non-empty) the packed file's
+									// .. directory, read once at startup
+	std::vector<std::uint64_t> packEntryPos; // offset, into packDirectory, of
+									// .. each embedded file's record
+	std::vector<bool> packEntryPreloaded; // true => the embedded file's
+									// .. content has been identified
+	std::unordered_map<std::string,std::uint32_t> packNameToEntry; // hash
+									// .. table mapping a node name to the
+									// .. embedded file containing it
 
 public:
 	static bool reportOpenClose;
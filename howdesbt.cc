@@ -15,7 +15,11 @@
 #include "cmd_make_bf.h"
 #include "cmd_cluster.h"
 #include "cmd_build_sbt.h"
+#include "cmd_insert_sbt.h"
+#include "cmd_remove_sbt.h"
 #include "cmd_query.h"
+#include "cmd_serve.h"
+#include "cmd_pack_tree.h"
 #include "cmd_version.h"
 #ifdef includeSecondaryCommands
 #include "cmd_query_bf.h"
@@ -32,6 +36,7 @@
 #include "cmd_load_test.h"
 #include "cmd_sabuhash_test.h"
 #include "cmd_validate_rrr.h"
+#include "cmd_validate_popcount.h"
 #include "cmd_bf_operate.h"
 #include "cmd_bv_operate.h"
 #endif // includeSecondaryCommands
@@ -103,7 +108,12 @@ int main
 	cmd->add_command_alias                       ("makefilter");
 	cmd->add_subcommand (new ClusterCommand      ("cluster"));
 	cmd->add_subcommand (new BuildSBTCommand     ("build"));
+	cmd->add_subcommand (new InsertSBTCommand    ("insert"));
+	cmd->add_subcommand (new RemoveSBTCommand    ("remove"));
 	cmd->add_subcommand (new QueryCommand        ("query"));
+	cmd->add_subcommand (new ServeCommand        ("serve"));
+	cmd->add_subcommand (new PackTreeCommand     ("packtree"));
+	cmd->add_command_alias                       ("treepack");
 	cmd->add_subcommand (new VersionCommand      ("version"));
 
 	// secondary commands
@@ -139,6 +149,8 @@ int main
 	cmd->add_subcommand (new SabuhashTestCommand ("sabuhash"));
 	cmd->add_subcommand (new ValidateRrrCommand  ("validaterrr"));
 	cmd->add_command_alias                       ("rrrvalidate");
+	cmd->add_subcommand (new ValidatePopcountCommand ("validatepopcount"));
+	cmd->add_command_alias                       ("popcountvalidate");
 	cmd->add_subcommand (new BFOperateCommand    ("bfoperate"));
 	cmd->add_command_alias                       ("bfop");
 	cmd->add_subcommand (new BVOperateCommand    ("bvoperate"));
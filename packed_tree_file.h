@@ -0,0 +1,76 @@
+#ifndef packed_tree_file_H
+#define packed_tree_file_H
+
+#include <cstdint>
+
+//----------
+//
+// File layout for packed tree files
+//
+//----------
+//
+// Implementation Notes
+//	[1]	A packed tree file holds an entire tree -- its topology and every
+//		node's bloom filter file -- in one file. It is written by the packtree
+//		command, and can be used in place of a topology file by commands that
+//		only read a tree (e.g. query). Commands that write node files (build,
+//		insert, remove) reject it.
+//	[2]	The file consists of a header, the embedded bloom filter files, the
+//		topology text, and a directory, in that order.
+//	[3]	Each embedded bloom filter file is copied verbatim, and begins on a
+//		multiple of pageSize. Offsets within an embedded file's header are
+//		relative to the start of that embedded file, so they remain valid; the
+//		reader adds the embedded file's offset. Since pageSize is a multiple of
+//		the system's page size, bit vectors can be memory mapped as they are
+//		for a standalone file.
+//	[4]	The topology text is in the name[filename] form (see read_topology()).
+//		The bracketed filenames are informational only; nodes are matched to
+//		filters by name.
+//	[5]	The directory contains one record for each embedded file, in the same
+//		order as the embedded files. Each record is a packedtreeentry followed
+//		by the embedded file's original name (zero-terminated) and then by a
+//		copy of the embedded file's header (bffileheader, including its
+//		info[] array and names). Both are padded to a multiple of 16 bytes. This
+//		allows the reader to identify the content of every node from a single
+//		read of the directory.
+//
+//----------
+
+struct packedtreeheader
+	{
+	std::uint64_t	magic;			// [00] (packedtreeheaderMagic)
+	std::uint32_t	headerSize;		// [08] number of bytes in the header record
+	std::uint32_t	version;		// [0C] file format version (1)
+	std::uint32_t	pageSize;		// [10] alignment of each embedded file
+	std::uint32_t	numFiles;		// [14] number of embedded bloom filter files
+	std::uint64_t	topologyOffset;	// [18] offset (from start of file) to the
+									//      .. topology text
+	std::uint64_t	topologyBytes;	// [20] number of bytes of topology text
+	std::uint64_t	directoryOffset;// [28] offset (from start of file) to the
+									//      .. directory
+	std::uint64_t	directoryBytes;	// [30] number of bytes in the directory
+	std::uint64_t	padding;		// [38] (expected to be 0)
+	};								// size: 0x40
+
+struct packedtreeentry
+	{
+	std::uint64_t	offset;			// [x+00] offset (from start of packed
+									//        .. file) to the embedded file
+	std::uint64_t	numBytes;		// [x+08] size of the embedded file
+	std::uint32_t	nameBytes;		// [x+10] number of bytes following this
+									//        .. record for the original name
+									//        .. (including terminator and
+									//        .. padding)
+	std::uint32_t	headerBytes;	// [x+14] number of bytes following the
+									//        .. name for the header copy
+									//        .. (including padding)
+	};								// size: 0x18
+
+const std::uint32_t packedtreeheaderVersion = 1;
+
+const std::uint64_t packedtreeheaderMagic   = 0xD5326B6370544253; // little-endian ascii "SBTpck" plus some extra bits
+const std::uint64_t packedtreeheaderMagicUn = 0xCD96A1E02C96649A; // (used for header written to an unfinished file)
+
+#define packedtree_default_page_size 4096
+
+#endif // packed_tree_file_H
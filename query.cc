@@ -12,7 +12,6 @@
 using std::string;
 using std::vector;
 using std::pair;
-using std::set;
 using std::cout;
 using std::cerr;
 using std::endl;
@@ -68,25 +67,68 @@ void Query::kmerize
 
 	// scan the sequence's kmers, convert to hash positions, and collect the
 	// distinct positions; optionally collect the corresponding kmers
+	//
+	// nota bene: with sabuhash we stream the sequence through a rolling hash,
+	//            so no kmer strings need to be built (except for debugging or
+	//            when the caller wants the kmers); we use a local copy of the
+	//            filter's hasher since the rolling hash keeps its state in the
+	//            hasher
+
+	u64 maxKmers = seq.length() + 1 - kmerSize;
+	kmerPositions.reserve(maxKmers);
+
+	// when only distinct positions are wanted, we track the positions seen so
+	// far in an open-addressing hash set; BloomFilter::npos marks empty slots,
+	// since it can't be a valid position
+
+	vector<u64> positionSet;
+	u32 setBits = 0;
+	if (distinct)
+		{
+		while ((((u64) 1) << setBits) < 2*maxKmers) setBits++;
+		positionSet.assign(((u64) 1) << setBits, BloomFilter::npos);
+		}
+	u64 setMask = (((u64) 1) << setBits) - 1;
+
+	bool needMers = (populateKmers) || (dbgKmerize) || (dbgKmerizeAll);
+	const char* s = seq.c_str();
 
-    set<u64> positionSet;
-	pair<set<u64>::iterator,bool> status;
+#ifdef useSabuHash
+	HashCanonical hasher(*bf->hasher1);
+	hasher.reset_rolling_hash();
+#endif // useSabuHash
 
 	size_t goodNtRunLen = 0;
 	for (size_t ix=0; ix<seq.length() ; ix++)
 		{
-		if (not nt_is_acgt(seq[ix])) { goodNtRunLen = 0;  continue; }
+#ifdef useSabuHash
+		// (rolling_hash resets itself when it sees a non-ACGT character)
+		u64 h = hasher.rolling_hash(s[ix], (ix >= kmerSize)? s[ix-kmerSize] : 0);
+#endif // useSabuHash
+
+		if (not nt_is_acgt(s[ix])) { goodNtRunLen = 0;  continue; }
 		if (++goodNtRunLen < kmerSize) continue;
 
-		string mer = seq.substr(ix+1-kmerSize,kmerSize);
-		u64 pos = bf->mer_to_position(mer);
+		string mer;
+		if (needMers) mer = seq.substr(ix+1-kmerSize,kmerSize);
+
+#ifdef useSabuHash
+		u64 pos = bf->hash_to_position(h);
+#else
+		u64 pos = bf->mer_to_position(seq.substr(ix+1-kmerSize,kmerSize));
+#endif // useSabuHash
+
 		if (pos != BloomFilter::npos)
 			{
 			if (distinct)
 				{
-				status = positionSet.insert(pos);
-				if (status.second == false) // pos was already in the set
+				u64 slot = (pos * 0x9E3779B97F4A7C15) >> (64-setBits);
+				while ((positionSet[slot] != BloomFilter::npos)
+				    && (positionSet[slot] != pos))
+					slot = (slot+1) & setMask;
+				if (positionSet[slot] == pos) // pos was already in the set
 					continue;
+				positionSet[slot] = pos;
 				}
 			kmerPositions.emplace_back(pos);
 			if (populateKmers) kmers.emplace_back(mer);
@@ -166,6 +208,58 @@ u64 Query::kmer_positions_hash
 	return (posSum + posXor) & 0x1FFFFFFF;  // (returning only 29 bits)
 	}
 
+//----------
+//
+// worker_copy, absorb_worker_copy--
+//	Make a copy of a query's search state, for a worker thread that will
+//	search a subtree concurrently with the original query; and fold the copy's
+//	results back into the original.
+//
+//----------
+//
+// Notes:
+//	(1)	The copy gets the current kmerPositions list and the current
+//		numUnresolved/numPassed/numFailed values, but starts with empty state
+//		stacks and no matches. The sequence itself is not copied, since the
+//		search doesn't need it.
+//	(2)	absorb_worker_copy() appends the copy's matches to ours, so callers
+//		should absorb copies in the order the subtrees would have been searched
+//		by a single thread.
+//
+//----------
+
+Query* Query::worker_copy ()
+	{
+	querydata qd;
+	qd.batchIx = batchIx;
+	qd.name    = name;
+
+	Query* wq = new Query(qd,threshold);
+	wq->kmerPositions    = kmerPositions;
+	wq->numPositions     = numPositions;
+	wq->neededToPass     = neededToPass;
+	wq->neededToFail     = neededToFail;
+	wq->numUnresolved    = numUnresolved;
+	wq->numPassed        = numPassed;
+	wq->numFailed        = numFailed;
+	wq->adjustKmerCounts = adjustKmerCounts;
+	wq->dbgKmerize       = dbgKmerize;
+	wq->dbgKmerizeAll    = dbgKmerizeAll;
+	return wq;
+	}
+
+void Query::absorb_worker_copy
+   (const Query* wq)
+	{
+	nodesExamined += wq->nodesExamined;
+	matches.insert            (matches.end(),
+	                           wq->matches.begin(), wq->matches.end());
+	matchesNumPassed.insert   (matchesNumPassed.end(),
+	                           wq->matchesNumPassed.begin(), wq->matchesNumPassed.end());
+	matchesAdjustedHits.insert(matchesAdjustedHits.end(),
+	                           wq->matchesAdjustedHits.begin(), wq->matchesAdjustedHits.end());
+	}
+
 //----------
 //
 // read_query_file--
@@ -31,6 +31,8 @@ public:
 	virtual void sort_kmer_positions ();
 	virtual void dump_kmer_positions (std::uint64_t numUnresolved=-1);
 	virtual std::uint64_t kmer_positions_hash (std::uint64_t numUnresolved=-1);
+	virtual Query* worker_copy ();
+	virtual void absorb_worker_copy (const Query* wq);
 
 public:
 	std::uint32_t batchIx;	// index of this query within a batch
@@ -7,6 +7,16 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <mutex>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define crc32c_hardware_possible
+#endif
 
 #include "utilities.h"
 
@@ -942,6 +952,169 @@ u32 update_crc (u32 crc, u8 ch)
 	return (crc>>8) ^ crcTable[(crc^ch) & 0xFF];
 	}
 
+//----------
+//
+// crc32c--
+//	Compute a CRC32C (Castagnoli) checksum over a buffer of bytes, or continue
+//	one begun over earlier bytes.
+//
+//----------
+//
+// Arguments:
+//	u32			crc:		The crc of the previous bytes (zero if there are
+//							none).
+//	const void*	data:		The bytes to "add" to the crc.
+//	size_t		numBytes:	The number of bytes in data.
+//
+// Returns:
+//	The new crc value.
+//
+//----------
+//
+// Notes:
+//	(1)	Unlike update_crc(), this uses the Castagnoli polynomial, for which
+//		x86-64 processors with SSE4.2 have an instruction. We check for that
+//		instruction at run time, and fall back on a table if it's missing.
+//	(2)	The bit inversion before and after is done here, so the result over
+//		a series of buffers is the same as over their concatenation, e.g.
+//		  crc = crc32c(0,a,aLen)
+//		  crc = crc32c(crc,b,bLen)
+//
+//----------
+
+static std::once_flag crc32cTableInitialized;
+static u32 crc32cTable[256];
+
+
+static void generate_crc32c_table (void)
+	{
+	// nota bene: this is only called through std::call_once, so the table is
+	//            complete before any thread can use it
+
+	u32	crc, poly;
+	int	i, j;
+
+	poly = 0x82F63B78L;
+	for (i=0 ; i<256 ; i++)
+		{
+		crc = i;
+		for (j=8 ; j>0 ; j--)
+			{
+			if (crc & 1) crc = (crc >> 1) ^ poly;
+			        else crc >>= 1;
+			}
+		crc32cTable[i] = crc;
+		}
+	}
+
+
+#ifdef crc32c_hardware_possible
+__attribute__ ((target ("sse4.2")))
+static u32 crc32c_hardware (u32 crc, const u8* data, size_t numBytes)
+	{
+	u64 crc64 = crc;
+	while (numBytes >= 8)
+		{
+		u64 word;
+		std::memcpy (&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64 (crc64, word);
+		data += 8;  numBytes -= 8;
+		}
+
+	crc = (u32) crc64;
+	while (numBytes-- > 0)
+		crc = _mm_crc32_u8 (crc, *(data++));
+	return crc;
+	}
+#endif // crc32c_hardware_possible
+
+
+u32 crc32c (u32 crc, const void* _data, size_t numBytes)
+	{
+	const u8* data = (const u8*) _data;
+	crc = ~crc;
+
+#ifdef crc32c_hardware_possible
+	static const int haveHardware = (__builtin_cpu_supports ("sse4.2"))? 1 : 0;
+	if (haveHardware == 1)
+		return ~crc32c_hardware (crc, data, numBytes);
+#endif // crc32c_hardware_possible
+
+	std::call_once (crc32cTableInitialized, generate_crc32c_table);
+	while (numBytes-- > 0)
+		crc = (crc>>8) ^ crc32cTable[(crc ^ *(data++)) & 0xFF];
+	return ~crc;
+	}
+
+//----------
+//
+// temp_filename, commit_temp_file--
+//	Support for replacing a file atomically. The caller writes the content
+//	to the temporary file, closes it, then calls commit_temp_file().
+//
+//----------
+//
+// Arguments (temp_filename):
+//	const string&	filename:		The name of the file to be replaced.
+//
+// Returns (temp_filename):
+//	The name of a temporary file, in the same directory.
+//
+//----------
+//
+// Arguments (commit_temp_file):
+//	const string&	tempFilename:	The name of the temporary file.
+//	const string&	filename:		The name of the file to be replaced.
+//
+// Returns (commit_temp_file):
+//	(nothing); failures are fatal
+//
+//----------
+//
+// Notes:
+//	(1)	The temporary file is flushed to disk before it is renamed, and the
+//		directory is flushed after, so after a crash the file will have
+//		either its old content or its new content, never part of the new.
+//
+//----------
+
+string temp_filename
+   (const string&	filename)
+	{
+	return filename + ".tmp";
+	}
+
+
+void commit_temp_file
+   (const string&	tempFilename,
+	const string&	filename)
+	{
+	int fd = ::open (tempFilename.c_str(), O_RDONLY);
+	if (fd < 0)
+		fatal ("error: failed to reopen \"" + tempFilename + "\"");
+	if (::fsync (fd) != 0)
+		fatal ("error: failed to flush \"" + tempFilename + "\" to disk");
+	::close (fd);
+
+	if (std::rename (tempFilename.c_str(), filename.c_str()) != 0)
+		fatal ("error: failed to rename \"" + tempFilename + "\""
+		     + " to \"" + filename + "\"");
+
+	string dirName = ".";
+	string::size_type slashIx = filename.find_last_of("/");
+	if (slashIx == 0)
+		dirName = "/";
+	else if (slashIx != string::npos)
+		dirName = filename.substr(0,slashIx);
+
+	fd = ::open (dirName.c_str(), O_RDONLY);
+	if (fd >= 0)
+		{ // (failure to flush the directory isn't fatal)
+		::fsync (fd);
+		::close (fd);
+		}
+	}
+
 //----------
 //
 // fatal--
@@ -34,6 +34,9 @@ std::string   to_lower               (const std::string& s);
 std::string   reverse_complement     (const std::string& s);
 bool          nt_is_acgt             (const char nt);
 std::uint32_t update_crc             (std::uint32_t crc, std::uint8_t ch);
+std::uint32_t crc32c                 (std::uint32_t crc, const void* data, size_t numBytes);
+std::string   temp_filename          (const std::string& filename);
+void          commit_temp_file       (const std::string& tempFilename, const std::string& filename);
 void          fatal                  (const std::string& message="");
 
 #define round_up_16(b)  ((((std::uint64_t) (b))+15)&(~15))